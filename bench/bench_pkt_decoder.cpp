@@ -0,0 +1,505 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <libsrc/cobs_decoder.h>
+#include <libsrc/pkt_corpus.h>
+#include <libsrc/pkt_decoder.h>
+#include <map>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Minimum wall time spent on each scenario, so short streams are repeated enough to be measurable
+static const double MIN_SECONDS( 0.25 );
+
+// Wire throughput (MB/s) of each result in a baseline run (--baseline), keyed by scenario and
+// engine, and where to save this run's results for later comparison (--save)
+static std::map< std::string, double > baselineResults;
+static FILE* saveFile( nullptr );
+
+// Ends a result line, with its gain over the baseline run if there is one
+static void compareWithBaseline( const std::string& key, double wireMBps )
+{
+   if ( nullptr != saveFile )
+   {
+      fprintf( saveFile, "%s\t%f\n", key.c_str(), wireMBps );
+   }
+   auto baseline = baselineResults.find( key );
+   if ( baseline != baselineResults.end() )
+   {
+      printf( "  %+6.1f%% vs baseline", 100.0 * ( wireMBps / baseline->second - 1.0 ) );
+   }
+   printf( "\n" );
+}
+
+static bool loadBaseline( const char* path )
+{
+   FILE* file = fopen( path, "r" );
+   if ( nullptr == file )
+   {
+      return false;
+   }
+   char line[ 256 ];
+   while ( nullptr != fgets( line, sizeof( line ), file ) )
+   {
+      char* tab = strrchr( line, '\t' );
+      if ( nullptr != tab )
+      {
+         baselineResults[ std::string( line, tab ) ] = atof( tab + 1 );
+      }
+   }
+   fclose( file );
+   return true;
+}
+
+// Hardware counters read around each timed loop (--counters). Each counter is opened on its own,
+// so one the CPU or hypervisor doesn't expose is reported as n/a without losing the others
+class PerfCounters
+{
+ public:
+   enum Counter
+   {
+      CYCLES,
+      INSTRUCTIONS,
+      BRANCH_MISSES,
+      L1D_MISSES,
+      COUNTER_COUNT
+   };
+
+   PerfCounters() : m_enabled( false )
+   {
+      for ( int counter = 0; counter < COUNTER_COUNT; ++counter )
+      {
+         m_fds[ counter ] = -1;
+         m_values[ counter ] = -1.0;
+      }
+   }
+
+   ~PerfCounters()
+   {
+#ifdef __linux__
+      for ( int fd : m_fds )
+      {
+         if ( fd >= 0 )
+         {
+            close( fd );
+         }
+      }
+#endif
+   }
+
+   // Returns false, with the reason in error, if no counter could be opened at all
+   bool open( std::string& error )
+   {
+#ifdef __linux__
+      const uint64_t configs[ COUNTER_COUNT ][ 2 ] = {
+         { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+         { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+         { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+         { PERF_TYPE_HW_CACHE,
+           PERF_COUNT_HW_CACHE_L1D | ( PERF_COUNT_HW_CACHE_OP_READ << 8 )
+              | ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 ) },
+      };
+      bool opened = false;
+      for ( int counter = 0; counter < COUNTER_COUNT; ++counter )
+      {
+         perf_event_attr attr;
+         memset( &attr, 0, sizeof( attr ) );
+         attr.size = sizeof( attr );
+         attr.type = static_cast< uint32_t >( configs[ counter ][ 0 ] );
+         attr.config = configs[ counter ][ 1 ];
+         attr.disabled = 1;
+         attr.exclude_kernel = 1;
+         attr.exclude_hv = 1;
+         // Scaled by enabled/running time if the PMU has to multiplex the counters
+         attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+         m_fds[ counter ] =
+            static_cast< int >( syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 ) );
+         if ( m_fds[ counter ] >= 0 )
+         {
+            opened = true;
+         }
+         else if ( error.empty() )
+         {
+            error = strerror( errno );
+         }
+      }
+      m_enabled = opened;
+      return opened;
+#else
+      error = "perf_event_open is Linux only";
+      return false;
+#endif
+   }
+
+   bool enabled() const { return m_enabled; }
+
+   void start()
+   {
+#ifdef __linux__
+      for ( int fd : m_fds )
+      {
+         if ( fd >= 0 )
+         {
+            ioctl( fd, PERF_EVENT_IOC_RESET, 0 );
+            ioctl( fd, PERF_EVENT_IOC_ENABLE, 0 );
+         }
+      }
+#endif
+   }
+
+   void stop()
+   {
+#ifdef __linux__
+      for ( int counter = 0; counter < COUNTER_COUNT; ++counter )
+      {
+         // Value, time enabled, time running
+         uint64_t reading[ 3 ];
+         int fd = m_fds[ counter ];
+         m_values[ counter ] = -1.0;
+         if ( ( fd >= 0 ) && ( 0 == ioctl( fd, PERF_EVENT_IOC_DISABLE, 0 ) )
+              && ( sizeof( reading ) == read( fd, reading, sizeof( reading ) ) )
+              && ( reading[ 2 ] > 0 ) )
+         {
+            m_values[ counter ] =
+               static_cast< double >( reading[ 0 ] ) * reading[ 1 ] / reading[ 2 ];
+         }
+      }
+#endif
+   }
+
+   // The last start/stop's count, or a negative value if the counter isn't available
+   double value( Counter counter ) const { return m_values[ counter ]; }
+
+   // Prints the last start/stop's counts, relative to the wire bytes the loop decoded
+   void print( double wireBytes ) const
+   {
+      if ( !m_enabled )
+      {
+         return;
+      }
+      printf( "         " );
+      printRatio( "cycles/byte", CYCLES, 1.0 / wireBytes );
+      if ( ( value( CYCLES ) > 0.0 ) && ( value( INSTRUCTIONS ) >= 0.0 ) )
+      {
+         printf( " %7.2f IPC", value( INSTRUCTIONS ) / value( CYCLES ) );
+      }
+      else
+      {
+         printf( " %7s IPC", "n/a" );
+      }
+      printRatio( "branch-misses/KB", BRANCH_MISSES, 1024.0 / wireBytes );
+      printRatio( "L1d-misses/KB", L1D_MISSES, 1024.0 / wireBytes );
+      printf( "\n" );
+   }
+
+ private:
+   void printRatio( const char* name, Counter counter, double scale ) const
+   {
+      if ( value( counter ) >= 0.0 )
+      {
+         printf( " %7.2f %s", value( counter ) * scale, name );
+      }
+      else
+      {
+         printf( " %7s %s", "n/a", name );
+      }
+   }
+
+   bool m_enabled;
+   int m_fds[ COUNTER_COUNT ];
+   double m_values[ COUNTER_COUNT ];
+};
+
+static PerfCounters perfCounters;
+
+// A framing engine under test, wrapped so every engine runs through the same timing loop
+struct Engine
+{
+   const char* name;
+   void* ( *create )( pkt_read_fn_t callback, void* ctx );
+   void ( *destroy )( void* decoder );
+   void ( *write )( void* decoder, size_t len, const uint8_t* data );
+   pkt_corpus_framing_t framing;
+   // Whether the framing can skip garbage between frames without losing the next frame
+   bool skipsGarbage;
+};
+
+static const Engine ENGINES[] = {
+   { "dle",
+     []( pkt_read_fn_t cb, void* ctx ) -> void* { return pkt_decoder_create( cb, ctx ); },
+     []( void* d ) { pkt_decoder_destroy( static_cast< pkt_decoder_t* >( d ) ); },
+     []( void* d, size_t len, const uint8_t* data ) {
+        pkt_decoder_write_bytes( static_cast< pkt_decoder_t* >( d ), len, data );
+     },
+     PKT_CORPUS_DLE,
+     true },
+   { "cobs",
+     []( pkt_read_fn_t cb, void* ctx ) -> void* { return cobs_decoder_create( cb, ctx ); },
+     []( void* d ) { cobs_decoder_destroy( static_cast< cobs_decoder_t* >( d ) ); },
+     []( void* d, size_t len, const uint8_t* data ) {
+        cobs_decoder_write_bytes( static_cast< cobs_decoder_t* >( d ), len, data );
+     },
+     PKT_CORPUS_COBS,
+     false },
+};
+
+// Shape of the traffic in a scenario
+struct Scenario
+{
+   const char* name;
+   size_t minPayload;
+   size_t maxPayload;
+   // Probability that a payload byte is one of the values the framing has to escape
+   double escapeRate;
+   // Sizes of the write_bytes calls
+   size_t minChunk;
+   size_t maxChunk;
+   // Fraction of the wire bytes that are line noise between frames
+   double garbageRatio;
+   // Share of frames that are cut short, or too long to deliver
+   double damagedRate;
+};
+
+static const Scenario SCENARIOS[] = {
+   { "short frames, no escapes", 8, 32, 0.0, 4096, 4096, 0.0, 0.0 },
+   { "short frames, 5% escapes", 8, 32, 0.05, 4096, 4096, 0.0, 0.0 },
+   { "max frames, no escapes", 512, 512, 0.0, 4096, 4096, 0.0, 0.0 },
+   { "max frames, 5% escapes", 512, 512, 0.05, 4096, 4096, 0.0, 0.0 },
+   { "mixed frames, 1% escapes", 1, 512, 0.01, 4096, 4096, 0.0, 0.0 },
+   { "mixed frames, 64-byte writes", 1, 512, 0.01, 64, 64, 0.0, 0.0 },
+   { "mixed frames, 1-4096 byte writes", 1, 512, 0.01, 1, 4096, 0.0, 0.0 },
+   { "mixed frames, 10% damaged", 1, 512, 0.01, 4096, 4096, 0.0, 0.1 },
+   { "mixed frames, 50% garbage", 1, 512, 0.01, 4096, 4096, 0.5, 0.0 },
+   { "mixed frames, 90% garbage", 1, 512, 0.01, 4096, 4096, 0.9, 0.0 },
+   { "short frames, 99% garbage", 8, 32, 0.01, 4096, 4096, 0.99, 0.0 },
+};
+
+// Total payload bytes generated per scenario
+static const size_t PAYLOAD_BYTES( 8 * 1024 * 1024 );
+
+struct Counters
+{
+   size_t packets;
+   size_t bytes;
+};
+
+static void countingCallback( void* ctx, size_t data_length, const uint8_t* data )
+{
+   ( void )data;
+   auto* counters = static_cast< Counters* >( ctx );
+   counters->packets++;
+   counters->bytes += data_length;
+}
+
+// Every engine and every run sees the same packets
+static pkt_corpus_t* makeCorpus( const Scenario& scenario, pkt_corpus_framing_t framing )
+{
+   pkt_corpus_config_t config;
+   pkt_corpus_default_config( &config );
+   config.seed = 0x5eed;
+   config.framing = framing;
+   config.payload_bytes = PAYLOAD_BYTES;
+   config.min_payload = scenario.minPayload;
+   config.max_payload = scenario.maxPayload;
+   config.escape_rate = scenario.escapeRate;
+   config.garbage_ratio = scenario.garbageRatio;
+   config.truncated_rate = scenario.damagedRate / 2;
+   config.overflow_rate = scenario.damagedRate / 2;
+   config.min_chunk = scenario.minChunk;
+   config.max_chunk = scenario.maxChunk;
+   return pkt_corpus_create( &config );
+}
+
+// Writes the whole corpus to a decoder in its write sizes
+static void writeCorpus( const pkt_corpus_t* corpus,
+                         void ( *write )( void* decoder, size_t len, const uint8_t* data ),
+                         void* decoder )
+{
+   const uint8_t* stream = pkt_corpus_stream( corpus );
+   const size_t* chunks = pkt_corpus_chunks( corpus );
+   for ( size_t chunk = 0; chunk < pkt_corpus_chunk_count( corpus ); ++chunk )
+   {
+      write( decoder, chunks[ chunk ], stream );
+      stream += chunks[ chunk ];
+   }
+}
+
+static void runScenario( const Scenario& scenario, const Engine& engine )
+{
+   if ( ( scenario.garbageRatio > 0.0 ) && !engine.skipsGarbage )
+   {
+      printf( "  %-6s (skipped: framing cannot resynchronize past garbage)\n", engine.name );
+      return;
+   }
+   pkt_corpus_t* corpus = makeCorpus( scenario, engine.framing );
+   size_t streamLength = pkt_corpus_stream_length( corpus );
+   size_t packetCount = pkt_corpus_packet_count( corpus );
+
+   Counters counters = { 0, 0 };
+   void* decoder = engine.create( countingCallback, &counters );
+   size_t passes = 0;
+   auto start = std::chrono::steady_clock::now();
+   double elapsed = 0.0;
+   perfCounters.start();
+   do
+   {
+      writeCorpus( corpus, engine.write, decoder );
+      ++passes;
+      elapsed = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+   } while ( elapsed < MIN_SECONDS );
+   perfCounters.stop();
+   engine.destroy( decoder );
+   pkt_corpus_destroy( corpus );
+
+   if ( counters.packets != packetCount * passes )
+   {
+      printf( "  %-6s ERROR: decoded %zu packets, expected %zu\n",
+              engine.name,
+              counters.packets,
+              packetCount * passes );
+      return;
+   }
+   double wireBytes = static_cast< double >( streamLength ) * passes;
+   printf( "  %-6s %9.1f MB/s wire %9.1f MB/s payload %8.2f Mpkt/s  (%.2f%% overhead)",
+           engine.name,
+           wireBytes / elapsed / 1e6,
+           counters.bytes / elapsed / 1e6,
+           counters.packets / elapsed / 1e6,
+           100.0 * ( streamLength - counters.bytes / passes ) / ( counters.bytes / passes ) );
+   compareWithBaseline( std::string( scenario.name ) + "/" + engine.name,
+                        wireBytes / elapsed / 1e6 );
+   perfCounters.print( wireBytes );
+}
+
+// Keeps roughly one packet type in twelve
+static bool typeFilter( void* ctx, size_t data_length, const uint8_t* data )
+{
+   ( void )ctx;
+   ( void )data_length;
+   return data[ 0 ] < 0x50;
+}
+
+static void filteringCallback( void* ctx, size_t data_length, const uint8_t* data )
+{
+   if ( typeFilter( nullptr, data_length, data ) )
+   {
+      countingCallback( ctx, data_length, data );
+   }
+}
+
+// Compares dropping unwanted packet types in the callback with dropping them after their first
+// byte with pkt_decoder_set_filter
+static void runFilterComparison( const Scenario& scenario )
+{
+   pkt_corpus_t* corpus = makeCorpus( scenario, PKT_CORPUS_DLE );
+   printf( "%s, 1 in 12 packet types wanted\n", scenario.name );
+   for ( bool early : { false, true } )
+   {
+      Counters counters = { 0, 0 };
+      pkt_decoder_t* decoder =
+         pkt_decoder_create( early ? countingCallback : filteringCallback, &counters );
+      if ( early )
+      {
+         pkt_decoder_set_filter( decoder, 1, typeFilter, nullptr );
+      }
+      size_t passes = 0;
+      auto start = std::chrono::steady_clock::now();
+      double elapsed = 0.0;
+      perfCounters.start();
+      do
+      {
+         writeCorpus( corpus, ENGINES[ 0 ].write, decoder );
+         ++passes;
+         elapsed =
+            std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+      } while ( elapsed < MIN_SECONDS );
+      perfCounters.stop();
+      pkt_decoder_destroy( decoder );
+      const char* name = early ? "filter after 1 byte" : "filter in callback";
+      double wireBytes = static_cast< double >( pkt_corpus_stream_length( corpus ) ) * passes;
+      double wireMBps = wireBytes / elapsed / 1e6;
+      printf( "  %-22s %9.1f MB/s wire %8.2f Mpkt/s kept",
+              name,
+              wireMBps,
+              counters.packets / elapsed / 1e6 );
+      compareWithBaseline( std::string( scenario.name ) + "/" + name, wireMBps );
+      perfCounters.print( wireBytes );
+   }
+   pkt_corpus_destroy( corpus );
+}
+
+int main( int argc, char** argv )
+{
+   // --save FILE records this run's results; --baseline FILE compares against a saved run (for
+   // example, the PGO build against pktDecoderBenchBaseline); --counters adds hardware counts
+   // under every result
+   for ( int arg = 1; arg < argc; ++arg )
+   {
+      if ( ( 0 == strcmp( argv[ arg ], "--save" ) ) && ( arg + 1 < argc ) )
+      {
+         saveFile = fopen( argv[ ++arg ], "w" );
+         if ( nullptr == saveFile )
+         {
+            fprintf( stderr, "can't write %s\n", argv[ arg ] );
+            return 1;
+         }
+      }
+      else if ( ( 0 == strcmp( argv[ arg ], "--baseline" ) ) && ( arg + 1 < argc ) )
+      {
+         if ( !loadBaseline( argv[ ++arg ] ) )
+         {
+            fprintf( stderr, "can't read %s\n", argv[ arg ] );
+            return 1;
+         }
+      }
+      else if ( 0 == strcmp( argv[ arg ], "--counters" ) )
+      {
+         std::string error;
+         if ( !perfCounters.open( error ) )
+         {
+            // Still run, so the counters can be asked for in scripts on any machine
+            fprintf( stderr,
+                     "hardware counters unavailable (%s); check "
+                     "/proc/sys/kernel/perf_event_paranoid\n",
+                     error.c_str() );
+         }
+      }
+      else
+      {
+         fprintf( stderr, "usage: %s [--save FILE] [--baseline FILE] [--counters]\n", argv[ 0 ] );
+         return 1;
+      }
+   }
+
+   for ( const Scenario& scenario : SCENARIOS )
+   {
+      printf( "%s (%zu-%zu byte payloads, %zu-%zu byte writes, %.0f%% garbage, %.0f%% damaged)"
+              "\n",
+              scenario.name,
+              scenario.minPayload,
+              scenario.maxPayload,
+              scenario.minChunk,
+              scenario.maxChunk,
+              100.0 * scenario.garbageRatio,
+              100.0 * scenario.damagedRate );
+      for ( const Engine& engine : ENGINES )
+      {
+         runScenario( scenario, engine );
+      }
+   }
+   runFilterComparison( SCENARIOS[ 3 ] );
+   runFilterComparison( SCENARIOS[ 4 ] );
+   if ( nullptr != saveFile )
+   {
+      fclose( saveFile );
+   }
+   return 0;
+}
@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <libsrc/pkt_scheduler.h>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Channel traffic follows a Zipf distribution: the channel of rank k gets a share of the
+// submissions proportional to 1 / k^ZIPF_EXPONENT
+static const size_t NUM_CHANNELS( 20000 );
+static const double ZIPF_EXPONENT( 1.1 );
+static const size_t NUM_SUBMITS( 400000 );
+static const size_t SUBMIT_BYTES( 256 );
+
+static void countingCallback( void* ctx, size_t data_length, const uint8_t* data )
+{
+   ( void )data_length;
+   ( void )data;
+   ( *static_cast< size_t* >( ctx ) )++;
+}
+
+// A long stream of 16-64 byte frames; each channel submits successive slices of it
+static std::vector< uint8_t > makeStream()
+{
+   std::mt19937 rng( 0x5eed );
+   std::vector< uint8_t > stream;
+   while ( stream.size() < 1024 * 1024 )
+   {
+      stream.push_back( STX );
+      for ( size_t len = 16 + rng() % 49; len > 0; --len )
+      {
+         stream.push_back( static_cast< uint8_t >( 0x40 + rng() % 0xC0 ) );
+      }
+      stream.push_back( ETX );
+   }
+   return stream;
+}
+
+// Channel ids in submission order. Ranks are shuffled onto ids so the busiest channels land on
+// arbitrary home workers, as they would in production
+static std::vector< uint32_t > makeSchedule()
+{
+   std::vector< double > cdf( NUM_CHANNELS );
+   double total = 0.0;
+   for ( size_t rank = 0; rank < NUM_CHANNELS; ++rank )
+   {
+      total += 1.0 / std::pow( rank + 1.0, ZIPF_EXPONENT );
+      cdf[ rank ] = total;
+   }
+   std::vector< uint32_t > idOfRank( NUM_CHANNELS );
+   for ( size_t rank = 0; rank < NUM_CHANNELS; ++rank )
+   {
+      idOfRank[ rank ] = static_cast< uint32_t >( rank );
+   }
+   std::mt19937 rng( 0x21bf );
+   std::shuffle( idOfRank.begin(), idOfRank.end(), rng );
+
+   std::uniform_real_distribution< double > pick( 0.0, total );
+   std::vector< uint32_t > schedule( NUM_SUBMITS );
+   for ( uint32_t& id : schedule )
+   {
+      size_t rank = std::lower_bound( cdf.begin(), cdf.end(), pick( rng ) ) - cdf.begin();
+      id = idOfRank[ std::min( rank, NUM_CHANNELS - 1 ) ];
+   }
+   return schedule;
+}
+
+static void run( size_t numWorkers,
+                 bool stealing,
+                 const std::vector< uint8_t >& stream,
+                 const std::vector< uint32_t >& schedule )
+{
+   pkt_scheduler_t* scheduler = pkt_scheduler_create( numWorkers );
+   pkt_scheduler_set_work_stealing( scheduler, stealing );
+   std::vector< size_t > packets( NUM_CHANNELS, 0 );
+   std::vector< pkt_decoder_t* > decoders( NUM_CHANNELS );
+   std::vector< pkt_channel_t* > channels( NUM_CHANNELS );
+   std::vector< size_t > offsets( NUM_CHANNELS, 0 );
+   for ( size_t id = 0; id < NUM_CHANNELS; ++id )
+   {
+      decoders[ id ] = pkt_decoder_create( countingCallback, &packets[ id ] );
+      channels[ id ] =
+         pkt_scheduler_add_channel( scheduler, static_cast< uint32_t >( id ), decoders[ id ] );
+   }
+
+   auto start = std::chrono::steady_clock::now();
+   for ( uint32_t id : schedule )
+   {
+      if ( offsets[ id ] + SUBMIT_BYTES > stream.size() )
+      {
+         offsets[ id ] = 0;
+      }
+      pkt_scheduler_submit( scheduler, channels[ id ], SUBMIT_BYTES, &stream[ offsets[ id ] ] );
+      offsets[ id ] += SUBMIT_BYTES;
+   }
+   pkt_scheduler_drain( scheduler );
+   double elapsed =
+      std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+
+   size_t total = 0;
+   for ( size_t count : packets )
+   {
+      total += count;
+   }
+   printf( "  %2zu workers, stealing %-3s %8.1f MB/s %8.2f Mpkt/s\n",
+           numWorkers,
+           stealing ? "on" : "off",
+           NUM_SUBMITS * SUBMIT_BYTES / elapsed / 1e6,
+           total / elapsed / 1e6 );
+
+   pkt_scheduler_destroy( scheduler );
+   for ( pkt_decoder_t* decoder : decoders )
+   {
+      pkt_decoder_destroy( decoder );
+   }
+}
+
+int main()
+{
+   std::vector< uint8_t > stream = makeStream();
+   std::vector< uint32_t > schedule = makeSchedule();
+   printf( "%zu channels, Zipf exponent %.2f, %zu submissions of %zu bytes\n",
+           NUM_CHANNELS,
+           ZIPF_EXPONENT,
+           NUM_SUBMITS,
+           SUBMIT_BYTES );
+   size_t maxWorkers = std::max( 2u, std::thread::hardware_concurrency() );
+   for ( size_t numWorkers = 1; numWorkers <= maxWorkers; numWorkers *= 2 )
+   {
+      run( numWorkers, false, stream, schedule );
+      if ( numWorkers > 1 )
+      {
+         run( numWorkers, true, stream, schedule );
+      }
+   }
+   return 0;
+}
@@ -0,0 +1,660 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <libsrc/cobs_decoder.h>
+#include <libsrc/pkt_arena.h>
+#include <libsrc/pkt_buffer_pool.h>
+#include <libsrc/pkt_checkpoint.h>
+#include <libsrc/pkt_corpus.h>
+#include <libsrc/pkt_decoder.h>
+#include <string>
+#include <vector>
+
+// Differential fuzzing of the decode engines. Every engine is fed the same stream, split into the
+// same random writes, and must deliver exactly the packets the reference decoder below does. The
+// reference is the original byte-at-a-time state machine, so the engines are held to its
+// semantics, oddities included: a DLE survives between frames and de-stuffs the first byte of the
+// next packet, an overflowing packet is dropped until the next STX, and an STX drops any packet
+// in progress.
+//
+// Built with -DPKT_LIBFUZZER (and -fsanitize=fuzzer) this is a libFuzzer target. Otherwise main()
+// runs generated streams, replays input files, or measures each engine's throughput on a corpus.
+
+typedef std::vector< std::vector< uint8_t > > PacketList;
+
+static void recordPacket( void* ctx, size_t data_length, const uint8_t* data )
+{
+   static_cast< PacketList* >( ctx )->emplace_back( data, data + data_length );
+}
+
+static void countPacket( void* ctx, size_t data_length, const uint8_t* data )
+{
+   ( void )data_length;
+   ( void )data;
+   ++*static_cast< size_t* >( ctx );
+}
+
+// xorshift64*, so a seed reproduces the same splits anywhere
+static uint64_t nextRandom( uint64_t& state )
+{
+   state ^= state >> 12;
+   state ^= state << 25;
+   state ^= state >> 27;
+   return state * 0x2545f4914f6cdd1dULL;
+}
+
+// The decoder as it was before any fast paths
+struct ReferenceDecoder
+{
+   pkt_read_fn_t callback;
+   void* ctx;
+   uint8_t buffer[ MAX_DECODED_DATA_LENGTH ];
+   size_t length;
+   bool valid;
+   bool deStuff;
+};
+
+static void referenceWrite( ReferenceDecoder* decoder, size_t length, const uint8_t* data )
+{
+   for ( size_t idx = 0; idx < length; ++idx )
+   {
+      switch ( data[ idx ] )
+      {
+         case STX: {
+            decoder->length = 0;
+            decoder->valid = true;
+         }
+         break;
+         case ETX: {
+            if ( decoder->valid && ( decoder->length > 0 ) )
+            {
+               decoder->callback( decoder->ctx, decoder->length, decoder->buffer );
+            }
+            decoder->valid = false;
+         }
+         break;
+         case DLE: {
+            decoder->deStuff = true;
+         }
+         break;
+         default: {
+            if ( decoder->valid )
+            {
+               uint8_t currentByte = data[ idx ];
+               if ( decoder->deStuff )
+               {
+                  currentByte &= ~ENC;
+                  decoder->deStuff = false;
+               }
+               if ( MAX_DECODED_DATA_LENGTH > decoder->length )
+               {
+                  decoder->buffer[ decoder->length++ ] = currentByte;
+               }
+               else
+               {
+                  decoder->valid = false;
+               }
+            }
+         }
+      }
+   }
+}
+
+// The filter and route-drop engines drop packets of odd types
+static bool evenType( void* ctx, size_t data_length, const uint8_t* data )
+{
+   ( void )ctx;
+   ( void )data_length;
+   return 0 == ( data[ 0 ] & 0x01 );
+}
+
+// Decoders that need more than a pkt_decoder_t to run
+struct PooledDecoder
+{
+   pkt_buffer_pool_t* pool;
+   pkt_arena_t* arena;
+   pkt_decoder_t* decoder;
+};
+
+struct TimestampDecoder
+{
+   pkt_read_fn_t callback;
+   void* ctx;
+   pkt_decoder_t* decoder;
+};
+
+static void timestampPacket( void* ctx,
+                             size_t data_length,
+                             const uint8_t* data,
+                             const pkt_timestamps_t* timestamps )
+{
+   ( void )timestamps;
+   auto* decoder = static_cast< TimestampDecoder* >( ctx );
+   decoder->callback( decoder->ctx, data_length, data );
+}
+
+struct CheckpointDecoder
+{
+   pkt_read_fn_t callback;
+   void* ctx;
+   pkt_decoder_t* decoder;
+};
+
+// An engine under test, wrapped so every engine runs through the same loops
+struct Engine
+{
+   const char* name;
+   void* ( *create )( pkt_read_fn_t callback, void* ctx );
+   void ( *destroy )( void* decoder );
+   void ( *write )( void* decoder, size_t len, const uint8_t* data );
+   // Packets the reference delivers that this engine is configured to drop
+   bool filtered;
+};
+
+static void writeDle( void* d, size_t len, const uint8_t* data )
+{
+   pkt_decoder_write_bytes( static_cast< pkt_decoder_t* >( d ), len, data );
+}
+
+static void destroyDle( void* d )
+{
+   pkt_decoder_destroy( static_cast< pkt_decoder_t* >( d ) );
+}
+
+static void writePooled( void* d, size_t len, const uint8_t* data )
+{
+   pkt_decoder_write_bytes( static_cast< PooledDecoder* >( d )->decoder, len, data );
+}
+
+static void destroyPooled( void* d )
+{
+   auto* pooled = static_cast< PooledDecoder* >( d );
+   pkt_decoder_destroy( pooled->decoder );
+   if ( nullptr != pooled->pool )
+   {
+      pkt_buffer_pool_destroy( pooled->pool );
+   }
+   if ( nullptr != pooled->arena )
+   {
+      pkt_arena_destroy( pooled->arena );
+   }
+   delete pooled;
+}
+
+static const Engine ENGINES[] = {
+   { "reference",
+     []( pkt_read_fn_t cb, void* ctx ) -> void* {
+        return new ReferenceDecoder{ cb, ctx, {}, 0, false, false };
+     },
+     []( void* d ) { delete static_cast< ReferenceDecoder* >( d ); },
+     []( void* d, size_t len, const uint8_t* data ) {
+        referenceWrite( static_cast< ReferenceDecoder* >( d ), len, data );
+     },
+     false },
+   { "dle",
+     []( pkt_read_fn_t cb, void* ctx ) -> void* { return pkt_decoder_create( cb, ctx ); },
+     destroyDle,
+     writeDle,
+     false },
+   { "dle-ts",
+     []( pkt_read_fn_t cb, void* ctx ) -> void* {
+        auto* decoder = new TimestampDecoder{ cb, ctx, nullptr };
+        decoder->decoder = pkt_decoder_create_ts( timestampPacket, decoder );
+        return decoder;
+     },
+     []( void* d ) {
+        pkt_decoder_destroy( static_cast< TimestampDecoder* >( d )->decoder );
+        delete static_cast< TimestampDecoder* >( d );
+     },
+     []( void* d, size_t len, const uint8_t* data ) {
+        pkt_decoder_write_bytes_ts( static_cast< TimestampDecoder* >( d )->decoder, len, data, 0 );
+     },
+     false },
+   { "pooled",
+     []( pkt_read_fn_t cb, void* ctx ) -> void* {
+        auto* pooled = new PooledDecoder{ pkt_buffer_pool_create( 1 ), nullptr, nullptr };
+        pooled->decoder = pkt_decoder_create_pooled( cb, ctx, pooled->pool );
+        return pooled;
+     },
+     destroyPooled,
+     writePooled,
+     false },
+   { "arena",
+     []( pkt_read_fn_t cb, void* ctx ) -> void* {
+        auto* pooled = new PooledDecoder{ nullptr, pkt_arena_create( 4096 ), nullptr };
+        pooled->decoder = pkt_decoder_create_arena( cb, ctx, pooled->arena );
+        return pooled;
+     },
+     destroyPooled,
+     writePooled,
+     false },
+   { "checkpoint",
+     // Moves the stream to a new decoder after every write
+     []( pkt_read_fn_t cb, void* ctx ) -> void* {
+        return new CheckpointDecoder{ cb, ctx, pkt_decoder_create( cb, ctx ) };
+     },
+     []( void* d ) {
+        pkt_decoder_destroy( static_cast< CheckpointDecoder* >( d )->decoder );
+        delete static_cast< CheckpointDecoder* >( d );
+     },
+     []( void* d, size_t len, const uint8_t* data ) {
+        auto* moving = static_cast< CheckpointDecoder* >( d );
+        pkt_decoder_write_bytes( moving->decoder, len, data );
+        uint8_t checkpoint[ PKT_CHECKPOINT_MAX_LENGTH ];
+        size_t length = pkt_checkpoint_save( moving->decoder, checkpoint );
+        pkt_decoder_destroy( moving->decoder );
+        moving->decoder = pkt_decoder_create( moving->callback, moving->ctx );
+        if ( length != pkt_checkpoint_restore( moving->decoder, length, checkpoint ) )
+        {
+           fprintf( stderr, "checkpoint: restore failed\n" );
+           abort();
+        }
+     },
+     false },
+   { "filter",
+     []( pkt_read_fn_t cb, void* ctx ) -> void* {
+        pkt_decoder_t* decoder = pkt_decoder_create( cb, ctx );
+        pkt_decoder_set_filter( decoder, 1, evenType, nullptr );
+        return decoder;
+     },
+     destroyDle,
+     writeDle,
+     true },
+   { "route-drop",
+     []( pkt_read_fn_t cb, void* ctx ) -> void* {
+        pkt_decoder_t* decoder = pkt_decoder_create( cb, ctx );
+        for ( int type = 0x01; type <= 0xFF; type += 2 )
+        {
+           pkt_decoder_set_route_drop( decoder, static_cast< uint8_t >( type ), true );
+        }
+        return decoder;
+     },
+     destroyDle,
+     writeDle,
+     true },
+};
+
+static PacketList withoutOddTypes( const PacketList& packets )
+{
+   PacketList kept;
+   for ( const auto& packet : packets )
+   {
+      if ( evenType( nullptr, packet.size(), packet.data() ) )
+      {
+         kept.push_back( packet );
+      }
+   }
+   return kept;
+}
+
+// Splits length bytes into writes: mostly short ones, with some up to the whole stream
+static std::vector< size_t > randomChunks( size_t length, uint64_t seed )
+{
+   uint64_t state = seed | 1;
+   std::vector< size_t > chunks;
+   for ( size_t offset = 0; offset < length; )
+   {
+      uint64_t pick = nextRandom( state );
+      size_t chunk = 1 + ( ( pick & 1 ) ? ( pick >> 1 ) % 16 : ( pick >> 1 ) % length );
+      chunk = std::min( chunk, length - offset );
+      chunks.push_back( chunk );
+      offset += chunk;
+   }
+   return chunks;
+}
+
+static PacketList decode( const Engine& engine,
+                          const uint8_t* data,
+                          const std::vector< size_t >& chunks )
+{
+   PacketList packets;
+   void* decoder = engine.create( recordPacket, &packets );
+   for ( size_t chunk : chunks )
+   {
+      engine.write( decoder, chunk, data );
+      data += chunk;
+   }
+   engine.destroy( decoder );
+   return packets;
+}
+
+static void printMismatch( const char* name, const PacketList& expected, const PacketList& got )
+{
+   size_t packet = 0;
+   while ( ( packet < expected.size() ) && ( packet < got.size() )
+           && ( expected[ packet ] == got[ packet ] ) )
+   {
+      ++packet;
+   }
+   fprintf( stderr,
+            "%s: delivered %zu packets, expected %zu; first difference at packet %zu\n",
+            name,
+            got.size(),
+            expected.size(),
+            packet );
+}
+
+// Runs every engine over one stream. Returns false (after describing the first mismatch) if any
+// engine disagrees with the reference
+static bool checkStream( const uint8_t* data, size_t length, uint64_t chunkSeed )
+{
+   if ( 0 == length )
+   {
+      return true;
+   }
+   std::vector< size_t > chunks = randomChunks( length, chunkSeed );
+   PacketList expected = decode( ENGINES[ 0 ], data, chunks );
+   PacketList expectedFiltered = withoutOddTypes( expected );
+   for ( const Engine& engine : ENGINES )
+   {
+      PacketList packets = decode( engine, data, chunks );
+      if ( packets != ( engine.filtered ? expectedFiltered : expected ) )
+      {
+         printMismatch( engine.name, engine.filtered ? expectedFiltered : expected, packets );
+         return false;
+      }
+   }
+   return true;
+}
+
+// Inputs are 8 bytes of write-split seed, then the stream
+static bool checkInput( const uint8_t* data, size_t size )
+{
+   uint64_t chunkSeed = 0;
+   size_t seedLength = std::min( size, sizeof( chunkSeed ) );
+   memcpy( &chunkSeed, data, seedLength );
+   return checkStream( data + seedLength, size - seedLength, chunkSeed );
+}
+
+#ifdef PKT_LIBFUZZER
+extern "C" int LLVMFuzzerTestOneInput( const uint8_t* data, size_t size )
+{
+   if ( !checkInput( data, size ) )
+   {
+      abort();
+   }
+   return 0;
+}
+#else
+// Where a failing generated stream is saved, as an input that can be replayed
+static const char FAILURE_PATH[] = "pkt-fuzz-failure.bin";
+
+static bool checkAndSave( const uint8_t* data, size_t length, uint64_t chunkSeed )
+{
+   if ( checkStream( data, length, chunkSeed ) )
+   {
+      return true;
+   }
+   FILE* file = fopen( FAILURE_PATH, "wb" );
+   if ( nullptr != file )
+   {
+      fwrite( &chunkSeed, sizeof( chunkSeed ), 1, file );
+      fwrite( data, 1, length, file );
+      fclose( file );
+      fprintf( stderr, "input saved to %s\n", FAILURE_PATH );
+   }
+   return false;
+}
+
+// Streams of random bytes rich in STX, ETX and DLE, with the odd run long enough to overflow
+static std::vector< uint8_t > randomStream( uint64_t& state )
+{
+   const uint8_t CONTROLS[] = { STX, ETX, DLE };
+   std::vector< uint8_t > stream( 1 + nextRandom( state ) % 2048 );
+   for ( size_t idx = 0; idx < stream.size(); ++idx )
+   {
+      uint64_t pick = nextRandom( state );
+      if ( 0 == pick % 64 )
+      {
+         // A run of plain bytes, sometimes longer than a packet can be
+         size_t run = std::min( stream.size() - idx, 1 + ( pick >> 8 ) % 600 );
+         memset( &stream[ idx ], 0x40 + ( pick >> 20 ) % 0xC0, run );
+         idx += run - 1;
+      }
+      else
+      {
+         stream[ idx ] = ( pick % 4 == 0 ) ? CONTROLS[ ( pick >> 8 ) % 3 ]
+                                           : static_cast< uint8_t >( pick >> 16 );
+      }
+   }
+   return stream;
+}
+
+// A corpus with random knobs. Its packets are known, so the reference is checked too, and COBS
+// (which has no byte-compatible semantics to fuzz) is checked on a COBS corpus of the same packets
+static bool checkCorpus( uint64_t& state )
+{
+   pkt_corpus_config_t config;
+   pkt_corpus_default_config( &config );
+   config.seed = nextRandom( state );
+   config.payload_bytes = 1 + nextRandom( state ) % 8192;
+   config.min_payload = 1 + nextRandom( state ) % MAX_DECODED_DATA_LENGTH;
+   size_t sizeRange = MAX_DECODED_DATA_LENGTH - config.min_payload + 1;
+   config.max_payload = config.min_payload + nextRandom( state ) % sizeRange;
+   config.escape_rate = ( nextRandom( state ) % 100 ) / 200.0;
+   config.truncated_rate = ( nextRandom( state ) % 100 ) / 1000.0;
+   config.overflow_rate = ( nextRandom( state ) % 100 ) / 1000.0;
+   config.min_chunk = 1;
+   config.max_chunk = 1 + nextRandom( state ) % 4096;
+
+   PacketList expected;
+   for ( pkt_corpus_framing_t framing : { PKT_CORPUS_COBS, PKT_CORPUS_DLE } )
+   {
+      config.framing = framing;
+      config.garbage_ratio =
+         ( PKT_CORPUS_DLE == framing ) ? ( nextRandom( state ) % 90 ) / 100.0 : 0.0;
+      pkt_corpus_t* corpus = pkt_corpus_create( &config );
+      expected.clear();
+      for ( size_t index = 0; index < pkt_corpus_packet_count( corpus ); ++index )
+      {
+         size_t length;
+         const uint8_t* packet = pkt_corpus_packet( corpus, index, &length );
+         expected.emplace_back( packet, packet + length );
+      }
+      const size_t* firstChunk = pkt_corpus_chunks( corpus );
+      std::vector< size_t > chunks( firstChunk, firstChunk + pkt_corpus_chunk_count( corpus ) );
+      PacketList packets;
+      if ( PKT_CORPUS_COBS == framing )
+      {
+         cobs_decoder_t* decoder = cobs_decoder_create( recordPacket, &packets );
+         const uint8_t* data = pkt_corpus_stream( corpus );
+         for ( size_t chunk : chunks )
+         {
+            cobs_decoder_write_bytes( decoder, chunk, data );
+            data += chunk;
+         }
+         cobs_decoder_destroy( decoder );
+      }
+      else
+      {
+         packets = decode( ENGINES[ 0 ], pkt_corpus_stream( corpus ), chunks );
+      }
+      bool ok = ( packets == expected );
+      if ( !ok )
+      {
+         printMismatch( ( PKT_CORPUS_COBS == framing ) ? "cobs" : "reference", expected, packets );
+      }
+      else if ( PKT_CORPUS_DLE == framing )
+      {
+         ok = checkAndSave( pkt_corpus_stream( corpus ),
+                            pkt_corpus_stream_length( corpus ),
+                            nextRandom( state ) );
+      }
+      pkt_corpus_destroy( corpus );
+      if ( !ok )
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+static bool replayFile( const char* path )
+{
+   FILE* file = fopen( path, "rb" );
+   if ( nullptr == file )
+   {
+      fprintf( stderr, "can't read %s\n", path );
+      return false;
+   }
+   std::vector< uint8_t > input;
+   uint8_t buffer[ 65536 ];
+   size_t length;
+   while ( 0 < ( length = fread( buffer, 1, sizeof( buffer ), file ) ) )
+   {
+      input.insert( input.end(), buffer, buffer + length );
+   }
+   fclose( file );
+   bool ok = checkInput( input.data(), input.size() );
+   printf( "%s: %s\n", path, ok ? "ok" : "MISMATCH" );
+   return ok;
+}
+
+// Minimum wall time spent on each engine
+static const double MIN_SECONDS( 0.25 );
+
+// Decode throughput of every engine on the same packets: the DLE engines on a DLE corpus, COBS on
+// a COBS corpus
+static void measureThroughput( uint64_t seed )
+{
+   pkt_corpus_config_t config;
+   pkt_corpus_default_config( &config );
+   config.seed = seed;
+   config.payload_bytes = 8 * 1024 * 1024;
+   config.truncated_rate = 0.01;
+   config.overflow_rate = 0.01;
+   config.min_chunk = 1;
+   config.max_chunk = 4096;
+   pkt_corpus_t* corpus = pkt_corpus_create( &config );
+   config.framing = PKT_CORPUS_COBS;
+   pkt_corpus_t* cobsCorpus = pkt_corpus_create( &config );
+   printf( "%zu packets, 1-512 byte payloads, 1%% escapes, 2%% damaged, 1-4096 byte writes\n",
+           pkt_corpus_packet_count( corpus ) );
+
+   const Engine COBS = {
+      "cobs",
+      []( pkt_read_fn_t cb, void* ctx ) -> void* { return cobs_decoder_create( cb, ctx ); },
+      []( void* d ) { cobs_decoder_destroy( static_cast< cobs_decoder_t* >( d ) ); },
+      []( void* d, size_t len, const uint8_t* data ) {
+         cobs_decoder_write_bytes( static_cast< cobs_decoder_t* >( d ), len, data );
+      },
+      false };
+   std::vector< const Engine* > engines;
+   for ( const Engine& engine : ENGINES )
+   {
+      engines.push_back( &engine );
+   }
+   engines.push_back( &COBS );
+
+   for ( const Engine* engine : engines )
+   {
+      const pkt_corpus_t* input = ( engine == &COBS ) ? cobsCorpus : corpus;
+      const uint8_t* stream = pkt_corpus_stream( input );
+      const size_t* chunks = pkt_corpus_chunks( input );
+      size_t packets = 0;
+      void* decoder = engine->create( countPacket, &packets );
+      size_t passes = 0;
+      auto start = std::chrono::steady_clock::now();
+      double elapsed = 0.0;
+      do
+      {
+         const uint8_t* data = stream;
+         for ( size_t chunk = 0; chunk < pkt_corpus_chunk_count( input ); ++chunk )
+         {
+            engine->write( decoder, chunks[ chunk ], data );
+            data += chunks[ chunk ];
+         }
+         ++passes;
+         elapsed =
+            std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+      } while ( elapsed < MIN_SECONDS );
+      engine->destroy( decoder );
+      printf( "  %-11s %9.1f MB/s wire %8.2f Mpkt/s\n",
+              engine->name,
+              static_cast< double >( pkt_corpus_stream_length( input ) ) * passes / elapsed / 1e6,
+              packets / elapsed / 1e6 );
+   }
+   pkt_corpus_destroy( corpus );
+   pkt_corpus_destroy( cobsCorpus );
+}
+
+int main( int argc, char** argv )
+{
+   uint64_t seed = 1;
+   size_t iterations = 10000;
+   bool throughput = false;
+   std::vector< const char* > files;
+   for ( int arg = 1; arg < argc; ++arg )
+   {
+      if ( ( 0 == strcmp( argv[ arg ], "--seed" ) ) && ( arg + 1 < argc ) )
+      {
+         seed = strtoull( argv[ ++arg ], nullptr, 0 );
+      }
+      else if ( ( 0 == strcmp( argv[ arg ], "--iterations" ) ) && ( arg + 1 < argc ) )
+      {
+         iterations = strtoull( argv[ ++arg ], nullptr, 0 );
+      }
+      else if ( 0 == strcmp( argv[ arg ], "--throughput" ) )
+      {
+         throughput = true;
+      }
+      else if ( '-' != argv[ arg ][ 0 ] )
+      {
+         files.push_back( argv[ arg ] );
+      }
+      else
+      {
+         fprintf( stderr,
+                  "usage: %s [--seed N] [--iterations N] [--throughput] [FILE...]\n",
+                  argv[ 0 ] );
+         return 1;
+      }
+   }
+
+   if ( !files.empty() )
+   {
+      bool ok = true;
+      for ( const char* path : files )
+      {
+         ok = replayFile( path ) && ok;
+      }
+      return ok ? 0 : 1;
+   }
+   if ( throughput )
+   {
+      measureThroughput( seed );
+      return 0;
+   }
+
+   uint64_t state = seed * 0x9e3779b97f4a7c15ULL + 1;
+   for ( size_t iteration = 0; iteration < iterations; ++iteration )
+   {
+      uint64_t streamSeed = state;
+      bool ok;
+      if ( iteration % 8 == 7 )
+      {
+         ok = checkCorpus( state );
+      }
+      else
+      {
+         std::vector< uint8_t > stream = randomStream( state );
+         ok = checkAndSave( stream.data(), stream.size(), nextRandom( state ) );
+      }
+      if ( !ok )
+      {
+         fprintf( stderr, "iteration %zu failed (seed %llu, state %llu)\n",
+                  iteration,
+                  static_cast< unsigned long long >( seed ),
+                  static_cast< unsigned long long >( streamSeed ) );
+         return 1;
+      }
+   }
+   printf( "%zu streams decoded identically by %zu engines\n",
+           iterations,
+           sizeof( ENGINES ) / sizeof( ENGINES[ 0 ] ) );
+   return 0;
+}
+#endif
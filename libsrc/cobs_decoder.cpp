@@ -0,0 +1,141 @@
+#include "cobs_decoder.h"
+
+#include <cstring>
+
+CobsDecoder::CobsDecoder( pkt_read_fn_t readCallback, void* callbackCtx )
+   : m_packetBuffer( nullptr ),
+     m_pktBufIdx( 0 ),
+     m_pktValid( true ),
+     m_readCallback( readCallback ),
+     m_callbackCtx( callbackCtx ),
+     m_blockRemaining( 0 ),
+     m_zeroPending( false )
+{
+}
+
+cobs_decoder_t* cobs_decoder_create( pkt_read_fn_t callback, void* callback_ctx )
+{
+   auto* decoder = new CobsDecoder( callback, callback_ctx );
+   decoder->m_packetBuffer = new uint8_t[ MAX_DECODED_DATA_LENGTH ];
+   decoder->clearBuffer();
+   return decoder;
+}
+
+void cobs_decoder_destroy( cobs_decoder_t* decoder )
+{
+   decoder->m_readCallback = nullptr;
+   decoder->m_callbackCtx = nullptr;
+   delete[] decoder->m_packetBuffer;
+   delete decoder;
+}
+
+void cobs_decoder_write_bytes( cobs_decoder_t* decoder, size_t length, const uint8_t* data )
+{
+   size_t idx = 0;
+   while ( idx < length )
+   {
+      if ( !decoder->m_pktValid )
+      {
+         // Resynchronize on the next delimiter; everything before it belongs to a dropped frame
+         const void* delim = memchr( data + idx, COBS_DELIMITER, length - idx );
+         if ( nullptr == delim )
+         {
+            return;
+         }
+         idx = static_cast< const uint8_t* >( delim ) - data + 1;
+         decoder->clearBuffer();
+         decoder->m_pktValid = true;
+         continue;
+      }
+
+      if ( 0 == decoder->m_blockRemaining )
+      {
+         const uint8_t code = data[ idx++ ];
+         if ( COBS_DELIMITER == code )
+         {
+            // End of frame. Any pending zero is the implied terminator and is not part of the
+            // packet. Empty frames are silently dropped, just like an empty STX/ETX frame
+            if ( ( decoder->m_pktBufIdx > 0 ) && decoder->m_readCallback )
+            {
+               decoder->m_readCallback(
+                  decoder->m_callbackCtx, decoder->m_pktBufIdx, decoder->m_packetBuffer );
+            }
+            decoder->clearBuffer();
+            continue;
+         }
+         if ( decoder->m_zeroPending )
+         {
+            if ( MAX_DECODED_DATA_LENGTH == decoder->m_pktBufIdx )
+            {
+               decoder->m_pktValid = false;
+               continue;
+            }
+            decoder->m_packetBuffer[ decoder->m_pktBufIdx++ ] = 0;
+         }
+         decoder->m_blockRemaining = code - 1;
+         decoder->m_zeroPending = ( 0xFF != code );
+         continue;
+      }
+
+      // Copy as much of the current block as this write contains
+      size_t run = decoder->m_blockRemaining;
+      if ( run > length - idx )
+      {
+         run = length - idx;
+      }
+      const void* delim = memchr( data + idx, COBS_DELIMITER, run );
+      if ( nullptr != delim )
+      {
+         // The block was cut short by a delimiter, so the frame is corrupt. The delimiter starts
+         // the next frame
+         idx = static_cast< const uint8_t* >( delim ) - data + 1;
+         decoder->clearBuffer();
+         continue;
+      }
+      if ( run > MAX_DECODED_DATA_LENGTH - decoder->m_pktBufIdx )
+      {
+         // Silently fail because this block will exceed the allowed maximum packet length, and
+         // drop everything until the next delimiter
+         decoder->m_pktValid = false;
+         continue;
+      }
+      memcpy( decoder->m_packetBuffer + decoder->m_pktBufIdx, data + idx, run );
+      decoder->m_pktBufIdx += run;
+      decoder->m_blockRemaining -= run;
+      idx += run;
+   }
+}
+
+size_t cobs_encode( size_t length, const uint8_t* data, uint8_t* out )
+{
+   size_t codeIdx = 0;
+   size_t outIdx = 1;
+   uint8_t code = 1;
+   for ( size_t idx = 0; idx < length; ++idx )
+   {
+      if ( COBS_DELIMITER == data[ idx ] )
+      {
+         out[ codeIdx ] = code;
+         codeIdx = outIdx++;
+         code = 1;
+         continue;
+      }
+      out[ outIdx++ ] = data[ idx ];
+      if ( 0xFF == ++code )
+      {
+         out[ codeIdx ] = code;
+         codeIdx = outIdx++;
+         code = 1;
+      }
+   }
+   out[ codeIdx ] = code;
+   out[ outIdx++ ] = COBS_DELIMITER;
+   return outIdx;
+}
+
+void CobsDecoder::clearBuffer()
+{
+   this->m_pktBufIdx = 0;
+   this->m_blockRemaining = 0;
+   this->m_zeroPending = false;
+}
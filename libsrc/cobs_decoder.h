@@ -0,0 +1,51 @@
+#ifndef COBS_DECODER_H_INCLUDED
+#define COBS_DECODER_H_INCLUDED
+
+#include "pkt_decoder.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+// COBS frames are delimited by a zero byte
+#define COBS_DELIMITER ( 0x00 )
+// Worst-case encoded size (including the trailing delimiter) of a raw payload of length len
+#define COBS_MAX_ENCODED_LENGTH( len ) ( ( len ) + ( ( len ) / 254 ) + 2 )
+
+   class CobsDecoder;
+
+   typedef struct CobsDecoder cobs_decoder_t;
+   // Constructor for a cobs_decoder. The callback signature is shared with pkt_decoder
+   PKT_API cobs_decoder_t* cobs_decoder_create( pkt_read_fn_t callback, void* callback_ctx );
+   // Destructor for a cobs_decoder
+   PKT_API void cobs_decoder_destroy( cobs_decoder_t* decoder );
+   // Called on incoming, undecoded bytes to be translated into packets
+   PKT_API void cobs_decoder_write_bytes( cobs_decoder_t* decoder,
+                                          size_t len,
+                                          const uint8_t* data );
+   // Encode len bytes of data into out (which must hold COBS_MAX_ENCODED_LENGTH( len ) bytes),
+   // including the trailing delimiter. Returns the number of bytes written to out
+   PKT_API size_t cobs_encode( size_t len, const uint8_t* data, uint8_t* out );
+
+   class CobsDecoder
+   {
+    public:
+      CobsDecoder( pkt_read_fn_t, void* );
+      virtual ~CobsDecoder() = default;
+      void clearBuffer();
+
+      uint8_t* m_packetBuffer;
+      size_t m_pktBufIdx;
+      bool m_pktValid;
+      pkt_read_fn_t m_readCallback;
+      void* m_callbackCtx;
+      // Number of data bytes left in the current COBS block (0 means the next byte is a code byte)
+      size_t m_blockRemaining;
+      // Set when the current block ends with an implied zero that has not been written yet
+      bool m_zeroPending;
+   };
+
+#ifdef __cplusplus
+}
+#endif
+#endif // COBS_DECODER_H_INCLUDED
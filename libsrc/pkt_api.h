@@ -0,0 +1,12 @@
+#ifndef PKT_API_H_INCLUDED
+#define PKT_API_H_INCLUDED
+
+// Marks the functions of the C API, the only symbols the shared library exports. Everything else
+// in it is built with hidden visibility
+#if defined( __GNUC__ )
+#define PKT_API __attribute__( ( visibility( "default" ) ) )
+#else
+#define PKT_API
+#endif
+
+#endif // PKT_API_H_INCLUDED
@@ -0,0 +1,128 @@
+#include "pkt_arena.h"
+
+#include "pkt_decoder.h"
+
+#include <new>
+
+namespace
+{
+   // Packet data starts a cache line into each chunk, after the chunk header
+   const size_t DATA_OFFSET( 64 );
+
+   uint8_t* dataOf( PacketArenaChunk* chunk )
+   {
+      return reinterpret_cast< uint8_t* >( chunk ) + DATA_OFFSET;
+   }
+} // namespace
+
+PacketArena::PacketArena( size_t chunkSize )
+   : m_chunkSize( chunkSize )
+{
+}
+
+PacketArena::~PacketArena()
+{
+   for ( PacketArenaChunk* chunk : m_chunks )
+   {
+      chunk->~PacketArenaChunk();
+      free( chunk );
+   }
+}
+
+pkt_arena_t* pkt_arena_create( size_t chunk_size )
+{
+   // Chunks are aligned to their size, so a packet's chunk is found by masking its address
+   size_t chunkSize = 1;
+   while ( ( chunkSize < chunk_size ) || ( chunkSize < DATA_OFFSET + MAX_DECODED_DATA_LENGTH ) )
+   {
+      chunkSize <<= 1;
+   }
+   return new PacketArena( chunkSize );
+}
+
+void pkt_arena_destroy( pkt_arena_t* arena )
+{
+   delete arena;
+}
+
+void pkt_arena_retain( pkt_arena_t* arena, const uint8_t* data )
+{
+   arena->chunkOf( data )->m_refs.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void pkt_arena_release( pkt_arena_t* arena, const uint8_t* data )
+{
+   arena->release( arena->chunkOf( data ) );
+}
+
+size_t pkt_arena_chunk_count( pkt_arena_t* arena )
+{
+   std::lock_guard< std::mutex > lock( arena->m_lock );
+   return arena->m_chunks.size();
+}
+
+size_t pkt_arena_free_chunk_count( pkt_arena_t* arena )
+{
+   std::lock_guard< std::mutex > lock( arena->m_lock );
+   return arena->m_free.size();
+}
+
+uint8_t* PacketArena::reserve( PacketArenaChunk*& chunk )
+{
+   if ( nullptr != chunk )
+   {
+      if ( 1 == chunk->m_refs.load( std::memory_order_acquire ) )
+      {
+         // Nothing in the chunk is retained, so the decoder can start again at the front
+         chunk->m_used = 0;
+      }
+      if ( chunk->m_used + MAX_DECODED_DATA_LENGTH <= this->m_chunkSize - DATA_OFFSET )
+      {
+         return dataOf( chunk ) + chunk->m_used;
+      }
+      this->release( chunk );
+   }
+
+   {
+      std::lock_guard< std::mutex > lock( this->m_lock );
+      if ( this->m_free.empty() )
+      {
+         void* memory = nullptr;
+         if ( 0 != posix_memalign( &memory, this->m_chunkSize, this->m_chunkSize ) )
+         {
+            chunk = nullptr;
+            return nullptr;
+         }
+         chunk = new ( memory ) PacketArenaChunk;
+         this->m_chunks.push_back( chunk );
+      }
+      else
+      {
+         chunk = this->m_free.back();
+         this->m_free.pop_back();
+      }
+   }
+   chunk->m_refs.store( 1, std::memory_order_relaxed );
+   chunk->m_used = 0;
+   return dataOf( chunk );
+}
+
+void PacketArena::commit( PacketArenaChunk* chunk, size_t length )
+{
+   chunk->m_used += length;
+}
+
+void PacketArena::release( PacketArenaChunk* chunk )
+{
+   if ( 1 == chunk->m_refs.fetch_sub( 1, std::memory_order_acq_rel ) )
+   {
+      std::lock_guard< std::mutex > lock( this->m_lock );
+      this->m_free.push_back( chunk );
+   }
+}
+
+PacketArenaChunk* PacketArena::chunkOf( const uint8_t* data ) const
+{
+   return reinterpret_cast< PacketArenaChunk* >( reinterpret_cast< uintptr_t >( data )
+                                                 & ~( this->m_chunkSize - 1 ) );
+}
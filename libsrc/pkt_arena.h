@@ -0,0 +1,68 @@
+#ifndef PKT_ARENA_H_INCLUDED
+#define PKT_ARENA_H_INCLUDED
+
+#include "pkt_api.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+// Chunked bump-pointer arena that decoders write packets into, so a callback can keep a packet
+// by retaining it instead of copying it. Every chunk counts the retained packets in it (plus one
+// while a decoder is writing into it) and is recycled once that count drops to zero
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#define PKT_ARENA_DEFAULT_CHUNK_SIZE ( 64 * 1024 )
+
+   class PacketArena;
+   struct PacketArenaChunk;
+
+   typedef struct PacketArena pkt_arena_t;
+
+   // chunk_size is rounded up to a power of two big enough to hold a maximum-length packet
+   PKT_API pkt_arena_t* pkt_arena_create( size_t chunk_size );
+   // Frees every chunk. Retained packets must not be used afterwards
+   PKT_API void pkt_arena_destroy( pkt_arena_t* arena );
+   // Keeps a packet delivered by an arena decoder (data as passed to the callback) valid after
+   // the callback returns. Can be called more than once; each call needs a pkt_arena_release
+   PKT_API void pkt_arena_retain( pkt_arena_t* arena, const uint8_t* data );
+   // Drops a reference taken with pkt_arena_retain. Can be called from any thread
+   PKT_API void pkt_arena_release( pkt_arena_t* arena, const uint8_t* data );
+   // Number of chunks allocated, and how many of them are waiting to be reused
+   PKT_API size_t pkt_arena_chunk_count( pkt_arena_t* arena );
+   PKT_API size_t pkt_arena_free_chunk_count( pkt_arena_t* arena );
+
+   struct PacketArenaChunk
+   {
+      // Retained packets, plus one while a decoder writes into the chunk
+      std::atomic< uint32_t > m_refs;
+      // Bytes of the chunk's data area taken by packets
+      size_t m_used;
+   };
+
+   class PacketArena
+   {
+    public:
+      explicit PacketArena( size_t );
+      virtual ~PacketArena();
+      // Returns room for a maximum-length packet, moving the decoder's chunk on if it is full
+      uint8_t* reserve( PacketArenaChunk*& chunk );
+      // Keeps the length bytes last reserved from chunk, so the next reserve comes after them
+      void commit( PacketArenaChunk* chunk, size_t length );
+      void release( PacketArenaChunk* chunk );
+      PacketArenaChunk* chunkOf( const uint8_t* data ) const;
+
+      size_t m_chunkSize;
+      std::mutex m_lock;
+      std::vector< PacketArenaChunk* > m_chunks;
+      std::vector< PacketArenaChunk* > m_free;
+   };
+
+#ifdef __cplusplus
+}
+#endif
+#endif // PKT_ARENA_H_INCLUDED
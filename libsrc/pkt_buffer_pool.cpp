@@ -0,0 +1,72 @@
+#include "pkt_buffer_pool.h"
+
+#include "pkt_decoder.h"
+
+namespace
+{
+   const uint64_t INDEX_MASK( 0xFFFFFFFFull );
+   const uint64_t TAG_INCREMENT( 1ull << 32 );
+} // namespace
+
+PacketBufferPool::PacketBufferPool( size_t numBuffers )
+   : m_numBuffers( numBuffers ),
+     m_buffers( new uint8_t[ numBuffers * MAX_DECODED_DATA_LENGTH ] ),
+     m_next( new std::atomic< uint32_t >[ numBuffers ] ),
+     m_head( 0 ),
+     m_available( numBuffers )
+{
+   // Chain every buffer onto the free list, buffer 0 on top
+   for ( size_t idx = 0; idx < numBuffers; ++idx )
+   {
+      m_next[ idx ] = ( idx + 1 < numBuffers ) ? static_cast< uint32_t >( idx + 2 ) : 0;
+   }
+   m_head = ( numBuffers > 0 ) ? 1 : 0;
+}
+
+pkt_buffer_pool_t* pkt_buffer_pool_create( size_t num_buffers )
+{
+   return new PacketBufferPool( num_buffers );
+}
+
+void pkt_buffer_pool_destroy( pkt_buffer_pool_t* pool )
+{
+   delete pool;
+}
+
+uint8_t* pkt_buffer_pool_acquire( pkt_buffer_pool_t* pool )
+{
+   uint64_t head = pool->m_head.load( std::memory_order_acquire );
+   while ( 0 != ( head & INDEX_MASK ) )
+   {
+      size_t idx = ( head & INDEX_MASK ) - 1;
+      uint64_t next = ( head & ~INDEX_MASK ) + TAG_INCREMENT
+                      + pool->m_next[ idx ].load( std::memory_order_relaxed );
+      if ( pool->m_head.compare_exchange_weak(
+              head, next, std::memory_order_acquire, std::memory_order_acquire ) )
+      {
+         pool->m_available.fetch_sub( 1, std::memory_order_relaxed );
+         return &pool->m_buffers[ idx * MAX_DECODED_DATA_LENGTH ];
+      }
+   }
+   return nullptr;
+}
+
+void pkt_buffer_pool_release( pkt_buffer_pool_t* pool, uint8_t* buffer )
+{
+   uint64_t idx = ( buffer - pool->m_buffers.get() ) / MAX_DECODED_DATA_LENGTH;
+   uint64_t head = pool->m_head.load( std::memory_order_relaxed );
+   uint64_t next;
+   do
+   {
+      pool->m_next[ idx ].store( static_cast< uint32_t >( head & INDEX_MASK ),
+                                 std::memory_order_relaxed );
+      next = ( head & ~INDEX_MASK ) + TAG_INCREMENT + idx + 1;
+   } while ( !pool->m_head.compare_exchange_weak(
+      head, next, std::memory_order_release, std::memory_order_relaxed ) );
+   pool->m_available.fetch_add( 1, std::memory_order_relaxed );
+}
+
+size_t pkt_buffer_pool_available( const pkt_buffer_pool_t* pool )
+{
+   return pool->m_available.load( std::memory_order_relaxed );
+}
@@ -0,0 +1,52 @@
+#ifndef PKT_BUFFER_POOL_H_INCLUDED
+#define PKT_BUFFER_POOL_H_INCLUDED
+
+#include "pkt_api.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+
+// A fixed set of MAX_DECODED_DATA_LENGTH packet buffers shared by many decoders. Acquiring and
+// releasing a buffer are lock-free, so decoders on different threads can share one pool
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+   class PacketBufferPool;
+
+   typedef struct PacketBufferPool pkt_buffer_pool_t;
+
+   // Allocates num_buffers packet buffers up front
+   PKT_API pkt_buffer_pool_t* pkt_buffer_pool_create( size_t num_buffers );
+   // Frees the pool. Every buffer must have been released (i.e. pooled decoders destroyed) first
+   PKT_API void pkt_buffer_pool_destroy( pkt_buffer_pool_t* pool );
+   // Takes a buffer from the pool, or returns a nullptr if they're all in use
+   PKT_API uint8_t* pkt_buffer_pool_acquire( pkt_buffer_pool_t* pool );
+   // Returns a buffer taken with pkt_buffer_pool_acquire
+   PKT_API void pkt_buffer_pool_release( pkt_buffer_pool_t* pool, uint8_t* buffer );
+   // Number of buffers not currently in use
+   PKT_API size_t pkt_buffer_pool_available( const pkt_buffer_pool_t* pool );
+
+   class PacketBufferPool
+   {
+    public:
+      explicit PacketBufferPool( size_t );
+      virtual ~PacketBufferPool() = default;
+
+      size_t m_numBuffers;
+      std::unique_ptr< uint8_t[] > m_buffers;
+      // Free list as a stack of buffer indexes: m_next[ i ] is the entry below buffer i, plus one
+      // (0 ends the list)
+      std::unique_ptr< std::atomic< uint32_t >[] > m_next;
+      // Top of the stack in the low 32 bits (index plus one), and a counter in the high 32 bits
+      // that changes on every update so a stale compare-exchange can't succeed (ABA)
+      std::atomic< uint64_t > m_head;
+      std::atomic< size_t > m_available;
+   };
+
+#ifdef __cplusplus
+}
+#endif
+#endif // PKT_BUFFER_POOL_H_INCLUDED
@@ -0,0 +1,196 @@
+#include "pkt_checkpoint.h"
+
+#include <cstring>
+
+namespace
+{
+   const uint8_t VERSION( 2 );
+   const uint8_t FLAG_PKT_VALID( 0x01 );
+   const uint8_t FLAG_DESTUFF_NEXT_BYTE( 0x02 );
+   const uint8_t FLAG_DROP_PACKET( 0x04 );
+   const size_t HEADER_LENGTH( 1 + 1 + 8 );
+   const size_t PACKET_HEADER_LENGTH( 2 + 8 );
+   const size_t SKIPPED_LENGTH( 2 );
+   const size_t COUNT_LENGTH( 4 );
+
+   void putLE( uint8_t* out, uint64_t value, size_t bytes )
+   {
+      for ( size_t idx = 0; idx < bytes; ++idx )
+      {
+         out[ idx ] = static_cast< uint8_t >( value >> ( 8 * idx ) );
+      }
+   }
+
+   uint64_t getLE( const uint8_t* in, size_t bytes )
+   {
+      uint64_t value = 0;
+      for ( size_t idx = 0; idx < bytes; ++idx )
+      {
+         value |= static_cast< uint64_t >( in[ idx ] ) << ( 8 * idx );
+      }
+      return value;
+   }
+
+   // Bytes of the partial packet to save: none unless a packet is in progress
+   size_t packetLength( const pkt_decoder_t* decoder )
+   {
+      return decoder->m_pktValid ? decoder->m_pktBufIdx : 0;
+   }
+} // namespace
+
+size_t pkt_checkpoint_length( const pkt_decoder_t* decoder )
+{
+   if ( decoder->m_pktValid )
+   {
+      return HEADER_LENGTH + PACKET_HEADER_LENGTH + packetLength( decoder );
+   }
+   return HEADER_LENGTH + ( decoder->m_dropPacket ? SKIPPED_LENGTH : 0 );
+}
+
+size_t pkt_checkpoint_save( const pkt_decoder_t* decoder, uint8_t* out )
+{
+   uint8_t flags = ( decoder->m_pktValid ? FLAG_PKT_VALID : 0 )
+                   | ( decoder->m_deStuffNextByte ? FLAG_DESTUFF_NEXT_BYTE : 0 )
+                   | ( decoder->m_dropPacket ? FLAG_DROP_PACKET : 0 );
+   out[ 0 ] = VERSION;
+   out[ 1 ] = flags;
+   putLE( out + 2, decoder->m_streamOffset, 8 );
+   if ( !decoder->m_pktValid )
+   {
+      if ( !decoder->m_dropPacket )
+      {
+         return HEADER_LENGTH;
+      }
+      // How much of the skipped packet has gone by, in case it would overflow
+      putLE( out + HEADER_LENGTH, decoder->m_pktBufIdx, 2 );
+      return HEADER_LENGTH + SKIPPED_LENGTH;
+   }
+   size_t length = packetLength( decoder );
+   putLE( out + HEADER_LENGTH, length, 2 );
+   putLE( out + HEADER_LENGTH + 2, decoder->m_stxTime, 8 );
+   memcpy( out + HEADER_LENGTH + PACKET_HEADER_LENGTH, decoder->m_packetBuffer, length );
+   return HEADER_LENGTH + PACKET_HEADER_LENGTH + length;
+}
+
+size_t pkt_checkpoint_restore( pkt_decoder_t* decoder, size_t length, const uint8_t* data )
+{
+   // Drop whatever the decoder was doing. A pooled or arena decoder gives back its buffer
+   if ( decoder->m_pktValid && decoder->borrowsBuffer() )
+   {
+      decoder->releaseBuffer( 0 );
+   }
+   decoder->m_pktValid = false;
+   decoder->m_dropPacket = false;
+   decoder->m_deStuffNextByte = false;
+
+   const uint8_t KNOWN_FLAGS = FLAG_PKT_VALID | FLAG_DESTUFF_NEXT_BYTE | FLAG_DROP_PACKET;
+   if ( ( length < HEADER_LENGTH ) || ( VERSION != data[ 0 ] )
+        || ( 0 != ( data[ 1 ] & ~KNOWN_FLAGS ) ) )
+   {
+      return 0;
+   }
+   uint8_t flags = data[ 1 ];
+   size_t packetLength = 0;
+   if ( 0 != ( flags & FLAG_PKT_VALID ) )
+   {
+      if ( length < HEADER_LENGTH + PACKET_HEADER_LENGTH )
+      {
+         return 0;
+      }
+      packetLength = getLE( data + HEADER_LENGTH, 2 );
+      if ( ( packetLength > MAX_DECODED_DATA_LENGTH )
+           || ( length < HEADER_LENGTH + PACKET_HEADER_LENGTH + packetLength ) )
+      {
+         return 0;
+      }
+      if ( ( nullptr == decoder->m_packetBuffer ) && !decoder->acquireBuffer() )
+      {
+         return 0;
+      }
+      decoder->clearBuffer();
+      memcpy( decoder->m_packetBuffer, data + HEADER_LENGTH + PACKET_HEADER_LENGTH, packetLength );
+      decoder->m_pktBufIdx = packetLength;
+      decoder->m_stxTime = getLE( data + HEADER_LENGTH + 2, 8 );
+      decoder->m_pktValid = true;
+      // Run this decoder's own route drop and filter checkpoints that the packet has already
+      // passed, in order, as if it had decoded the packet itself. Either may drop it, leaving
+      // the rest to be skipped; otherwise m_filterIdx ends at the next checkpoint
+      decoder->m_filterIdx = decoder->m_firstFilterIdx;
+      while ( decoder->m_pktValid && ( 0 != decoder->m_filterIdx )
+              && ( decoder->m_filterIdx <= packetLength ) )
+      {
+         decoder->m_pktBufIdx = decoder->m_filterIdx;
+         decoder->filterPacket();
+      }
+      decoder->m_pktBufIdx = packetLength;
+   }
+   else if ( 0 != ( flags & FLAG_DROP_PACKET ) )
+   {
+      if ( length < HEADER_LENGTH + SKIPPED_LENGTH )
+      {
+         return 0;
+      }
+      size_t skippedLength = getLE( data + HEADER_LENGTH, 2 );
+      if ( skippedLength > MAX_DECODED_DATA_LENGTH )
+      {
+         return 0;
+      }
+      if ( !decoder->borrowsBuffer() )
+      {
+         // Keeps the buffer zeroed past m_pktBufIdx
+         decoder->clearBuffer();
+      }
+      decoder->m_pktBufIdx = skippedLength;
+      decoder->m_dropPacket = true;
+   }
+   decoder->m_deStuffNextByte = ( 0 != ( flags & FLAG_DESTUFF_NEXT_BYTE ) );
+   decoder->m_streamOffset = getLE( data + 2, 8 );
+   if ( 0 != ( flags & FLAG_PKT_VALID ) )
+   {
+      return HEADER_LENGTH + PACKET_HEADER_LENGTH + packetLength;
+   }
+   return HEADER_LENGTH + ( ( 0 != ( flags & FLAG_DROP_PACKET ) ) ? SKIPPED_LENGTH : 0 );
+}
+
+size_t pkt_checkpoint_length_all( pkt_decoder_t* const* decoders, size_t count )
+{
+   size_t length = COUNT_LENGTH;
+   for ( size_t idx = 0; idx < count; ++idx )
+   {
+      length += pkt_checkpoint_length( decoders[ idx ] );
+   }
+   return length;
+}
+
+size_t pkt_checkpoint_save_all( pkt_decoder_t* const* decoders, size_t count, uint8_t* out )
+{
+   putLE( out, count, COUNT_LENGTH );
+   size_t offset = COUNT_LENGTH;
+   for ( size_t idx = 0; idx < count; ++idx )
+   {
+      offset += pkt_checkpoint_save( decoders[ idx ], out + offset );
+   }
+   return offset;
+}
+
+bool pkt_checkpoint_restore_all( pkt_decoder_t* const* decoders,
+                                 size_t count,
+                                 size_t length,
+                                 const uint8_t* data )
+{
+   if ( ( length < COUNT_LENGTH ) || ( count != getLE( data, COUNT_LENGTH ) ) )
+   {
+      return false;
+   }
+   size_t offset = COUNT_LENGTH;
+   for ( size_t idx = 0; idx < count; ++idx )
+   {
+      size_t used = pkt_checkpoint_restore( decoders[ idx ], length - offset, data + offset );
+      if ( 0 == used )
+      {
+         return false;
+      }
+      offset += used;
+   }
+   return offset == length;
+}
@@ -0,0 +1,52 @@
+#ifndef PKT_CHECKPOINT_H_INCLUDED
+#define PKT_CHECKPOINT_H_INCLUDED
+
+#include "pkt_decoder.h"
+
+// Checkpoints of a decoder's stream state, so a stream can move to another decoder (in another
+// process) without losing a packet in progress. A checkpoint holds the partial packet, the
+// hunting/skipping and de-stuffing state, the stream offset and the STX time. It doesn't hold
+// configuration (callbacks, checksum, routes, filter, pool or arena): the restored decoder keeps
+// its own, and its route drops and filter are applied to a restored partial packet that is
+// already long enough for them. All integers are little-endian.
+//
+//   checkpoint   u8 version | u8 flags | u64 stream offset, and while a packet is in progress
+//                u16 length | u64 STX time | length bytes of partial packet, or while a filtered
+//                packet is being skipped u16 length skipped so far
+//   bulk         u32 decoder count | one checkpoint per decoder
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+// Longest checkpoint of a single decoder
+#define PKT_CHECKPOINT_MAX_LENGTH ( 1 + 1 + 8 + 2 + 8 + MAX_DECODED_DATA_LENGTH )
+
+   // Length of decoder's checkpoint
+   PKT_API size_t pkt_checkpoint_length( const pkt_decoder_t* decoder );
+   // Writes decoder's checkpoint (at most PKT_CHECKPOINT_MAX_LENGTH bytes) to out and returns
+   // its length
+   PKT_API size_t pkt_checkpoint_save( const pkt_decoder_t* decoder, uint8_t* out );
+   // Replaces decoder's stream state with the checkpoint at the start of data. Returns the
+   // checkpoint's length, or 0 (leaving decoder hunting) if it is malformed or a pooled decoder
+   // can't get a buffer for the partial packet
+   PKT_API size_t pkt_checkpoint_restore( pkt_decoder_t* decoder,
+                                          size_t length,
+                                          const uint8_t* data );
+
+   // Bulk versions, for count decoders at a time
+   PKT_API size_t pkt_checkpoint_length_all( pkt_decoder_t* const* decoders, size_t count );
+   PKT_API size_t pkt_checkpoint_save_all( pkt_decoder_t* const* decoders,
+                                           size_t count,
+                                           uint8_t* out );
+   // Returns false if data doesn't hold exactly count well-formed checkpoints. Decoders before
+   // the first bad checkpoint are restored, the decoder it was meant for is left hunting, and the
+   // rest are left as they were
+   PKT_API bool pkt_checkpoint_restore_all( pkt_decoder_t* const* decoders,
+                                            size_t count,
+                                            size_t length,
+                                            const uint8_t* data );
+
+#ifdef __cplusplus
+}
+#endif
+#endif // PKT_CHECKPOINT_H_INCLUDED
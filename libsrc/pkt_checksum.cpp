@@ -0,0 +1,207 @@
+#include "pkt_checksum.h"
+
+#include <cstring>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <nmmintrin.h>
+#define PKT_HAVE_X86 ( 1 )
+#endif
+
+namespace
+{
+   const uint16_t CRC16_CCITT_POLY( 0x1021 );
+   // Reflected CRC-32C polynomial
+   const uint32_t CRC32C_POLY( 0x82F63B78 );
+
+   struct CrcTables
+   {
+      CrcTables()
+      {
+         for ( uint32_t value = 0; value < 256; ++value )
+         {
+            uint16_t crc16 = static_cast< uint16_t >( value << 8 );
+            uint32_t crc32 = value;
+            for ( int bit = 0; bit < 8; ++bit )
+            {
+               crc16 = static_cast< uint16_t >(
+                  ( crc16 & 0x8000 ) ? ( crc16 << 1 ) ^ CRC16_CCITT_POLY : ( crc16 << 1 ) );
+               crc32 = ( crc32 & 1 ) ? ( crc32 >> 1 ) ^ CRC32C_POLY : ( crc32 >> 1 );
+            }
+            m_crc16[ value ] = crc16;
+            m_crc32c[ value ] = crc32;
+         }
+      }
+
+      uint16_t m_crc16[ 256 ];
+      uint32_t m_crc32c[ 256 ];
+   };
+
+   const CrcTables& tables()
+   {
+      static const CrcTables TABLES;
+      return TABLES;
+   }
+
+   uint32_t crc32cSoftware( uint32_t crc, size_t len, const uint8_t* data )
+   {
+      const uint32_t* table = tables().m_crc32c;
+      crc = ~crc;
+      for ( size_t idx = 0; idx < len; ++idx )
+      {
+         crc = table[ ( crc ^ data[ idx ] ) & 0xFF ] ^ ( crc >> 8 );
+      }
+      return ~crc;
+   }
+
+#ifdef PKT_HAVE_X86
+   __attribute__( ( target( "sse4.2" ) ) ) uint32_t crc32cHardware( uint32_t crc,
+                                                                    size_t len,
+                                                                    const uint8_t* data )
+   {
+      crc = ~crc;
+#ifdef __x86_64__
+      uint64_t crc64 = crc;
+      for ( ; len >= sizeof( uint64_t ); len -= sizeof( uint64_t ), data += sizeof( uint64_t ) )
+      {
+         uint64_t word;
+         memcpy( &word, data, sizeof( word ) );
+         crc64 = _mm_crc32_u64( crc64, word );
+      }
+      crc = static_cast< uint32_t >( crc64 );
+#endif
+      for ( ; len > 0; --len )
+      {
+         crc = _mm_crc32_u8( crc, *data++ );
+      }
+      return ~crc;
+   }
+#endif
+
+   typedef uint32_t ( *crc32c_fn_t )( uint32_t, size_t, const uint8_t* );
+
+   bool hardwareSupported()
+   {
+#ifdef PKT_HAVE_X86
+      // This can run during static initialization, possibly before libgcc has probed the CPU
+      __builtin_cpu_init();
+      return __builtin_cpu_supports( "sse4.2" );
+#else
+      return false;
+#endif
+   }
+
+   crc32c_fn_t selectCrc32c()
+   {
+#ifdef PKT_HAVE_X86
+      if ( hardwareSupported() )
+      {
+         return crc32cHardware;
+      }
+#endif
+      return crc32cSoftware;
+   }
+
+   uint32_t resolveCrc32c( uint32_t crc, size_t len, const uint8_t* data );
+
+   // Constant-initialized to the trampoline, so checksums taken by other static initializers
+   // still work
+   crc32c_fn_t crc32cImpl = resolveCrc32c;
+
+   // Stands in for the implementation until the first call (or the library's static
+   // initialization) resolves it
+   uint32_t resolveCrc32c( uint32_t crc, size_t len, const uint8_t* data )
+   {
+      crc32cImpl = selectCrc32c();
+      return crc32cImpl( crc, len, data );
+   }
+
+   struct ResolveAtLoad
+   {
+      ResolveAtLoad()
+      {
+         crc32cImpl = selectCrc32c();
+      }
+   } resolveAtLoad;
+} // namespace
+
+uint16_t pkt_crc16_ccitt( uint16_t crc, size_t len, const uint8_t* data )
+{
+   const uint16_t* table = tables().m_crc16;
+   for ( size_t idx = 0; idx < len; ++idx )
+   {
+      crc = static_cast< uint16_t >( ( crc << 8 )
+                                     ^ table[ ( ( crc >> 8 ) ^ data[ idx ] ) & 0xFF ] );
+   }
+   return crc;
+}
+
+uint32_t pkt_crc32c( uint32_t crc, size_t len, const uint8_t* data )
+{
+   return crc32cImpl( crc, len, data );
+}
+
+uint32_t pkt_crc32c_software( uint32_t crc, size_t len, const uint8_t* data )
+{
+   return crc32cSoftware( crc, len, data );
+}
+
+bool pkt_crc32c_hardware_supported( void )
+{
+   return hardwareSupported();
+}
+
+uint32_t pkt_crc32c_hardware( uint32_t crc, size_t len, const uint8_t* data )
+{
+#ifdef PKT_HAVE_X86
+   return crc32cHardware( crc, len, data );
+#else
+   return crc32cSoftware( crc, len, data );
+#endif
+}
+
+size_t pkt_checksum_length( pkt_checksum_t type )
+{
+   switch ( type )
+   {
+      case PKT_CHECKSUM_CRC16_CCITT:
+         return sizeof( uint16_t );
+      case PKT_CHECKSUM_CRC32C:
+         return sizeof( uint32_t );
+      default:
+         return 0;
+   }
+}
+
+size_t pkt_checksum_append( pkt_checksum_t type, size_t len, const uint8_t* data, uint8_t* trailer )
+{
+   uint32_t crc = 0;
+   switch ( type )
+   {
+      case PKT_CHECKSUM_CRC16_CCITT:
+         crc = pkt_crc16_ccitt( PKT_CRC16_CCITT_INIT, len, data );
+         break;
+      case PKT_CHECKSUM_CRC32C:
+         crc = pkt_crc32c( PKT_CRC32C_INIT, len, data );
+         break;
+      default:
+         break;
+   }
+   size_t trailerLength = pkt_checksum_length( type );
+   for ( size_t idx = 0; idx < trailerLength; ++idx )
+   {
+      trailer[ idx ] = static_cast< uint8_t >( crc >> ( 8 * idx ) );
+   }
+   return trailerLength;
+}
+
+bool pkt_checksum_verify( pkt_checksum_t type, size_t len, const uint8_t* data )
+{
+   size_t trailerLength = pkt_checksum_length( type );
+   if ( len < trailerLength )
+   {
+      return false;
+   }
+   uint8_t expected[ PKT_MAX_CHECKSUM_LENGTH ];
+   pkt_checksum_append( type, len - trailerLength, data, expected );
+   return 0 == memcmp( expected, data + len - trailerLength, trailerLength );
+}
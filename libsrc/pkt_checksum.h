@@ -0,0 +1,50 @@
+#ifndef PKT_CHECKSUM_H_INCLUDED
+#define PKT_CHECKSUM_H_INCLUDED
+
+#include "pkt_api.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+// Initial value for pkt_crc16_ccitt (CRC-16/CCITT-FALSE)
+#define PKT_CRC16_CCITT_INIT ( 0xFFFF )
+// Initial value for pkt_crc32c
+#define PKT_CRC32C_INIT ( 0 )
+// Largest trailer any checksum type appends
+#define PKT_MAX_CHECKSUM_LENGTH ( 4 )
+
+   // Frame trailer checksums. The trailer is the last bytes of the decoded packet, least
+   // significant byte first
+   typedef enum
+   {
+      PKT_CHECKSUM_NONE = 0,
+      PKT_CHECKSUM_CRC16_CCITT,
+      PKT_CHECKSUM_CRC32C
+   } pkt_checksum_t;
+
+   // CRC-16/CCITT-FALSE (poly 0x1021), continuing from crc
+   PKT_API uint16_t pkt_crc16_ccitt( uint16_t crc, size_t len, const uint8_t* data );
+   // CRC-32C (Castagnoli), continuing from crc. Uses the SSE4.2 crc32 instruction when available
+   PKT_API uint32_t pkt_crc32c( uint32_t crc, size_t len, const uint8_t* data );
+   // The table-driven CRC-32C pkt_crc32c falls back to, whatever the CPU
+   PKT_API uint32_t pkt_crc32c_software( uint32_t crc, size_t len, const uint8_t* data );
+   // Whether this CPU (and this build of the library) can run pkt_crc32c_hardware
+   PKT_API bool pkt_crc32c_hardware_supported( void );
+   // The SSE4.2 CRC-32C pkt_crc32c prefers. Must be supported
+   PKT_API uint32_t pkt_crc32c_hardware( uint32_t crc, size_t len, const uint8_t* data );
+   // Number of trailer bytes used by a checksum type
+   PKT_API size_t pkt_checksum_length( pkt_checksum_t type );
+   // Writes the trailer for len bytes of data to trailer and returns its length
+   PKT_API size_t pkt_checksum_append( pkt_checksum_t type, size_t len, const uint8_t* data,
+                                       uint8_t* trailer );
+   // Checks that the last pkt_checksum_length( type ) bytes of data are its valid trailer
+   PKT_API bool pkt_checksum_verify( pkt_checksum_t type, size_t len, const uint8_t* data );
+
+#ifdef __cplusplus
+}
+#endif
+#endif // PKT_CHECKSUM_H_INCLUDED
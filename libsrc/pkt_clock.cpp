@@ -0,0 +1,52 @@
+#include "pkt_clock.h"
+
+#include <ctime>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#define PKT_HAVE_TSC ( 1 )
+#endif
+
+namespace
+{
+   uint64_t monotonicNs()
+   {
+      timespec now;
+      clock_gettime( CLOCK_MONOTONIC, &now );
+      return static_cast< uint64_t >( now.tv_sec ) * 1000000000ull + now.tv_nsec;
+   }
+
+   double calibrate()
+   {
+#ifdef PKT_HAVE_TSC
+      // Spin for long enough that the clock_gettime overhead at either end is negligible
+      const uint64_t CALIBRATION_NS( 10000000 );
+      uint64_t startNs = monotonicNs();
+      uint64_t startTicks = __rdtsc();
+      uint64_t endNs;
+      do
+      {
+         endNs = monotonicNs();
+      } while ( endNs - startNs < CALIBRATION_NS );
+      uint64_t endTicks = __rdtsc();
+      return static_cast< double >( endNs - startNs ) / ( endTicks - startTicks );
+#else
+      return 1.0;
+#endif
+   }
+} // namespace
+
+uint64_t pkt_clock_now( void )
+{
+#ifdef PKT_HAVE_TSC
+   return __rdtsc();
+#else
+   return monotonicNs();
+#endif
+}
+
+double pkt_clock_ns_per_tick( void )
+{
+   static const double NS_PER_TICK = calibrate();
+   return NS_PER_TICK;
+}
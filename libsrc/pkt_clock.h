@@ -0,0 +1,21 @@
+#ifndef PKT_CLOCK_H_INCLUDED
+#define PKT_CLOCK_H_INCLUDED
+
+#include "pkt_api.h"
+
+#include <cstdint>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+   // Cheap monotonic timestamp: the TSC on x86, CLOCK_MONOTONIC nanoseconds elsewhere
+   PKT_API uint64_t pkt_clock_now( void );
+   // Nanoseconds per pkt_clock_now() tick. The first call calibrates the TSC against
+   // CLOCK_MONOTONIC, which takes about 10 ms
+   PKT_API double pkt_clock_ns_per_tick( void );
+
+#ifdef __cplusplus
+}
+#endif
+#endif // PKT_CLOCK_H_INCLUDED
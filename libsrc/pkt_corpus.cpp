@@ -0,0 +1,268 @@
+#include "pkt_corpus.h"
+
+#include "cobs_decoder.h"
+
+namespace
+{
+   // Values every framing has to escape: the DLE control characters plus the COBS delimiter
+   const uint8_t SPECIALS[] = { COBS_DELIMITER, STX, ETX, DLE };
+   // How far past MAX_DECODED_DATA_LENGTH an overflow frame can run
+   const size_t MAX_OVERFLOW( 64 );
+
+   // splitmix64, so a seed produces the same numbers everywhere
+   class CorpusRandom
+   {
+    public:
+      explicit CorpusRandom( uint64_t seed ) : m_state( seed ) {}
+
+      uint64_t next()
+      {
+         uint64_t value = ( m_state += 0x9e3779b97f4a7c15ULL );
+         value = ( value ^ ( value >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+         value = ( value ^ ( value >> 27 ) ) * 0x94d049bb133111ebULL;
+         return value ^ ( value >> 31 );
+      }
+      // From 0 up to (not including) bound
+      size_t below( size_t bound ) { return static_cast< size_t >( next() % bound ); }
+      size_t between( size_t low, size_t high ) { return low + below( high - low + 1 ); }
+      // From 0 up to (not including) 1
+      double fraction() { return static_cast< double >( next() >> 11 ) / 9007199254740992.0; }
+
+    private:
+      uint64_t m_state;
+   };
+
+   uint8_t plainByte( CorpusRandom& bytes )
+   {
+      return static_cast< uint8_t >( 0x40 + bytes.below( 0xC0 ) );
+   }
+
+   // A payload of the configured size and escape rate
+   void makePayload( const pkt_corpus_config_t* config,
+                     CorpusRandom& layout,
+                     CorpusRandom& bytes,
+                     std::vector< uint8_t >& payload )
+   {
+      payload.resize( ( PKT_CORPUS_SIZE_BIMODAL == config->size_distribution )
+                         ? ( layout.below( 2 ) ? config->max_payload : config->min_payload )
+                         : layout.between( config->min_payload, config->max_payload ) );
+      for ( uint8_t& byte : payload )
+      {
+         byte = ( bytes.fraction() < config->escape_rate ) ? SPECIALS[ bytes.below( 4 ) ]
+                                                           : plainByte( bytes );
+      }
+   }
+
+   // An unterminated frame is left for the next frame's STX to abort
+   void dleFrame( const std::vector< uint8_t >& payload,
+                  bool terminate,
+                  std::vector< uint8_t >& stream )
+   {
+      stream.push_back( STX );
+      for ( uint8_t byte : payload )
+      {
+         if ( STX == byte || ETX == byte || DLE == byte )
+         {
+            stream.push_back( DLE );
+            byte |= ENC;
+         }
+         stream.push_back( byte );
+      }
+      if ( terminate )
+      {
+         stream.push_back( ETX );
+      }
+   }
+
+   void cobsFrame( const std::vector< uint8_t >& payload, std::vector< uint8_t >& stream )
+   {
+      size_t start = stream.size();
+      stream.resize( start + COBS_MAX_ENCODED_LENGTH( payload.size() ) );
+      stream.resize( start + cobs_encode( payload.size(), payload.data(), &stream[ start ] ) );
+   }
+
+   bool validConfig( const pkt_corpus_config_t* config )
+   {
+      return ( config->payload_bytes > 0 ) && ( config->min_payload >= 1 )
+             && ( config->min_payload <= config->max_payload )
+             && ( config->max_payload <= MAX_DECODED_DATA_LENGTH )
+             && ( config->escape_rate >= 0.0 ) && ( config->escape_rate <= 1.0 )
+             && ( config->garbage_ratio >= 0.0 ) && ( config->garbage_ratio < 1.0 )
+             && ( ( PKT_CORPUS_DLE == config->framing ) || ( 0.0 == config->garbage_ratio ) )
+             && ( config->truncated_rate >= 0.0 ) && ( config->overflow_rate >= 0.0 )
+             && ( config->truncated_rate + config->overflow_rate < 1.0 )
+             && ( config->min_chunk >= 1 ) && ( config->min_chunk <= config->max_chunk );
+   }
+} // namespace
+
+PacketCorpus::PacketCorpus() : m_truncatedCount( 0 ), m_overflowCount( 0 ) {}
+
+void pkt_corpus_default_config( pkt_corpus_config_t* config )
+{
+   config->seed = 1;
+   config->framing = PKT_CORPUS_DLE;
+   config->payload_bytes = 64 * 1024;
+   config->size_distribution = PKT_CORPUS_SIZE_UNIFORM;
+   config->min_payload = 1;
+   config->max_payload = MAX_DECODED_DATA_LENGTH;
+   config->escape_rate = 0.01;
+   config->garbage_ratio = 0.0;
+   config->truncated_rate = 0.0;
+   config->overflow_rate = 0.0;
+   config->min_chunk = 4096;
+   config->max_chunk = 4096;
+}
+
+pkt_corpus_t* pkt_corpus_create( const pkt_corpus_config_t* config )
+{
+   if ( !validConfig( config ) )
+   {
+      return nullptr;
+   }
+   // Separate generators, so the packets don't depend on the framing or the garbage, and the
+   // stream doesn't depend on the write sizes
+   CorpusRandom layout( config->seed );
+   CorpusRandom bytes( config->seed ^ 0x6279746573ULL );
+   CorpusRandom garbage( config->seed ^ 0x67617262616765ULL );
+   CorpusRandom chunks( config->seed ^ 0x6368756e6b73ULL );
+   const bool dle = ( PKT_CORPUS_DLE == config->framing );
+
+   auto* corpus = new PacketCorpus;
+   std::vector< uint8_t > payload;
+   std::vector< uint8_t > encoded;
+   size_t delivered = 0;
+   while ( delivered < config->payload_bytes )
+   {
+      double kind = layout.fraction();
+      size_t frameStart = corpus->m_stream.size();
+      if ( kind < config->truncated_rate + config->overflow_rate )
+      {
+         if ( kind < config->truncated_rate )
+         {
+            makePayload( config, layout, bytes, payload );
+            // A leading delimiter would end COBS's first block before it could be cut
+            if ( COBS_DELIMITER == payload[ 0 ] )
+            {
+               payload[ 0 ] = plainByte( bytes );
+            }
+            size_t cut = layout.below( payload.size() );
+            if ( dle )
+            {
+               // Whole bytes only: a dangling DLE would de-stuff the next frame's first byte
+               payload.resize( cut );
+               dleFrame( payload, false, corpus->m_stream );
+            }
+            else
+            {
+               // Stop inside the first block, so the delimiter cuts it short
+               encoded.clear();
+               cobsFrame( payload, encoded );
+               corpus->m_stream.insert( corpus->m_stream.end(),
+                                        encoded.begin(),
+                                        encoded.begin() + 1 + cut % ( encoded[ 0 ] - 1 ) );
+               corpus->m_stream.push_back( COBS_DELIMITER );
+            }
+            corpus->m_truncatedCount++;
+            continue;
+         }
+         payload.resize( MAX_DECODED_DATA_LENGTH + 1 + layout.below( MAX_OVERFLOW ) );
+         for ( uint8_t& byte : payload )
+         {
+            byte = plainByte( bytes );
+         }
+         corpus->m_overflowCount++;
+      }
+      else
+      {
+         makePayload( config, layout, bytes, payload );
+         corpus->m_payloads.insert( corpus->m_payloads.end(), payload.begin(), payload.end() );
+         corpus->m_packetEnds.push_back( corpus->m_payloads.size() );
+         delivered += payload.size();
+      }
+
+      if ( dle )
+      {
+         dleFrame( payload, true, corpus->m_stream );
+      }
+      else
+      {
+         cobsFrame( payload, corpus->m_stream );
+      }
+      size_t noise = static_cast< size_t >( ( corpus->m_stream.size() - frameStart )
+                                            * config->garbage_ratio
+                                            / ( 1.0 - config->garbage_ratio ) );
+      while ( noise > 0 )
+      {
+         uint8_t byte = static_cast< uint8_t >( garbage.next() );
+         if ( ( STX != byte ) && ( DLE != byte ) )
+         {
+            corpus->m_stream.push_back( byte );
+            --noise;
+         }
+      }
+   }
+
+   for ( size_t offset = 0; offset < corpus->m_stream.size(); )
+   {
+      size_t chunk = chunks.between( config->min_chunk, config->max_chunk );
+      if ( chunk > corpus->m_stream.size() - offset )
+      {
+         chunk = corpus->m_stream.size() - offset;
+      }
+      corpus->m_chunks.push_back( chunk );
+      offset += chunk;
+   }
+   return corpus;
+}
+
+void pkt_corpus_destroy( pkt_corpus_t* corpus )
+{
+   delete corpus;
+}
+
+size_t pkt_corpus_stream_length( const pkt_corpus_t* corpus )
+{
+   return corpus->m_stream.size();
+}
+
+const uint8_t* pkt_corpus_stream( const pkt_corpus_t* corpus )
+{
+   return corpus->m_stream.data();
+}
+
+size_t pkt_corpus_chunk_count( const pkt_corpus_t* corpus )
+{
+   return corpus->m_chunks.size();
+}
+
+const size_t* pkt_corpus_chunks( const pkt_corpus_t* corpus )
+{
+   return corpus->m_chunks.data();
+}
+
+size_t pkt_corpus_packet_count( const pkt_corpus_t* corpus )
+{
+   return corpus->m_packetEnds.size();
+}
+
+const uint8_t* pkt_corpus_packet( const pkt_corpus_t* corpus, size_t index, size_t* length )
+{
+   size_t start = ( index > 0 ) ? corpus->m_packetEnds[ index - 1 ] : 0;
+   *length = corpus->m_packetEnds[ index ] - start;
+   return corpus->m_payloads.data() + start;
+}
+
+size_t pkt_corpus_payload_length( const pkt_corpus_t* corpus )
+{
+   return corpus->m_payloads.size();
+}
+
+size_t pkt_corpus_truncated_count( const pkt_corpus_t* corpus )
+{
+   return corpus->m_truncatedCount;
+}
+
+size_t pkt_corpus_overflow_count( const pkt_corpus_t* corpus )
+{
+   return corpus->m_overflowCount;
+}
@@ -0,0 +1,108 @@
+#ifndef PKT_CORPUS_H_INCLUDED
+#define PKT_CORPUS_H_INCLUDED
+
+#include "pkt_decoder.h"
+
+#include <vector>
+
+// Seeded generator of synthetic framed traffic, so benchmarks, tests and fuzzers share the same
+// inputs. A corpus is a byte stream of DLE or COBS frames, the packets a decoder should deliver
+// from it, and the sizes of the writes to feed it in. The same config always produces the same
+// corpus, on any platform: the generator doesn't use the standard library's distributions, whose
+// output differs between implementations.
+//
+// Besides valid frames a stream can hold:
+//   garbage     line noise after frames (DLE only: COBS can't resynchronize past it). It never
+//               contains STX or DLE, which would start a frame or arm de-stuffing of the next one
+//   truncated   frames that stop part way through, cut off by the next frame's STX (DLE) or by a
+//               delimiter inside a block (COBS). Never followed by garbage
+//   overflow    frames that decode to more than MAX_DECODED_DATA_LENGTH bytes. Their payloads
+//               have no escapes
+// None of these are delivered, and the stream always ends with a valid frame. The packets don't
+// depend on the framing or the garbage ratio, so DLE and COBS corpora made from the same config
+// carry the same packets.
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+   typedef enum
+   {
+      PKT_CORPUS_DLE = 0,
+      PKT_CORPUS_COBS
+   } pkt_corpus_framing_t;
+
+   typedef enum
+   {
+      // Payload lengths spread evenly from min_payload to max_payload
+      PKT_CORPUS_SIZE_UNIFORM = 0,
+      // Each payload is either min_payload or max_payload long
+      PKT_CORPUS_SIZE_BIMODAL
+   } pkt_corpus_sizes_t;
+
+   typedef struct
+   {
+      uint64_t seed;
+      pkt_corpus_framing_t framing;
+      // Frames are generated until the valid ones hold at least this many payload bytes
+      size_t payload_bytes;
+      pkt_corpus_sizes_t size_distribution;
+      // 1 <= min_payload <= max_payload <= MAX_DECODED_DATA_LENGTH
+      size_t min_payload;
+      size_t max_payload;
+      // Probability that a payload byte is STX, ETX, DLE or the COBS delimiter
+      double escape_rate;
+      // Fraction of the stream that is garbage
+      double garbage_ratio;
+      // Probability that a frame is truncated, and that it overflows
+      double truncated_rate;
+      double overflow_rate;
+      // Write sizes spread evenly from min_chunk to max_chunk (the last write may be shorter)
+      size_t min_chunk;
+      size_t max_chunk;
+   } pkt_corpus_config_t;
+
+   class PacketCorpus;
+
+   typedef struct PacketCorpus pkt_corpus_t;
+
+   // Fills config with 64 KiB of 1-512 byte DLE packets with 1% escapes, and nothing else, in
+   // 4 KiB writes
+   PKT_API void pkt_corpus_default_config( pkt_corpus_config_t* config );
+   // Generates a corpus. Returns a nullptr if the config is out of range
+   PKT_API pkt_corpus_t* pkt_corpus_create( const pkt_corpus_config_t* config );
+   PKT_API void pkt_corpus_destroy( pkt_corpus_t* corpus );
+   PKT_API size_t pkt_corpus_stream_length( const pkt_corpus_t* corpus );
+   PKT_API const uint8_t* pkt_corpus_stream( const pkt_corpus_t* corpus );
+   // Write sizes, which add up to the stream length
+   PKT_API size_t pkt_corpus_chunk_count( const pkt_corpus_t* corpus );
+   PKT_API const size_t* pkt_corpus_chunks( const pkt_corpus_t* corpus );
+   // The packets a decoder delivers from the stream, in order
+   PKT_API size_t pkt_corpus_packet_count( const pkt_corpus_t* corpus );
+   PKT_API const uint8_t* pkt_corpus_packet( const pkt_corpus_t* corpus,
+                                             size_t index,
+                                             size_t* length );
+   // Total length of the packets
+   PKT_API size_t pkt_corpus_payload_length( const pkt_corpus_t* corpus );
+   // Frames a DLE decoder reports as PKT_ERROR_ABORTED and PKT_ERROR_OVERFLOW
+   PKT_API size_t pkt_corpus_truncated_count( const pkt_corpus_t* corpus );
+   PKT_API size_t pkt_corpus_overflow_count( const pkt_corpus_t* corpus );
+
+   class PacketCorpus
+   {
+    public:
+      PacketCorpus();
+      virtual ~PacketCorpus() = default;
+
+      std::vector< uint8_t > m_stream;
+      std::vector< size_t > m_chunks;
+      // The expected packets, back to back, and where each one ends
+      std::vector< uint8_t > m_payloads;
+      std::vector< size_t > m_packetEnds;
+      size_t m_truncatedCount;
+      size_t m_overflowCount;
+   };
+
+#ifdef __cplusplus
+}
+#endif
+#endif // PKT_CORPUS_H_INCLUDED
@@ -1,55 +1,194 @@
 #include "pkt_decoder.h"
 
+#include "pkt_probes.h"
+#include "pkt_simd.h"
+
+#include <algorithm>
 #include <cstring>
 
+namespace
+{
+   // Index of the first bit set in bits at or after from, or limit if there isn't one before it.
+   // Only the words up to limit are read
+   size_t nextBit( const uint64_t* bits, size_t from, size_t limit )
+   {
+      if ( from >= limit )
+      {
+         return limit;
+      }
+      size_t word = from / 64;
+      uint64_t remaining = bits[ word ] & ( ~0ULL << ( from % 64 ) );
+      const size_t words = ( limit + 63 ) / 64;
+      while ( 0 == remaining )
+      {
+         if ( ++word == words )
+         {
+            return limit;
+         }
+         remaining = bits[ word ];
+      }
+      return std::min< size_t >( word * 64 + __builtin_ctzll( remaining ), limit );
+   }
+} // namespace
+
 PacketDecoder::PacketDecoder( pkt_read_fn_t readCallback, void* callbackCtx )
    : m_packetBuffer( nullptr ),
      m_pktBufIdx( 0 ),
      m_pktValid( false ),
      m_readCallback( readCallback ),
      m_callbackCtx( callbackCtx ),
-     m_deStuffNextByte( false )
+     m_deStuffNextByte( false ),
+     m_checksumType( PKT_CHECKSUM_NONE ),
+     m_checksumErrorCallback( nullptr ),
+     m_errorCallback( nullptr ),
+     m_errorCtx( nullptr ),
+     m_streamOffset( 0 ),
+     m_readTsCallback( nullptr ),
+     m_currentTime( 0 ),
+     m_stxTime( 0 ),
+     m_bufferPool( nullptr ),
+     m_arena( nullptr ),
+     m_arenaChunk( nullptr ),
+     m_routeOffset( 0 ),
+     m_filter( nullptr ),
+     m_filterCtx( nullptr ),
+     m_filterLength( 0 ),
+     m_routeDropIdx( 0 ),
+     m_filterIdx( 0 ),
+     m_firstFilterIdx( 0 ),
+     m_dropPacket( false )
 {
 }
 
 pkt_decoder_t* pkt_decoder_create( pkt_read_fn_t callback, void* callback_ctx )
 {
    auto* decoder = new PacketDecoder( callback, callback_ctx );
-   decoder->m_packetBuffer = new uint8_t[ MAX_DECODED_DATA_LENGTH ];
+   decoder->m_packetBuffer = new uint8_t[ MAX_DECODED_DATA_LENGTH ]();
    decoder->clearBuffer();
    return decoder;
 }
 
+pkt_decoder_t* pkt_decoder_create_ts( pkt_read_ts_fn_t callback, void* callback_ctx )
+{
+   pkt_decoder_t* decoder = pkt_decoder_create( nullptr, callback_ctx );
+   decoder->m_readTsCallback = callback;
+   return decoder;
+}
+
+pkt_decoder_t* pkt_decoder_create_pooled( pkt_read_fn_t callback,
+                                          void* callback_ctx,
+                                          pkt_buffer_pool_t* pool )
+{
+   // No buffer until the first STX
+   auto* decoder = new PacketDecoder( callback, callback_ctx );
+   decoder->m_bufferPool = pool;
+   return decoder;
+}
+
+pkt_decoder_t* pkt_decoder_create_arena( pkt_read_fn_t callback,
+                                         void* callback_ctx,
+                                         pkt_arena_t* arena )
+{
+   // No chunk until the first STX
+   auto* decoder = new PacketDecoder( callback, callback_ctx );
+   decoder->m_arena = arena;
+   return decoder;
+}
+
 void pkt_decoder_destroy( pkt_decoder_t* decoder )
 {
    decoder->m_readCallback = nullptr;
    decoder->m_callbackCtx = nullptr;
-   delete decoder->m_packetBuffer;
+   if ( !decoder->borrowsBuffer() )
+   {
+      delete[] decoder->m_packetBuffer;
+   }
+   else if ( nullptr != decoder->m_packetBuffer )
+   {
+      decoder->releaseBuffer( 0 );
+   }
+   if ( nullptr != decoder->m_arenaChunk )
+   {
+      decoder->m_arena->release( decoder->m_arenaChunk );
+   }
    delete decoder;
 }
 
 void pkt_decoder_write_bytes( pkt_decoder_t* decoder, size_t length, const uint8_t* data )
 {
+   PacketBitmaps bitmaps;
+   bitmaps.m_start = 0;
+   bitmaps.m_length = 0;
+   bitmaps.m_nextLength = PKT_MIN_BITMAP_BLOCK;
    for ( size_t idx = 0; idx < length; ++idx )
    {
+      if ( !decoder->m_pktValid )
+      {
+         // Hunting for the start of a packet (or the end of a dropped one). Skip straight to the
+         // next STX instead of running every byte of garbage through the switch below
+         const bool resync = !decoder->m_dropPacket;
+         size_t huntIdx = idx;
+         idx = resync ? decoder->huntForStx( idx, length, data )
+                      : decoder->skipPacket( idx, length, data );
+         if ( idx == length )
+         {
+            break;
+         }
+         if ( resync && ( idx > huntIdx ) )
+         {
+            PKT_PROBE3( resync, decoder, idx - huntIdx, decoder->m_streamOffset + idx );
+         }
+         if ( resync && decoder->decodesInBulk() )
+         {
+            // Frames that need only copying out are delivered without the switch below ever
+            // seeing them, so a run of short frames costs little more than one pass over them
+            idx = decoder->decodeFrames( idx, length, data, bitmaps );
+            if ( idx == length )
+            {
+               break;
+            }
+         }
+      }
+
       switch ( data[ idx ] )
       {
          case STX: {
-            // If we already have a packet in progress this will cause it to be silently dropped
+            // If we already have a packet in progress this will cause it to be dropped
+            if ( decoder->m_pktValid )
+            {
+               PKT_PROBE3(
+                  abort, decoder, decoder->m_pktBufIdx, decoder->m_streamOffset + idx );
+               decoder->reportError(
+                  PKT_ERROR_ABORTED, decoder->m_pktBufIdx, decoder->m_streamOffset + idx );
+            }
+            // Only a pooled or arena decoder can be without a buffer, and then only between packets
+            if ( ( nullptr == decoder->m_packetBuffer ) && !decoder->acquireBuffer() )
+            {
+               decoder->reportError( PKT_ERROR_NO_BUFFER, 0, decoder->m_streamOffset + idx );
+               break;
+            }
             decoder->clearBuffer();
             decoder->m_pktValid = true;
+            decoder->m_filterIdx = decoder->m_firstFilterIdx;
+            decoder->m_stxTime = decoder->m_currentTime;
          }
          break;
          case ETX: {
-            // do NOT call the callback function if a) we're not working on a valid packet, b) we
-            // haven't inserted any decoded bytes into the packet buffer, or c) we don't have a
-            // valid callback pointer
-            if ( decoder->m_pktValid && ( decoder->m_pktBufIdx > 0 ) && decoder->m_readCallback )
+            // do NOT deliver the packet if we haven't inserted any decoded bytes into the packet
+            // buffer
+            if ( decoder->m_pktBufIdx > 0 )
+            {
+               decoder->deliverPacket( decoder->m_streamOffset + idx );
+            }
+            else
             {
-               decoder->m_readCallback(
-                  decoder->m_callbackCtx, decoder->m_pktBufIdx, decoder->m_packetBuffer );
+               decoder->reportError( PKT_ERROR_EMPTY, 0, decoder->m_streamOffset + idx );
             }
             decoder->m_pktValid = false;
+            if ( decoder->borrowsBuffer() )
+            {
+               decoder->releaseBuffer( decoder->m_pktBufIdx );
+            }
          }
          break;
          case DLE: {
@@ -57,33 +196,440 @@ void pkt_decoder_write_bytes( pkt_decoder_t* decoder, size_t length, const uint8
          }
          break;
          default: {
-            // handle a non-control byte (only if currently processing a packet)
-            if ( decoder->m_pktValid )
+            // handle a non-control byte (we only get here while processing a packet)
+            uint8_t currentByte = data[ idx ];
+            if ( decoder->m_deStuffNextByte )
             {
-               uint8_t currentByte = data[ idx ];
-               if ( decoder->m_deStuffNextByte )
+               currentByte &= ~ENC;
+               decoder->m_deStuffNextByte = false;
+            }
+            if ( MAX_DECODED_DATA_LENGTH > decoder->m_pktBufIdx )
+            {
+               decoder->m_packetBuffer[ decoder->m_pktBufIdx++ ] = currentByte;
+               if ( decoder->m_pktBufIdx == decoder->m_filterIdx )
                {
-                  currentByte &= ~ENC;
-                  decoder->m_deStuffNextByte = false;
+                  decoder->filterPacket();
                }
-               if ( MAX_DECODED_DATA_LENGTH > decoder->m_pktBufIdx )
+               if ( decoder->m_pktValid )
                {
-                  decoder->m_packetBuffer[ decoder->m_pktBufIdx++ ] = currentByte;
+                  idx = decoder->copyPlainRun( idx + 1, length, data ) - 1;
                }
-               else
+            }
+            else
+            {
+               // Fail because this byte will exceed the allowed maximum packet length, and
+               // prevent handling of any further bytes until a new STX is received
+               decoder->m_pktValid = false;
+               PKT_PROBE3(
+                  overflow, decoder, decoder->m_pktBufIdx, decoder->m_streamOffset + idx );
+               decoder->reportError(
+                  PKT_ERROR_OVERFLOW, decoder->m_pktBufIdx, decoder->m_streamOffset + idx );
+               if ( decoder->borrowsBuffer() )
                {
-                  // Silently fail because this byte will exceed the allowed maximum packet
-                  // length, and prevent handling of any further bytes until a new STX is received
-                  decoder->m_pktValid = false;
+                  decoder->releaseBuffer( 0 );
                }
             }
          }
       }
    }
+   decoder->m_streamOffset += length;
+}
+
+void pkt_decoder_write_bytes_ts( pkt_decoder_t* decoder,
+                                 size_t length,
+                                 const uint8_t* data,
+                                 uint64_t timestamp )
+{
+   // One clock read per write, however many packets it completes
+   decoder->m_currentTime = ( PKT_TIMESTAMP_NOW == timestamp ) ? pkt_clock_now() : timestamp;
+   pkt_decoder_write_bytes( decoder, length, data );
+}
+
+void pkt_decoder_set_checksum( pkt_decoder_t* decoder,
+                               pkt_checksum_t type,
+                               pkt_read_fn_t error_callback )
+{
+   decoder->m_checksumType = type;
+   decoder->m_checksumErrorCallback = error_callback;
+}
+
+void pkt_decoder_set_error_callback( pkt_decoder_t* decoder,
+                                     pkt_error_fn_t callback,
+                                     void* callback_ctx )
+{
+   decoder->m_errorCallback = callback;
+   decoder->m_errorCtx = callback_ctx;
+}
+
+void pkt_decoder_set_route_offset( pkt_decoder_t* decoder, size_t offset )
+{
+   decoder->m_routeOffset = offset;
+   if ( 0 != decoder->m_routeDropIdx )
+   {
+      decoder->m_routeDropIdx = offset + 1;
+      decoder->updateFilterIdx();
+   }
+}
+
+void pkt_decoder_set_route( pkt_decoder_t* decoder,
+                            uint8_t type,
+                            pkt_read_fn_t handler,
+                            void* handler_ctx )
+{
+   if ( !decoder->m_routes )
+   {
+      decoder->m_routes.reset( new PacketRoute[ 256 ]() );
+   }
+   decoder->m_routes[ type ].m_handler = handler;
+   decoder->m_routes[ type ].m_ctx = handler_ctx;
+}
+
+void pkt_decoder_set_route_drop( pkt_decoder_t* decoder, uint8_t type, bool drop )
+{
+   if ( !decoder->m_routes )
+   {
+      decoder->m_routes.reset( new PacketRoute[ 256 ]() );
+   }
+   decoder->m_routes[ type ].m_drop = drop;
+   if ( drop )
+   {
+      // Check each packet's type as soon as it has been decoded
+      decoder->m_routeDropIdx = decoder->m_routeOffset + 1;
+      decoder->updateFilterIdx();
+      return;
+   }
+   for ( size_t route = 0; route < 256; ++route )
+   {
+      if ( decoder->m_routes[ route ].m_drop )
+      {
+         return;
+      }
+   }
+   // The last drop is gone, so packets needn't stop at their type byte (and can be decoded in
+   // bulk again)
+   decoder->m_routeDropIdx = 0;
+   decoder->updateFilterIdx();
+}
+
+void pkt_decoder_set_filter( pkt_decoder_t* decoder,
+                             size_t filter_length,
+                             pkt_filter_fn_t filter,
+                             void* filter_ctx )
+{
+   decoder->m_filter = filter;
+   decoder->m_filterCtx = filter_ctx;
+   decoder->m_filterLength = ( nullptr == filter ) ? 0 : ( filter_length > 0 ) ? filter_length : 1;
+   decoder->updateFilterIdx();
+}
+
+void PacketDecoder::updateFilterIdx()
+{
+   // The earlier of the two checkpoints
+   this->m_firstFilterIdx = this->m_routeDropIdx;
+   if ( ( 0 == this->m_firstFilterIdx )
+        || ( ( 0 != this->m_filterLength ) && ( this->m_filterLength < this->m_firstFilterIdx ) ) )
+   {
+      this->m_firstFilterIdx = this->m_filterLength;
+   }
+   if ( !this->m_pktValid )
+   {
+      this->m_filterIdx = this->m_firstFilterIdx;
+   }
+}
+
+void PacketDecoder::filterPacket()
+{
+   size_t length = this->m_pktBufIdx;
+   if ( ( length == this->m_routeDropIdx )
+        && this->m_routes[ this->m_packetBuffer[ this->m_routeOffset ] ].m_drop )
+   {
+      this->dropPacket();
+      return;
+   }
+   if ( ( length == this->m_filterLength )
+        && !this->m_filter( this->m_filterCtx, length, this->m_packetBuffer ) )
+   {
+      this->dropPacket();
+      return;
+   }
+   // Move on to the later checkpoint, if there is one
+   this->m_filterIdx = ( this->m_routeDropIdx > length )    ? this->m_routeDropIdx
+                       : ( this->m_filterLength > length ) ? this->m_filterLength
+                                                           : 0;
+}
+
+void PacketDecoder::dropPacket()
+{
+   PKT_PROBE2( drop, this, this->m_pktBufIdx );
+   this->m_pktValid = false;
+   this->m_dropPacket = true;
+   if ( this->borrowsBuffer() )
+   {
+      this->releaseBuffer( 0 );
+   }
+}
+
+size_t PacketDecoder::skipPacket( size_t idx, size_t length, const uint8_t* data )
+{
+   // The packet ends at its ETX, or is cut short by an STX
+   const void* etx = memchr( data + idx, ETX, length - idx );
+   size_t endIdx = ( nullptr == etx ) ? length : static_cast< const uint8_t* >( etx ) - data;
+   const void* stx = memchr( data + idx, STX, endIdx - idx );
+   if ( nullptr != stx )
+   {
+      endIdx = static_cast< const uint8_t* >( stx ) - data;
+   }
+   // m_pktBufIdx keeps counting the skipped packet's data bytes. If it grows too long it is
+   // dropped as an overflow would have been, and from then on every DLE arms de-stuffing
+   size_t room = MAX_DECODED_DATA_LENGTH - this->m_pktBufIdx;
+   size_t dataBytes = endIdx - idx;
+   if ( ( dataBytes > room ) || ( endIdx == length ) )
+   {
+      dataBytes -= std::count( data + idx, data + endIdx, DLE );
+      for ( size_t scan = idx; dataBytes > room; ++scan )
+      {
+         if ( ( DLE != data[ scan ] ) && ( 0 == room-- ) )
+         {
+            // The byte that would have overflowed it still consumes a pending DLE
+            this->m_deStuffNextByte = false;
+            this->m_dropPacket = false;
+            return this->huntForStx( scan + 1, length, data );
+         }
+      }
+   }
+   // Every skipped data byte consumes a pending DLE, so only a DLE at the very end carries on
+   if ( endIdx > idx )
+   {
+      this->m_deStuffNextByte = ( DLE == data[ endIdx - 1 ] );
+   }
+   if ( endIdx == length )
+   {
+      // The packet carries on into the next write
+      this->m_pktBufIdx += dataBytes;
+      return endIdx;
+   }
+   this->m_dropPacket = false;
+   if ( STX == data[ endIdx ] )
+   {
+      return endIdx;
+   }
+   // Skipped the ETX; hunt for the next packet
+   return this->huntForStx( endIdx + 1, length, data );
+}
+
+size_t PacketDecoder::copyPlainRun( size_t idx, size_t length, const uint8_t* data )
+{
+   // Stop where the buffer fills, so the byte after goes through the overflow check, or at the
+   // filter checkpoint
+   size_t room = MAX_DECODED_DATA_LENGTH - this->m_pktBufIdx;
+   if ( this->m_filterIdx > this->m_pktBufIdx )
+   {
+      room = std::min( room, this->m_filterIdx - this->m_pktBufIdx );
+   }
+   size_t run = pktFindControl( std::min( room, length - idx ), data + idx );
+   memcpy( this->m_packetBuffer + this->m_pktBufIdx, data + idx, run );
+   this->m_pktBufIdx += run;
+   if ( ( run > 0 ) && ( this->m_pktBufIdx == this->m_filterIdx ) )
+   {
+      this->filterPacket();
+   }
+   return idx + run;
+}
+
+bool PacketDecoder::decodesInBulk() const
+{
+   return !this->borrowsBuffer() && ( 0 == this->m_firstFilterIdx ) && !this->m_deStuffNextByte;
+}
+
+size_t PacketDecoder::decodeFrames( size_t idx,
+                                    size_t length,
+                                    const uint8_t* data,
+                                    PacketBitmaps& bitmaps )
+{
+   for ( ;; )
+   {
+      if ( ( idx < bitmaps.m_start ) || ( idx >= bitmaps.m_start + bitmaps.m_length ) )
+      {
+         bitmaps.m_start = idx;
+         bitmaps.m_length = std::min< size_t >( length - idx, bitmaps.m_nextLength );
+         pktControlBitmaps(
+            bitmaps.m_length, data + idx, bitmaps.m_stx, bitmaps.m_etx, bitmaps.m_dle );
+         bitmaps.m_nextLength =
+            std::min< size_t >( 2 * bitmaps.m_nextLength, PKT_MAX_BITMAP_BLOCK );
+      }
+      const size_t base = bitmaps.m_start;
+      const size_t end = bitmaps.m_length;
+      const size_t stx = idx - base;
+      size_t etx = nextBit( bitmaps.m_etx, stx + 1, end );
+      if ( ( etx == end ) && ( base + end < length )
+           && ( ( stx > 0 ) || ( end < PKT_MAX_BITMAP_BLOCK ) ) )
+      {
+         // The frame runs past the block, so start a bigger one at it
+         bitmaps.m_length = 0;
+         continue;
+      }
+      // Left to the byte loop: a frame that runs past the block, is empty or too long (the
+      // unsigned subtraction wraps for an empty one), is aborted or has escapes
+      size_t frameLength = etx - stx - 1;
+      if ( ( etx == end ) || ( frameLength - 1 >= MAX_DECODED_DATA_LENGTH )
+           || ( nextBit( bitmaps.m_stx, stx + 1, etx ) < etx )
+           || ( nextBit( bitmaps.m_dle, stx + 1, etx ) < etx ) )
+      {
+         return idx;
+      }
+      memcpy( this->m_packetBuffer, data + idx + 1, frameLength );
+      if ( this->m_pktBufIdx > frameLength )
+      {
+         // As clearBuffer would have left it
+         memset( this->m_packetBuffer + frameLength, 0, this->m_pktBufIdx - frameLength );
+      }
+      this->m_pktBufIdx = frameLength;
+      this->m_stxTime = this->m_currentTime;
+      this->deliverPacket( this->m_streamOffset + base + etx );
+
+      // Hunt for the next frame through the bitmaps, or past the block (or a DLE, which
+      // huntForStx keeps for the next frame) as the byte loop would
+      size_t huntIdx = base + etx + 1;
+      size_t next = nextBit( bitmaps.m_stx, etx + 1, end );
+      if ( ( next < end ) && ( next == nextBit( bitmaps.m_dle, etx + 1, next ) ) )
+      {
+         idx = base + next;
+      }
+      else
+      {
+         idx = this->huntForStx( huntIdx, length, data );
+         bitmaps.m_nextLength = PKT_MIN_BITMAP_BLOCK;
+      }
+      if ( idx == length )
+      {
+         return length;
+      }
+      if ( idx > huntIdx )
+      {
+         PKT_PROBE3( resync, this, idx - huntIdx, this->m_streamOffset + idx );
+      }
+      if ( !this->decodesInBulk() )
+      {
+         // The callback set a filter or route drop, or there was a DLE in the garbage
+         return idx;
+      }
+   }
+}
+
+void PacketDecoder::deliverPacket( uint64_t streamOffset )
+{
+   size_t length = this->m_pktBufIdx;
+   if ( this->m_filter && ( length < this->m_filterLength )
+        && !this->m_filter( this->m_filterCtx, length, this->m_packetBuffer ) )
+   {
+      // Too short to have been filtered as it was decoded
+      PKT_PROBE2( drop, this, length );
+      return;
+   }
+   if ( PKT_CHECKSUM_NONE != this->m_checksumType )
+   {
+      // The packet is still hot in cache, so checking it here in one pass is cheaper than
+      // folding every byte into a running CRC as it is decoded
+      if ( !pkt_checksum_verify( this->m_checksumType, length, this->m_packetBuffer ) )
+      {
+         if ( this->m_checksumErrorCallback )
+         {
+            this->m_checksumErrorCallback( this->m_callbackCtx, length, this->m_packetBuffer );
+         }
+         this->reportError( PKT_ERROR_CHECKSUM, length, streamOffset );
+         return;
+      }
+      length -= pkt_checksum_length( this->m_checksumType );
+      if ( 0 == length )
+      {
+         // A bare trailer is an empty packet, which is dropped
+         this->reportError( PKT_ERROR_EMPTY, 0, streamOffset );
+         return;
+      }
+   }
+   // Only packets that passed the filter and checksum, without their trailer
+   PKT_PROBE4( packet, this, length, this->m_packetBuffer, streamOffset );
+   if ( this->m_routes && ( length > this->m_routeOffset ) )
+   {
+      const PacketRoute& route = this->m_routes[ this->m_packetBuffer[ this->m_routeOffset ] ];
+      if ( route.m_handler )
+      {
+         route.m_handler( route.m_ctx, length, this->m_packetBuffer );
+         return;
+      }
+   }
+   if ( this->m_readTsCallback )
+   {
+      const pkt_timestamps_t timestamps = { this->m_stxTime, this->m_currentTime };
+      this->m_readTsCallback( this->m_callbackCtx, length, this->m_packetBuffer, &timestamps );
+   }
+   else if ( this->m_readCallback )
+   {
+      this->m_readCallback( this->m_callbackCtx, length, this->m_packetBuffer );
+   }
+}
+
+void PacketDecoder::reportError( pkt_error_t reason, size_t partialLength, uint64_t streamOffset )
+{
+   if ( this->m_errorCallback )
+   {
+      this->m_errorCallback( this->m_errorCtx, reason, partialLength, streamOffset );
+   }
+}
+
+size_t PacketDecoder::huntForStx( size_t idx, size_t length, const uint8_t* data )
+{
+   const void* stx = memchr( data + idx, STX, length - idx );
+   size_t stxIdx = ( nullptr == stx ) ? length : static_cast< const uint8_t* >( stx ) - data;
+   // ETX and data bytes are ignored while hunting, but a DLE still arms de-stuffing of the first
+   // byte of the next packet
+   if ( !this->m_deStuffNextByte && ( nullptr != memchr( data + idx, DLE, stxIdx - idx ) ) )
+   {
+      this->m_deStuffNextByte = true;
+   }
+   return stxIdx;
+}
+
+bool PacketDecoder::borrowsBuffer() const
+{
+   return ( nullptr != this->m_bufferPool ) || ( nullptr != this->m_arena );
+}
+
+bool PacketDecoder::acquireBuffer()
+{
+   if ( nullptr != this->m_arena )
+   {
+      this->m_packetBuffer = this->m_arena->reserve( this->m_arenaChunk );
+   }
+   else
+   {
+      this->m_packetBuffer = pkt_buffer_pool_acquire( this->m_bufferPool );
+   }
+   return nullptr != this->m_packetBuffer;
+}
+
+void PacketDecoder::releaseBuffer( size_t keepLength )
+{
+   if ( nullptr != this->m_arena )
+   {
+      // The packet stays where it is in case the callback retained it. If it didn't, the next
+      // reserve rewinds over it
+      this->m_arena->commit( this->m_arenaChunk, keepLength );
+   }
+   else
+   {
+      pkt_buffer_pool_release( this->m_bufferPool, this->m_packetBuffer );
+   }
+   this->m_packetBuffer = nullptr;
 }
 
 void PacketDecoder::clearBuffer()
 {
-   memset( this->m_packetBuffer, 0, MAX_DECODED_DATA_LENGTH );
+   // An owned buffer is kept zeroed past m_pktBufIdx, so only the last packet needs clearing. A
+   // borrowed one could hold anything
+   size_t used = this->borrowsBuffer() ? MAX_DECODED_DATA_LENGTH
+                                       : std::min< size_t >( this->m_pktBufIdx,
+                                                             MAX_DECODED_DATA_LENGTH );
+   memset( this->m_packetBuffer, 0, used );
    this->m_pktBufIdx = 0;
 }
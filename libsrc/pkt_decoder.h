@@ -3,6 +3,12 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <memory>
+#include "pkt_api.h"
+#include "pkt_arena.h"
+#include "pkt_buffer_pool.h"
+#include "pkt_checksum.h"
+#include "pkt_clock.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -20,12 +26,127 @@ extern "C"
    typedef struct PacketDecoder pkt_decoder_t;
    // data_length must be <= MAX_DECODED_DATA_LENGTH
    typedef void ( *pkt_read_fn_t )( void* ctx, size_t data_length, const uint8_t* data );
+
+   // Arrival times of a packet's STX and ETX, as passed to pkt_decoder_write_bytes_ts
+   typedef struct
+   {
+      uint64_t stx_time;
+      uint64_t etx_time;
+   } pkt_timestamps_t;
+   // Callback that also receives the packet's arrival times
+   typedef void ( *pkt_read_ts_fn_t )( void* ctx,
+                                       size_t data_length,
+                                       const uint8_t* data,
+                                       const pkt_timestamps_t* timestamps );
+// Pass as the timestamp to pkt_decoder_write_bytes_ts to have it read pkt_clock_now()
+#define PKT_TIMESTAMP_NOW ( UINT64_MAX )
+
+   // Early filter: return false to discard the packet. data holds its first data_length bytes
+   typedef bool ( *pkt_filter_fn_t )( void* ctx, size_t data_length, const uint8_t* data );
+
+   // Reasons a packet is dropped instead of being delivered
+   typedef enum
+   {
+      // The decoded packet grew past MAX_DECODED_DATA_LENGTH
+      PKT_ERROR_OVERFLOW = 1,
+      // An STX arrived while a packet was in progress
+      PKT_ERROR_ABORTED,
+      // An ETX arrived before any data was decoded
+      PKT_ERROR_EMPTY,
+      // The packet failed its trailer checksum
+      PKT_ERROR_CHECKSUM,
+      // An STX arrived but the decoder's buffer pool was empty
+      PKT_ERROR_NO_BUFFER
+   } pkt_error_t;
+   // partial_length is the number of bytes decoded when the packet was dropped. stream_offset is
+   // the position, counting every byte ever written to the decoder, of the byte that caused it
+   typedef void ( *pkt_error_fn_t )( void* ctx,
+                                     pkt_error_t reason,
+                                     size_t partial_length,
+                                     uint64_t stream_offset );
    // Constructor for a pkt_decoder
-   pkt_decoder_t* pkt_decoder_create( pkt_read_fn_t callback, void* callback_ctx );
+   PKT_API pkt_decoder_t* pkt_decoder_create( pkt_read_fn_t callback, void* callback_ctx );
+   // Constructor for a pkt_decoder that delivers packets with their arrival times
+   PKT_API pkt_decoder_t* pkt_decoder_create_ts( pkt_read_ts_fn_t callback, void* callback_ctx );
+   // Constructor for a pkt_decoder that borrows a packet buffer from pool at each STX and
+   // returns it when the packet is delivered or dropped. Packets that start while the pool is
+   // empty are dropped (PKT_ERROR_NO_BUFFER)
+   PKT_API pkt_decoder_t* pkt_decoder_create_pooled( pkt_read_fn_t callback,
+                                                     void* callback_ctx,
+                                                     pkt_buffer_pool_t* pool );
+   // Constructor for a pkt_decoder that writes packets into chunks of arena. The callback can
+   // keep a packet past its return with pkt_arena_retain instead of copying it. Packets that
+   // start when no chunk can be allocated are dropped (PKT_ERROR_NO_BUFFER)
+   PKT_API pkt_decoder_t* pkt_decoder_create_arena( pkt_read_fn_t callback,
+                                                    void* callback_ctx,
+                                                    pkt_arena_t* arena );
    // Destructor for a pkt_decoder
-   void pkt_decoder_destroy( pkt_decoder_t* decoder );
+   PKT_API void pkt_decoder_destroy( pkt_decoder_t* decoder );
    // Called on incoming, undecoded bytes to be translated into packets
-   void pkt_decoder_write_bytes( pkt_decoder_t* decoder, size_t len, const uint8_t* data );
+   PKT_API void pkt_decoder_write_bytes( pkt_decoder_t* decoder, size_t len, const uint8_t* data );
+   // As pkt_decoder_write_bytes, with every byte in data stamped as arriving at timestamp (in any
+   // unit the caller likes, or PKT_TIMESTAMP_NOW for a single pkt_clock_now() reading)
+   PKT_API void pkt_decoder_write_bytes_ts( pkt_decoder_t* decoder,
+                                            size_t len,
+                                            const uint8_t* data,
+                                            uint64_t timestamp );
+   // Require a trailer checksum on every packet. The trailer is stripped before the packet is
+   // passed to the read callback. Packets that fail the check are passed, trailer included, to
+   // error_callback (if not a nullptr) instead
+   PKT_API void pkt_decoder_set_checksum( pkt_decoder_t* decoder,
+                                          pkt_checksum_t type,
+                                          pkt_read_fn_t error_callback );
+   // Report every dropped packet to callback. Dropped packets are only checked for a registered
+   // callback when they occur, so decoders without one pay nothing extra
+   PKT_API void pkt_decoder_set_error_callback( pkt_decoder_t* decoder,
+                                                pkt_error_fn_t callback,
+                                                void* callback_ctx );
+
+   // Dispatch packets on the byte at offset in the decoded packet (its message type). The offset
+   // is 0 until set
+   PKT_API void pkt_decoder_set_route_offset( pkt_decoder_t* decoder, size_t offset );
+   // Deliver packets whose type byte is type to handler instead of the read callback. A nullptr
+   // handler sends them back to the read callback
+   PKT_API void pkt_decoder_set_route( pkt_decoder_t* decoder,
+                                       uint8_t type,
+                                       pkt_read_fn_t handler,
+                                       void* handler_ctx );
+   // Discard packets whose type byte is type as soon as it is decoded, without buffering the rest
+   // of the packet. Discarded packets aren't reported to the error callback
+   PKT_API void pkt_decoder_set_route_drop( pkt_decoder_t* decoder, uint8_t type, bool drop );
+
+   // Run filter on every packet once filter_length (at least 1) bytes of it have been decoded, or
+   // at its ETX if it is shorter. Rejected packets are skipped up to their ETX without being
+   // buffered, and aren't reported to the error callback. A nullptr filter removes it
+   PKT_API void pkt_decoder_set_filter( pkt_decoder_t* decoder,
+                                        size_t filter_length,
+                                        pkt_filter_fn_t filter,
+                                        void* filter_ctx );
+
+   // Handler table entry for one message type
+   struct PacketRoute
+   {
+      pkt_read_fn_t m_handler;
+      void* m_ctx;
+      bool m_drop;
+   };
+
+// Bytes of a write covered by the first block of control-byte bitmaps, and by the largest
+#define PKT_MIN_BITMAP_BLOCK ( 256 )
+#define PKT_MAX_BITMAP_BLOCK ( 4096 )
+
+   // Where the control bytes are in a block of one write, for decoding whole frames at once
+   struct PacketBitmaps
+   {
+      // The block is data[ m_start, m_start + m_length ) of the write. Blocks start small, so a
+      // lone frame among garbage costs little, and grow while frames keep coming
+      size_t m_start;
+      size_t m_length;
+      size_t m_nextLength;
+      uint64_t m_stx[ PKT_MAX_BITMAP_BLOCK / 64 ];
+      uint64_t m_etx[ PKT_MAX_BITMAP_BLOCK / 64 ];
+      uint64_t m_dle[ PKT_MAX_BITMAP_BLOCK / 64 ];
+   };
 
    class PacketDecoder
    {
@@ -33,13 +154,69 @@ extern "C"
       PacketDecoder( pkt_read_fn_t, void* );
       virtual ~PacketDecoder() = default;
       void clearBuffer();
+      void deliverPacket( uint64_t streamOffset );
+      void reportError( pkt_error_t reason, size_t partialLength, uint64_t streamOffset );
+      // Returns the index of the next STX in data[ idx, length ), or length if there isn't one
+      size_t huntForStx( size_t idx, size_t length, const uint8_t* data );
+      // Called when the packet reaches m_filterIdx bytes
+      void filterPacket();
+      void updateFilterIdx();
+      // Stops buffering the current packet and skips the rest of it
+      void dropPacket();
+      // Skips to the end of a dropped packet. Returns the index of the next STX in
+      // data[ idx, length ), or length if there isn't one
+      size_t skipPacket( size_t idx, size_t length, const uint8_t* data );
+      // Copies the run of data bytes (none of them STX, ETX or DLE) starting at data[ idx ] into
+      // the packet buffer, and returns the index of the first byte not copied
+      size_t copyPlainRun( size_t idx, size_t length, const uint8_t* data );
+      // Whether decodeFrames can be used: the decoder owns its buffer, and has no filter or route
+      // drops to check partway through a packet
+      bool decodesInBulk() const;
+      // Delivers the frame at the STX data[ idx ], and the frames after it, straight from the
+      // control-byte bitmaps of the write while they have no escapes and fit the buffer. Returns
+      // the index of the STX of the first frame that needs the byte loop, or length
+      size_t decodeFrames( size_t idx, size_t length, const uint8_t* data, PacketBitmaps& bitmaps );
+      // Pooled and arena decoders only hold a packet buffer while m_pktValid
+      bool borrowsBuffer() const;
+      bool acquireBuffer();
+      // Gives the packet buffer back. An arena decoder keeps the first keepLength bytes
+      void releaseBuffer( size_t keepLength );
 
       uint8_t* m_packetBuffer;
       size_t m_pktBufIdx;
+      // False while hunting for the STX that starts the next packet
       bool m_pktValid;
       pkt_read_fn_t m_readCallback;
       void* m_callbackCtx;
       bool m_deStuffNextByte;
+      pkt_checksum_t m_checksumType;
+      pkt_read_fn_t m_checksumErrorCallback;
+      pkt_error_fn_t m_errorCallback;
+      void* m_errorCtx;
+      // Number of bytes written to the decoder before the current write_bytes call
+      uint64_t m_streamOffset;
+      pkt_read_ts_fn_t m_readTsCallback;
+      // Arrival time of the bytes in the current write, and of the current packet's STX
+      uint64_t m_currentTime;
+      uint64_t m_stxTime;
+      // Source of m_packetBuffer for pooled decoders
+      pkt_buffer_pool_t* m_bufferPool;
+      // Source of m_packetBuffer for arena decoders, and the chunk currently being written
+      pkt_arena_t* m_arena;
+      PacketArenaChunk* m_arenaChunk;
+      // 256 entry handler table, only allocated once a route is set
+      std::unique_ptr< PacketRoute[] > m_routes;
+      size_t m_routeOffset;
+      pkt_filter_fn_t m_filter;
+      void* m_filterCtx;
+      size_t m_filterLength;
+      // Packet length at which route drops are checked (0 for never)
+      size_t m_routeDropIdx;
+      // Packet length at which filterPacket next runs (0 for never), and its value at STX
+      size_t m_filterIdx;
+      size_t m_firstFilterIdx;
+      // Set while skipping the rest of a dropped packet. m_pktValid is false meanwhile
+      bool m_dropPacket;
    };
 
 #ifdef __cplusplus
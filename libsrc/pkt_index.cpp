@@ -0,0 +1,305 @@
+#include "pkt_index.h"
+
+#include "pkt_simd.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace
+{
+   // Runs work( chunk, from, to ) over data[ 0, length ) cut into chunks of chunkLength bytes,
+   // one thread per chunk, the first on the calling thread
+   template < typename Work >
+   void runChunks( size_t length, size_t chunkLength, Work work )
+   {
+      size_t chunks = ( length + chunkLength - 1 ) / chunkLength;
+      if ( 0 == chunks )
+      {
+         return;
+      }
+      std::vector< std::thread > threads;
+      for ( size_t chunk = 1; chunk < chunks; ++chunk )
+      {
+         threads.emplace_back( work,
+                               chunk,
+                               chunk * chunkLength,
+                               std::min( length, ( chunk + 1 ) * chunkLength ) );
+      }
+      work( 0, 0, std::min( length, chunkLength ) );
+      for ( auto& thread : threads )
+      {
+         thread.join();
+      }
+   }
+} // namespace
+
+PacketIndex::PacketIndex( size_t length, const uint8_t* data )
+   : m_length( length ),
+     m_data( data ),
+     m_stx( new uint64_t[ ( length + 63 ) / 64 ] ),
+     m_etx( new uint64_t[ ( length + 63 ) / 64 ] ),
+     m_dle( new uint64_t[ ( length + 63 ) / 64 ] ),
+     m_stxCount( 0 ),
+     m_etxCount( 0 ),
+     m_dleCount( 0 ),
+     m_frameCount( 0 )
+{
+}
+
+pkt_index_t* pkt_index_create( size_t len, const uint8_t* data, size_t num_threads )
+{
+   auto* index = new PacketIndex( len, data );
+   if ( 0 == num_threads )
+   {
+      num_threads = std::max( 1U, std::thread::hardware_concurrency() );
+   }
+   // Chunks start on a bitmap word, so threads never share one
+   size_t chunkLength = std::max< size_t >( ( len + num_threads - 1 ) / num_threads,
+                                            PKT_INDEX_MIN_THREAD_BYTES );
+   chunkLength = ( chunkLength + 63 ) & ~size_t( 63 );
+   size_t chunks = ( len + chunkLength - 1 ) / chunkLength;
+
+   // Frames are counted once every bitmap is whole, since a frame can end in a later chunk
+   std::vector< size_t > counts( 4 * chunks );
+   runChunks( len, chunkLength, [ index, &counts ]( size_t chunk, size_t from, size_t to ) {
+      index->indexRange( from, to );
+      size_t* count = &counts[ 4 * chunk ];
+      for ( size_t word = from / 64; word < ( to + 63 ) / 64; ++word )
+      {
+         count[ 0 ] += __builtin_popcountll( index->m_stx[ word ] );
+         count[ 1 ] += __builtin_popcountll( index->m_etx[ word ] );
+         count[ 2 ] += __builtin_popcountll( index->m_dle[ word ] );
+      }
+   } );
+   runChunks( len, chunkLength, [ index, &counts ]( size_t chunk, size_t from, size_t to ) {
+      counts[ 4 * chunk + 3 ] = index->countFrames( from, to );
+   } );
+   for ( size_t chunk = 0; chunk < chunks; ++chunk )
+   {
+      index->m_stxCount += counts[ 4 * chunk ];
+      index->m_etxCount += counts[ 4 * chunk + 1 ];
+      index->m_dleCount += counts[ 4 * chunk + 2 ];
+      index->m_frameCount += counts[ 4 * chunk + 3 ];
+   }
+   return index;
+}
+
+void pkt_index_destroy( pkt_index_t* index )
+{
+   delete index;
+}
+
+const uint64_t* pkt_index_bitmap( const pkt_index_t* index, uint8_t control )
+{
+   return index->bitmap( control );
+}
+
+size_t pkt_index_count( const pkt_index_t* index, uint8_t control )
+{
+   switch ( control )
+   {
+      case STX: {
+         return index->m_stxCount;
+      }
+      case ETX: {
+         return index->m_etxCount;
+      }
+      case DLE: {
+         return index->m_dleCount;
+      }
+   }
+   return 0;
+}
+
+size_t pkt_index_positions( const pkt_index_t* index,
+                            uint8_t control,
+                            size_t from,
+                            size_t max_positions,
+                            size_t* positions )
+{
+   if ( nullptr == index->bitmap( control ) )
+   {
+      return 0;
+   }
+   size_t count = 0;
+   for ( size_t position = index->next( control, from, index->m_length );
+         ( position < index->m_length ) && ( count < max_positions );
+         position = index->next( control, position + 1, index->m_length ) )
+   {
+      positions[ count++ ] = position;
+   }
+   return count;
+}
+
+size_t pkt_index_frames( const pkt_index_t* index,
+                         size_t from,
+                         size_t max_frames,
+                         pkt_index_frame_t* frames )
+{
+   size_t count = 0;
+   for ( size_t start = index->next( STX, from, index->m_length );
+         ( start < index->m_length ) && ( count < max_frames ); )
+   {
+      size_t next = index->frameAt( start, frames[ count ] );
+      if ( frames[ count ].end < index->m_length )
+      {
+         ++count;
+      }
+      start = next;
+   }
+   return count;
+}
+
+size_t pkt_index_count_frames( const pkt_index_t* index )
+{
+   return index->m_frameCount;
+}
+
+size_t pkt_index_split( const pkt_index_t* index, size_t parts, size_t* offsets )
+{
+   if ( 0 == parts )
+   {
+      return 0;
+   }
+   size_t pieces = 1;
+   offsets[ 0 ] = 0;
+   size_t start = 0;
+   for ( size_t part = 1; part < parts; ++part )
+   {
+      // Cut after the first suitable frame starting at or after an even share of the buffer
+      size_t share = index->m_length * part / parts;
+      start = index->next( STX, std::max( start, share ), index->m_length );
+      while ( start < index->m_length )
+      {
+         pkt_index_frame_t frame;
+         size_t next = index->frameAt( start, frame );
+         // A DLE before the ETX would still de-stuff the first byte of the next frame
+         if ( ( frame.end < index->m_length ) && frame.valid
+              && ( DLE != index->m_data[ frame.end - 1 ] ) )
+         {
+            if ( frame.end + 1 < index->m_length )
+            {
+               offsets[ pieces++ ] = frame.end + 1;
+            }
+            start = next;
+            break;
+         }
+         start = next;
+      }
+      if ( start >= index->m_length )
+      {
+         break;
+      }
+   }
+   return pieces;
+}
+
+const uint64_t* PacketIndex::bitmap( uint8_t control ) const
+{
+   switch ( control )
+   {
+      case STX: {
+         return this->m_stx.get();
+      }
+      case ETX: {
+         return this->m_etx.get();
+      }
+      case DLE: {
+         return this->m_dle.get();
+      }
+   }
+   return nullptr;
+}
+
+size_t PacketIndex::next( uint8_t control, size_t from, size_t limit ) const
+{
+   if ( from >= limit )
+   {
+      return limit;
+   }
+   const uint64_t* bits = this->bitmap( control );
+   size_t word = from / 64;
+   uint64_t remaining = bits[ word ] & ( ~0ULL << ( from % 64 ) );
+   const size_t words = ( limit + 63 ) / 64;
+   while ( 0 == remaining )
+   {
+      if ( ++word == words )
+      {
+         return limit;
+      }
+      remaining = bits[ word ];
+   }
+   return std::min< size_t >( word * 64 + __builtin_ctzll( remaining ), limit );
+}
+
+size_t PacketIndex::countDle( size_t from, size_t to ) const
+{
+   size_t count = 0;
+   while ( from < to )
+   {
+      // The bits of data[ from, to ) in from's word
+      size_t bits = std::min< size_t >( 64 - from % 64, to - from );
+      uint64_t mask = ( ( bits < 64 ) ? ( ( 1ULL << bits ) - 1 ) : ~0ULL ) << ( from % 64 );
+      count += __builtin_popcountll( this->m_dle[ from / 64 ] & mask );
+      from += bits;
+   }
+   return count;
+}
+
+size_t PacketIndex::frameAt( size_t start, pkt_index_frame_t& frame ) const
+{
+   size_t next = this->next( STX, start + 1, this->m_length );
+   size_t end = this->next( ETX, start + 1, next );
+   frame.start = start;
+   frame.end = end;
+   frame.valid = false;
+   if ( end == this->m_length )
+   {
+      return this->m_length;
+   }
+   frame.data_length = end - start - 1 - this->countDle( start + 1, end );
+   if ( frame.data_length > MAX_DECODED_DATA_LENGTH )
+   {
+      // Once it overflows the decoder hunts for the next STX, so it is never aborted
+      frame.error = PKT_ERROR_OVERFLOW;
+   }
+   else if ( end == next )
+   {
+      frame.error = PKT_ERROR_ABORTED;
+   }
+   else if ( 0 == frame.data_length )
+   {
+      frame.error = PKT_ERROR_EMPTY;
+   }
+   else
+   {
+      frame.valid = true;
+   }
+   return next;
+}
+
+void PacketIndex::indexRange( size_t from, size_t to )
+{
+   pktControlBitmaps( to - from,
+                      this->m_data + from,
+                      &this->m_stx[ from / 64 ],
+                      &this->m_etx[ from / 64 ],
+                      &this->m_dle[ from / 64 ] );
+}
+
+size_t PacketIndex::countFrames( size_t from, size_t to ) const
+{
+   size_t count = 0;
+   for ( size_t start = this->next( STX, from, to ); start < to; )
+   {
+      pkt_index_frame_t frame;
+      size_t next = this->frameAt( start, frame );
+      if ( frame.valid )
+      {
+         ++count;
+      }
+      start = std::min( next, to );
+   }
+   return count;
+}
@@ -0,0 +1,104 @@
+#ifndef PKT_INDEX_H_INCLUDED
+#define PKT_INDEX_H_INCLUDED
+
+#include "pkt_decoder.h"
+
+#include <memory>
+
+// Index of the control bytes of a raw DLE-framed buffer: where every STX, ETX and DLE is, found
+// with the SIMD kernels (and for a big buffer several threads) without running a decoder. From
+// it frames can be counted and listed, with the reason a decoder would drop any that are
+// malformed, and the buffer can be cut into pieces that decode independently.
+//
+// "A decoder" here is one that owns its packet buffer and checks no trailer checksum; the index
+// knows nothing of either.
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+// Bytes each thread indexes at least, below which extra threads cost more than they save
+#define PKT_INDEX_MIN_THREAD_BYTES ( 1024 * 1024 )
+
+   class PacketIndex;
+
+   typedef struct PacketIndex pkt_index_t;
+
+   // A frame: an STX, and the ETX (or the STX aborting it) that ends it
+   typedef struct
+   {
+      // Offsets of the STX and of the byte that ends the frame
+      size_t start;
+      size_t end;
+      // Data bytes between them, not counting DLEs
+      size_t data_length;
+      // Whether a decoder would deliver the frame, and if not why it would drop it:
+      // PKT_ERROR_OVERFLOW, PKT_ERROR_ABORTED or PKT_ERROR_EMPTY
+      bool valid;
+      pkt_error_t error;
+   } pkt_index_frame_t;
+
+   // Indexes data with up to num_threads threads (0 for one per CPU). data must outlive the index
+   PKT_API pkt_index_t* pkt_index_create( size_t len, const uint8_t* data, size_t num_threads );
+   PKT_API void pkt_index_destroy( pkt_index_t* index );
+   // Where control (STX, ETX or DLE) is: bit ( idx % 64 ) of word ( idx / 64 ) is set if
+   // data[ idx ] is control. Holds ( len + 63 ) / 64 words. A nullptr for any other byte
+   PKT_API const uint64_t* pkt_index_bitmap( const pkt_index_t* index, uint8_t control );
+   // How many times control appears in the buffer
+   PKT_API size_t pkt_index_count( const pkt_index_t* index, uint8_t control );
+   // Writes the offsets of up to max_positions appearances of control at or after from to
+   // positions, in order, and returns how many it wrote
+   PKT_API size_t pkt_index_positions( const pkt_index_t* index,
+                                       uint8_t control,
+                                       size_t from,
+                                       size_t max_positions,
+                                       size_t* positions );
+   // Writes up to max_frames of the frames starting at or after from to frames, in order, and
+   // returns how many it wrote. A frame still open at the end of the buffer isn't listed
+   PKT_API size_t pkt_index_frames( const pkt_index_t* index,
+                                    size_t from,
+                                    size_t max_frames,
+                                    pkt_index_frame_t* frames );
+   // How many frames a decoder would deliver from the buffer
+   PKT_API size_t pkt_index_count_frames( const pkt_index_t* index );
+   // Cuts the buffer into up to parts pieces of roughly equal length, each cut just after the
+   // ETX of a frame a decoder would deliver and with no DLE pending, so that a new decoder fed
+   // each piece delivers just the frames one decoder fed the whole buffer would. Writes the
+   // offsets the pieces start at to offsets (the first is 0) and returns how many there are,
+   // which is fewer than parts if the buffer has too few places to cut
+   PKT_API size_t pkt_index_split( const pkt_index_t* index, size_t parts, size_t* offsets );
+
+   class PacketIndex
+   {
+    public:
+      PacketIndex( size_t, const uint8_t* );
+      virtual ~PacketIndex() = default;
+      // Bitmap of control, or a nullptr
+      const uint64_t* bitmap( uint8_t control ) const;
+      // Offset of the first control at or after from, or limit if there isn't one before it
+      size_t next( uint8_t control, size_t from, size_t limit ) const;
+      // Appearances of DLE in data[ from, to )
+      size_t countDle( size_t from, size_t to ) const;
+      // Fills frame with the frame at the STX data[ start ] (its end is m_length, and it isn't
+      // valid, if it runs off the end), and returns the offset of the next STX or m_length
+      size_t frameAt( size_t start, pkt_index_frame_t& frame ) const;
+      // Indexes data[ from, to ), from a multiple of 64
+      void indexRange( size_t from, size_t to );
+      // Counts the frames a decoder would deliver whose STX lies in data[ from, to )
+      size_t countFrames( size_t from, size_t to ) const;
+
+      size_t m_length;
+      const uint8_t* m_data;
+      // Left uninitialized, so each thread is the first to touch (and page in) its own chunk
+      std::unique_ptr< uint64_t[] > m_stx;
+      std::unique_ptr< uint64_t[] > m_etx;
+      std::unique_ptr< uint64_t[] > m_dle;
+      size_t m_stxCount;
+      size_t m_etxCount;
+      size_t m_dleCount;
+      size_t m_frameCount;
+   };
+
+#ifdef __cplusplus
+}
+#endif
+#endif // PKT_INDEX_H_INCLUDED
@@ -0,0 +1,383 @@
+#include "pkt_log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+   const char HEADER_MAGIC[] = "PKTLOG01";
+   const char FOOTER_MAGIC[] = "PKTIDX01";
+   const size_t MAGIC_LENGTH( 8 );
+   const uint32_t VERSION( 1 );
+   const size_t HEADER_LENGTH( MAGIC_LENGTH + 4 + 4 );
+   const size_t RECORD_HEADER_LENGTH( 4 + 8 );
+   const size_t INDEX_ENTRY_LENGTH( 8 + 8 + 8 + 4 + 4 );
+   const size_t FOOTER_LENGTH( 8 + 8 + 8 + MAGIC_LENGTH );
+
+   void put32( uint8_t* out, uint32_t value )
+   {
+      for ( size_t idx = 0; idx < 4; ++idx )
+      {
+         out[ idx ] = static_cast< uint8_t >( value >> ( 8 * idx ) );
+      }
+   }
+
+   void put64( uint8_t* out, uint64_t value )
+   {
+      for ( size_t idx = 0; idx < 8; ++idx )
+      {
+         out[ idx ] = static_cast< uint8_t >( value >> ( 8 * idx ) );
+      }
+   }
+
+   uint32_t get32( const uint8_t* in )
+   {
+      uint32_t value = 0;
+      for ( size_t idx = 0; idx < 4; ++idx )
+      {
+         value |= static_cast< uint32_t >( in[ idx ] ) << ( 8 * idx );
+      }
+      return value;
+   }
+
+   uint64_t get64( const uint8_t* in )
+   {
+      uint64_t value = 0;
+      for ( size_t idx = 0; idx < 8; ++idx )
+      {
+         value |= static_cast< uint64_t >( in[ idx ] ) << ( 8 * idx );
+      }
+      return value;
+   }
+
+   bool writeAll( PacketLogWriter* writer, const void* data, size_t length )
+   {
+      if ( !writer->m_failed && ( fwrite( data, 1, length, writer->m_file ) != length ) )
+      {
+         writer->m_failed = true;
+      }
+      writer->m_offset += length;
+      return !writer->m_failed;
+   }
+
+   // Reads the index and footer at the end of the mapping. Returns false if they're missing or
+   // inconsistent
+   bool readIndex( PacketLogReader* reader )
+   {
+      const uint8_t* map = reader->m_map;
+      size_t length = reader->m_mapLength;
+      if ( ( length < HEADER_LENGTH + FOOTER_LENGTH )
+           || ( 0 != memcmp( map + length - MAGIC_LENGTH, FOOTER_MAGIC, MAGIC_LENGTH ) ) )
+      {
+         return false;
+      }
+      const uint8_t* footer = map + length - FOOTER_LENGTH;
+      uint64_t indexOffset = get64( footer );
+      uint64_t blockCount = get64( footer + 8 );
+      if ( ( indexOffset < HEADER_LENGTH ) || ( indexOffset > length - FOOTER_LENGTH )
+           || ( blockCount != ( length - FOOTER_LENGTH - indexOffset ) / INDEX_ENTRY_LENGTH ) )
+      {
+         return false;
+      }
+      reader->m_dataEnd = indexOffset;
+      reader->m_packetCount = get64( footer + 16 );
+      reader->m_index.resize( blockCount );
+      // Every block must start inside the data, after the one before it, and number its packets
+      // on from where that one left off
+      uint64_t minOffset = HEADER_LENGTH;
+      uint64_t sequence = 0;
+      for ( uint64_t block = 0; block < blockCount; ++block )
+      {
+         const uint8_t* entry = map + indexOffset + block * INDEX_ENTRY_LENGTH;
+         PacketLogBlock& indexed = reader->m_index[ block ];
+         indexed.m_offset = get64( entry );
+         indexed.m_firstSequence = get64( entry + 8 );
+         indexed.m_firstTimestamp = get64( entry + 16 );
+         indexed.m_count = get32( entry + 24 );
+         if ( ( indexed.m_offset < minOffset ) || ( indexed.m_offset >= indexOffset )
+              || ( indexed.m_firstSequence != sequence ) || ( 0 == indexed.m_count ) )
+         {
+            return false;
+         }
+         minOffset = indexed.m_offset + RECORD_HEADER_LENGTH;
+         sequence += indexed.m_count;
+      }
+      return sequence == reader->m_packetCount;
+   }
+
+   // Offset just past the record at offset, or 0 if it doesn't lie wholly before the index
+   uint64_t recordEnd( const PacketLogReader* reader, uint64_t offset )
+   {
+      if ( ( offset >= reader->m_dataEnd )
+           || ( reader->m_dataEnd - offset < RECORD_HEADER_LENGTH ) )
+      {
+         return 0;
+      }
+      uint64_t length = get32( reader->m_map + offset );
+      if ( reader->m_dataEnd - offset - RECORD_HEADER_LENGTH < length )
+      {
+         return 0;
+      }
+      return offset + RECORD_HEADER_LENGTH + length;
+   }
+
+   // Rebuilds the index of a log that was never closed (or whose index is corrupt), stopping at
+   // the first incomplete record, or at the index if the footer said where that starts
+   void scanIndex( PacketLogReader* reader, uint64_t blockSize )
+   {
+      uint64_t dataEnd = ( 0 != reader->m_dataEnd ) ? reader->m_dataEnd : reader->m_mapLength;
+      uint64_t offset = HEADER_LENGTH;
+      uint64_t blockEnd = offset;
+      uint64_t sequence = 0;
+      while ( offset + RECORD_HEADER_LENGTH <= dataEnd )
+      {
+         uint64_t recordEnd = offset + RECORD_HEADER_LENGTH + get32( reader->m_map + offset );
+         if ( recordEnd > dataEnd )
+         {
+            break;
+         }
+         if ( offset >= blockEnd )
+         {
+            PacketLogBlock block = { offset, sequence, get64( reader->m_map + offset + 4 ), 0 };
+            reader->m_index.push_back( block );
+            blockEnd = offset + blockSize;
+         }
+         reader->m_index.back().m_count++;
+         ++sequence;
+         offset = recordEnd;
+      }
+      reader->m_dataEnd = offset;
+      reader->m_packetCount = sequence;
+   }
+} // namespace
+
+PacketLogWriter::PacketLogWriter( FILE* file, size_t blockSize )
+   : m_file( file ),
+     m_blockSize( blockSize ),
+     m_offset( 0 ),
+     m_blockEnd( 0 ),
+     m_packetCount( 0 ),
+     m_failed( false )
+{
+}
+
+PacketLogReader::PacketLogReader( const uint8_t* map, size_t mapLength )
+   : m_map( map ),
+     m_mapLength( mapLength ),
+     m_dataEnd( 0 ),
+     m_packetCount( 0 ),
+     m_offset( 0 ),
+     m_sequence( 0 )
+{
+}
+
+pkt_log_writer_t* pkt_log_writer_open( const char* path, size_t block_size )
+{
+   FILE* file = fopen( path, "wb" );
+   if ( nullptr == file )
+   {
+      return nullptr;
+   }
+   auto* writer = new PacketLogWriter( file, block_size );
+   uint8_t header[ HEADER_LENGTH ];
+   memcpy( header, HEADER_MAGIC, MAGIC_LENGTH );
+   put32( header + MAGIC_LENGTH, VERSION );
+   put32( header + MAGIC_LENGTH + 4, static_cast< uint32_t >( block_size ) );
+   writeAll( writer, header, sizeof( header ) );
+   return writer;
+}
+
+bool pkt_log_writer_append( pkt_log_writer_t* writer,
+                            uint64_t timestamp,
+                            size_t data_length,
+                            const uint8_t* data )
+{
+   if ( writer->m_offset >= writer->m_blockEnd )
+   {
+      PacketLogBlock block = { writer->m_offset, writer->m_packetCount, timestamp, 0 };
+      writer->m_index.push_back( block );
+      writer->m_blockEnd = writer->m_offset + writer->m_blockSize;
+   }
+   writer->m_index.back().m_count++;
+   writer->m_packetCount++;
+
+   uint8_t recordHeader[ RECORD_HEADER_LENGTH ];
+   put32( recordHeader, static_cast< uint32_t >( data_length ) );
+   put64( recordHeader + 4, timestamp );
+   return writeAll( writer, recordHeader, sizeof( recordHeader ) )
+          && writeAll( writer, data, data_length );
+}
+
+bool pkt_log_writer_close( pkt_log_writer_t* writer )
+{
+   uint64_t indexOffset = writer->m_offset;
+   for ( const PacketLogBlock& block : writer->m_index )
+   {
+      uint8_t entry[ INDEX_ENTRY_LENGTH ] = {};
+      put64( entry, block.m_offset );
+      put64( entry + 8, block.m_firstSequence );
+      put64( entry + 16, block.m_firstTimestamp );
+      put32( entry + 24, block.m_count );
+      writeAll( writer, entry, sizeof( entry ) );
+   }
+   uint8_t footer[ FOOTER_LENGTH ];
+   put64( footer, indexOffset );
+   put64( footer + 8, writer->m_index.size() );
+   put64( footer + 16, writer->m_packetCount );
+   memcpy( footer + 24, FOOTER_MAGIC, MAGIC_LENGTH );
+   writeAll( writer, footer, sizeof( footer ) );
+
+   bool ok = ( 0 == fclose( writer->m_file ) ) && !writer->m_failed;
+   delete writer;
+   return ok;
+}
+
+void pkt_log_write_packet( void* writer, size_t data_length, const uint8_t* data )
+{
+   pkt_log_writer_append( static_cast< pkt_log_writer_t* >( writer ), 0, data_length, data );
+}
+
+void pkt_log_write_packet_ts( void* writer,
+                              size_t data_length,
+                              const uint8_t* data,
+                              const pkt_timestamps_t* timestamps )
+{
+   pkt_log_writer_append(
+      static_cast< pkt_log_writer_t* >( writer ), timestamps->etx_time, data_length, data );
+}
+
+pkt_log_reader_t* pkt_log_reader_open( const char* path )
+{
+   int fd = open( path, O_RDONLY );
+   if ( fd < 0 )
+   {
+      return nullptr;
+   }
+   struct stat info;
+   void* map = MAP_FAILED;
+   if ( ( 0 == fstat( fd, &info ) ) && ( static_cast< size_t >( info.st_size ) >= HEADER_LENGTH ) )
+   {
+      map = mmap( nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+   }
+   close( fd );
+   if ( MAP_FAILED == map )
+   {
+      return nullptr;
+   }
+
+   auto* reader = new PacketLogReader( static_cast< const uint8_t* >( map ), info.st_size );
+   if ( ( 0 != memcmp( reader->m_map, HEADER_MAGIC, MAGIC_LENGTH ) )
+        || ( VERSION != get32( reader->m_map + MAGIC_LENGTH ) ) )
+   {
+      pkt_log_reader_close( reader );
+      return nullptr;
+   }
+   if ( !readIndex( reader ) )
+   {
+      reader->m_index.clear();
+      scanIndex( reader, get32( reader->m_map + MAGIC_LENGTH + 4 ) );
+   }
+   reader->m_offset = HEADER_LENGTH;
+   return reader;
+}
+
+void pkt_log_reader_close( pkt_log_reader_t* reader )
+{
+   munmap( const_cast< uint8_t* >( reader->m_map ), reader->m_mapLength );
+   delete reader;
+}
+
+uint64_t pkt_log_reader_count( const pkt_log_reader_t* reader )
+{
+   return reader->m_packetCount;
+}
+
+bool pkt_log_reader_seek( pkt_log_reader_t* reader, uint64_t sequence )
+{
+   if ( sequence >= reader->m_packetCount )
+   {
+      return false;
+   }
+   // The last block that starts at or before the packet
+   auto block = std::upper_bound( reader->m_index.begin(),
+                                  reader->m_index.end(),
+                                  sequence,
+                                  []( uint64_t seq, const PacketLogBlock& entry ) {
+                                     return seq < entry.m_firstSequence;
+                                  } );
+   if ( ( reader->m_index.begin() == block )
+        || !reader->seekBlock( block - reader->m_index.begin() - 1 ) )
+   {
+      return false;
+   }
+   while ( reader->m_sequence < sequence )
+   {
+      uint64_t next = recordEnd( reader, reader->m_offset );
+      if ( 0 == next )
+      {
+         return false;
+      }
+      reader->m_offset = next;
+      reader->m_sequence++;
+   }
+   return true;
+}
+
+bool pkt_log_reader_seek_time( pkt_log_reader_t* reader, uint64_t timestamp )
+{
+   // The first block that starts at or after timestamp. The block before it may still end with
+   // packets stamped at or after timestamp, so the scan starts there
+   auto block = std::lower_bound( reader->m_index.begin(),
+                                  reader->m_index.end(),
+                                  timestamp,
+                                  []( const PacketLogBlock& entry, uint64_t time ) {
+                                     return entry.m_firstTimestamp < time;
+                                  } );
+   size_t start = block - reader->m_index.begin();
+   if ( !reader->seekBlock( ( start > 0 ) ? start - 1 : 0 ) )
+   {
+      return false;
+   }
+   for ( uint64_t next = recordEnd( reader, reader->m_offset ); 0 != next;
+         next = recordEnd( reader, reader->m_offset ) )
+   {
+      if ( get64( reader->m_map + reader->m_offset + 4 ) >= timestamp )
+      {
+         return true;
+      }
+      reader->m_offset = next;
+      reader->m_sequence++;
+   }
+   return false;
+}
+
+bool pkt_log_reader_next( pkt_log_reader_t* reader, pkt_log_record_t* record )
+{
+   uint64_t next = recordEnd( reader, reader->m_offset );
+   if ( 0 == next )
+   {
+      return false;
+   }
+   const uint8_t* recordHeader = reader->m_map + reader->m_offset;
+   record->sequence = reader->m_sequence++;
+   record->data_length = get32( recordHeader );
+   record->timestamp = get64( recordHeader + 4 );
+   record->data = recordHeader + RECORD_HEADER_LENGTH;
+   reader->m_offset = next;
+   return true;
+}
+
+bool PacketLogReader::seekBlock( size_t block )
+{
+   if ( block >= this->m_index.size() )
+   {
+      return false;
+   }
+   this->m_offset = this->m_index[ block ].m_offset;
+   this->m_sequence = this->m_index[ block ].m_firstSequence;
+   return true;
+}
@@ -0,0 +1,120 @@
+#ifndef PKT_LOG_H_INCLUDED
+#define PKT_LOG_H_INCLUDED
+
+#include "pkt_decoder.h"
+
+#include <cstdio>
+#include <vector>
+
+// On-disk packet log. All integers are little-endian.
+//
+//   header   "PKTLOG01" | u32 version | u32 block size
+//   blocks   records, each u32 length | u64 timestamp | length bytes of packet data. A block is
+//            closed once it holds at least block size bytes; records never span blocks
+//   index    one entry per block: u64 file offset | u64 first sequence number | u64 first
+//            timestamp | u32 record count | u32 reserved
+//   footer   u64 index offset | u64 block count | u64 packet count | "PKTIDX01"
+//
+// Sequence numbers count packets from 0. Seeking by time assumes timestamps never decrease.
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#define PKT_LOG_DEFAULT_BLOCK_SIZE ( 64 * 1024 )
+
+   class PacketLogWriter;
+   class PacketLogReader;
+
+   typedef struct PacketLogWriter pkt_log_writer_t;
+   typedef struct PacketLogReader pkt_log_reader_t;
+
+   // A packet read back from a log. data points into the reader's mapping of the file, and is
+   // valid until the reader is closed
+   typedef struct
+   {
+      uint64_t sequence;
+      uint64_t timestamp;
+      size_t data_length;
+      const uint8_t* data;
+   } pkt_log_record_t;
+
+   // Creates (or truncates) a log file. Returns a nullptr if the file can't be opened
+   PKT_API pkt_log_writer_t* pkt_log_writer_open( const char* path, size_t block_size );
+   // Appends one packet. Returns false on a write error
+   PKT_API bool pkt_log_writer_append( pkt_log_writer_t* writer,
+                                       uint64_t timestamp,
+                                       size_t data_length,
+                                       const uint8_t* data );
+   // Writes the index and footer and closes the file. Returns false on a write error
+   PKT_API bool pkt_log_writer_close( pkt_log_writer_t* writer );
+   // pkt_read_fn_t adapter, for logging straight from a decoder (ctx is the writer). Packets are
+   // logged with a timestamp of 0
+   PKT_API void pkt_log_write_packet( void* writer, size_t data_length, const uint8_t* data );
+   // pkt_read_ts_fn_t adapter (ctx is the writer). Packets are logged with their ETX time
+   PKT_API void pkt_log_write_packet_ts( void* writer,
+                                         size_t data_length,
+                                         const uint8_t* data,
+                                         const pkt_timestamps_t* timestamps );
+
+   // Maps a log file for reading, positioned at the first packet. If the log was never closed
+   // the index is rebuilt with one pass over the records. Returns a nullptr if the file can't be
+   // read or isn't a packet log
+   PKT_API pkt_log_reader_t* pkt_log_reader_open( const char* path );
+   PKT_API void pkt_log_reader_close( pkt_log_reader_t* reader );
+   // Number of packets in the log
+   PKT_API uint64_t pkt_log_reader_count( const pkt_log_reader_t* reader );
+   // Positions the reader at packet number sequence. Returns false if there is no such packet
+   PKT_API bool pkt_log_reader_seek( pkt_log_reader_t* reader, uint64_t sequence );
+   // Positions the reader at the first packet stamped at or after timestamp. Returns false if
+   // there is no such packet
+   PKT_API bool pkt_log_reader_seek_time( pkt_log_reader_t* reader, uint64_t timestamp );
+   // Reads the packet at the current position and advances. Returns false at the end of the log
+   PKT_API bool pkt_log_reader_next( pkt_log_reader_t* reader, pkt_log_record_t* record );
+
+   // One index entry per block
+   struct PacketLogBlock
+   {
+      uint64_t m_offset;
+      uint64_t m_firstSequence;
+      uint64_t m_firstTimestamp;
+      uint32_t m_count;
+   };
+
+   class PacketLogWriter
+   {
+    public:
+      PacketLogWriter( FILE*, size_t );
+      virtual ~PacketLogWriter() = default;
+
+      FILE* m_file;
+      size_t m_blockSize;
+      // File offset of the next record, and of the end of the current block
+      uint64_t m_offset;
+      uint64_t m_blockEnd;
+      uint64_t m_packetCount;
+      bool m_failed;
+      std::vector< PacketLogBlock > m_index;
+   };
+
+   class PacketLogReader
+   {
+    public:
+      PacketLogReader( const uint8_t*, size_t );
+      virtual ~PacketLogReader() = default;
+      bool seekBlock( size_t block );
+
+      const uint8_t* m_map;
+      size_t m_mapLength;
+      // End of the record area (the start of the index)
+      uint64_t m_dataEnd;
+      uint64_t m_packetCount;
+      std::vector< PacketLogBlock > m_index;
+      // Position of the next record to read
+      uint64_t m_offset;
+      uint64_t m_sequence;
+   };
+
+#ifdef __cplusplus
+}
+#endif
+#endif // PKT_LOG_H_INCLUDED
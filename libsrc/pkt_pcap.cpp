@@ -0,0 +1,704 @@
+#include "pkt_pcap.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+   const size_t PCAP_HEADER_LENGTH( 24 );
+   const size_t PCAP_RECORD_HEADER_LENGTH( 16 );
+   const uint32_t PCAP_MAGIC_MICROSECONDS( 0xA1B2C3D4 );
+   const uint32_t PCAP_MAGIC_NANOSECONDS( 0xA1B23C4D );
+
+   const uint32_t PCAPNG_SECTION_HEADER( 0x0A0D0D0A );
+   const uint32_t PCAPNG_INTERFACE_DESCRIPTION( 1 );
+   const uint32_t PCAPNG_SIMPLE_PACKET( 3 );
+   const uint32_t PCAPNG_ENHANCED_PACKET( 6 );
+   const uint32_t PCAPNG_BYTE_ORDER_MAGIC( 0x1A2B3C4D );
+   const uint16_t PCAPNG_OPTION_END( 0 );
+   const uint16_t PCAPNG_OPTION_TSRESOL( 9 );
+
+   const uint32_t LINKTYPE_NULL( 0 );
+   const uint32_t LINKTYPE_ETHERNET( 1 );
+   const uint32_t LINKTYPE_RAW( 101 );
+   const uint32_t LINKTYPE_LINUX_SLL( 113 );
+   const uint32_t LINKTYPE_IPV4( 228 );
+   const uint32_t LINKTYPE_IPV6( 229 );
+   const uint32_t LINKTYPE_LINUX_SLL2( 276 );
+
+   const uint16_t ETHERTYPE_IPV4( 0x0800 );
+   const uint16_t ETHERTYPE_IPV6( 0x86DD );
+   const uint16_t ETHERTYPE_VLAN( 0x8100 );
+   const uint16_t ETHERTYPE_QINQ( 0x88A8 );
+
+   const uint8_t IPPROTO_HOP_BY_HOP( 0 );
+   const uint8_t IPPROTO_TCP_( 6 );
+   const uint8_t IPPROTO_UDP_( 17 );
+   const uint8_t IPPROTO_ROUTING( 43 );
+   const uint8_t IPPROTO_FRAGMENT( 44 );
+   const uint8_t IPPROTO_AUTH( 51 );
+   const uint8_t IPPROTO_DEST_OPTS( 60 );
+
+   const uint8_t TCP_FIN( 0x01 );
+   const uint8_t TCP_SYN( 0x02 );
+   const uint8_t TCP_RST( 0x04 );
+
+   // Capture files are in the byte order of the machine that wrote them
+   uint16_t get16( const uint8_t* in, bool swapped )
+   {
+      uint16_t value;
+      memcpy( &value, in, sizeof( value ) );
+      return swapped ? __builtin_bswap16( value ) : value;
+   }
+
+   uint32_t get32( const uint8_t* in, bool swapped )
+   {
+      uint32_t value;
+      memcpy( &value, in, sizeof( value ) );
+      return swapped ? __builtin_bswap32( value ) : value;
+   }
+
+   // Protocol headers are big-endian
+   uint16_t getBe16( const uint8_t* in )
+   {
+      return static_cast< uint16_t >( ( in[ 0 ] << 8 ) | in[ 1 ] );
+   }
+
+   uint32_t getBe32( const uint8_t* in )
+   {
+      return ( static_cast< uint32_t >( in[ 0 ] ) << 24 )
+             | ( static_cast< uint32_t >( in[ 1 ] ) << 16 )
+             | ( static_cast< uint32_t >( in[ 2 ] ) << 8 ) | in[ 3 ];
+   }
+
+   // A pcapng interface: its link type, and its timestamp unit as 10^-exponent or 2^-exponent
+   // seconds
+   struct PcapInterface
+   {
+      uint32_t m_linkType;
+      bool m_binary;
+      uint8_t m_exponent;
+   };
+
+   uint64_t toNanoseconds( uint64_t ticks, const PcapInterface& interface )
+   {
+      if ( interface.m_binary )
+      {
+         if ( interface.m_exponent >= 64 )
+         {
+            return 0;
+         }
+         uint64_t fraction = ticks & ( ( uint64_t( 1 ) << interface.m_exponent ) - 1 );
+         // A fraction of more than 34 bits would overflow when scaled, and its extra bits are
+         // finer than a nanosecond
+         uint8_t exponent = interface.m_exponent;
+         if ( exponent > 34 )
+         {
+            fraction >>= exponent - 34;
+            exponent = 34;
+         }
+         return ( ticks >> interface.m_exponent ) * 1000000000
+                + ( ( fraction * 1000000000 ) >> exponent );
+      }
+      uint64_t scale = 1;
+      for ( uint8_t digit = interface.m_exponent; digit < 9; ++digit )
+      {
+         scale *= 10;
+      }
+      for ( uint8_t digit = 9; digit < interface.m_exponent; ++digit )
+      {
+         ticks /= 10;
+      }
+      return ticks * scale;
+   }
+
+   // Reads an IDB's link type and if_tsresol option
+   PcapInterface readInterface( size_t length, const uint8_t* body, bool swapped )
+   {
+      PcapInterface interface = { get16( body, swapped ), false, 6 };
+      size_t offset = 8;
+      while ( offset + 4 <= length )
+      {
+         uint16_t code = get16( body + offset, swapped );
+         uint16_t optionLength = get16( body + offset + 2, swapped );
+         if ( ( PCAPNG_OPTION_END == code ) || ( offset + 4 + optionLength > length ) )
+         {
+            break;
+         }
+         if ( ( PCAPNG_OPTION_TSRESOL == code ) && ( 1 == optionLength ) )
+         {
+            interface.m_binary = 0 != ( body[ offset + 4 ] & 0x80 );
+            interface.m_exponent = body[ offset + 4 ] & 0x7F;
+         }
+         offset += 4 + ( ( optionLength + 3 ) & ~3u );
+      }
+      return interface;
+   }
+
+   void frameCallback( void* ctx,
+                       size_t data_length,
+                       const uint8_t* data,
+                       const pkt_timestamps_t* timestamps )
+   {
+      auto* flow = static_cast< PcapFlow* >( ctx );
+      PcapReader* reader = flow->m_reader;
+      reader->m_stats.frames++;
+      reader->m_callback(
+         reader->m_callbackCtx, &flow->m_key, timestamps->etx_time, data_length, data );
+   }
+} // namespace
+
+size_t PcapFlowHash::operator()( const pkt_flow_key_t& key ) const
+{
+   // Multiply-xorshift over the key a word at a time (it has no padding)
+   const auto* bytes = reinterpret_cast< const uint8_t* >( &key );
+   uint64_t hash = 0;
+   for ( size_t idx = 0; idx < sizeof( key ); idx += sizeof( uint64_t ) )
+   {
+      uint64_t word = 0;
+      memcpy( &word, bytes + idx, std::min( sizeof( word ), sizeof( key ) - idx ) );
+      hash = ( hash ^ word ) * 0x9E3779B97F4A7C15;
+      hash ^= hash >> 32;
+   }
+   return static_cast< size_t >( hash );
+}
+
+bool PcapFlowEqual::operator()( const pkt_flow_key_t& left, const pkt_flow_key_t& right ) const
+{
+   return 0 == memcmp( &left, &right, sizeof( left ) );
+}
+
+PcapFlow::PcapFlow( PcapReader* reader, const pkt_flow_key_t& key )
+   : m_reader( reader ),
+     m_key( key ),
+     m_decoder( pkt_decoder_create_ts( frameCallback, this ) ),
+     m_synced( false ),
+     m_nextSeq( 0 ),
+     m_position( 0 ),
+     m_heldBytes( 0 ),
+     m_closing( false ),
+     m_finPosition( 0 )
+{
+}
+
+PcapFlow::~PcapFlow()
+{
+   pkt_decoder_destroy( this->m_decoder );
+}
+
+void PcapFlow::deliver( uint64_t timestamp, size_t length, const uint8_t* data )
+{
+   this->m_reader->m_stats.payload_bytes += length;
+   pkt_decoder_write_bytes_ts( this->m_decoder, length, data, timestamp );
+}
+
+void PcapFlow::writeSegment( uint32_t seq, uint64_t timestamp, size_t length, const uint8_t* data )
+{
+   int32_t ahead = static_cast< int32_t >( seq - this->m_nextSeq );
+   if ( ahead > 0 )
+   {
+      uint64_t position = this->m_position + static_cast< uint64_t >( ahead );
+      PcapSegment& held = this->m_held[ position ];
+      if ( held.m_data.size() >= length )
+      {
+         this->m_reader->m_stats.retransmits++;
+         return;
+      }
+      this->m_reader->m_stats.out_of_order++;
+      this->m_heldBytes += length - held.m_data.size();
+      held.m_timestamp = timestamp;
+      held.m_data.assign( data, data + length );
+      while ( this->m_heldBytes > PKT_PCAP_MAX_HELD_BYTES )
+      {
+         this->skipGap();
+      }
+      return;
+   }
+   size_t overlap = this->m_nextSeq - seq;
+   if ( overlap >= length )
+   {
+      this->m_reader->m_stats.retransmits++;
+      return;
+   }
+   this->deliver( timestamp, length - overlap, data + overlap );
+   this->m_nextSeq += static_cast< uint32_t >( length - overlap );
+   this->m_position += length - overlap;
+   if ( !this->m_held.empty() )
+   {
+      this->deliverHeld();
+   }
+}
+
+void PcapFlow::deliverHeld()
+{
+   while ( !this->m_held.empty() && ( this->m_held.begin()->first <= this->m_position ) )
+   {
+      auto first = this->m_held.begin();
+      const std::vector< uint8_t >& data = first->second.m_data;
+      uint64_t overlap = this->m_position - first->first;
+      if ( overlap < data.size() )
+      {
+         size_t length = data.size() - overlap;
+         this->deliver( first->second.m_timestamp, length, data.data() + overlap );
+         this->m_nextSeq += static_cast< uint32_t >( length );
+         this->m_position += length;
+      }
+      this->m_heldBytes -= data.size();
+      this->m_held.erase( first );
+   }
+}
+
+void PcapFlow::skipGap()
+{
+   // The frame in progress is missing bytes, so it mustn't be completed by what follows the gap
+   pkt_decoder_destroy( this->m_decoder );
+   this->m_decoder = pkt_decoder_create_ts( frameCallback, this );
+   this->m_reader->m_stats.gaps++;
+   uint64_t skipped = this->m_held.begin()->first - this->m_position;
+   this->m_nextSeq += static_cast< uint32_t >( skipped );
+   this->m_position += skipped;
+   this->deliverHeld();
+}
+
+PcapReader::PcapReader( const uint8_t* map,
+                        size_t mapLength,
+                        pkt_pcap_frame_fn_t callback,
+                        void* callbackCtx )
+   : m_map( map ),
+     m_mapLength( mapLength ),
+     m_callback( callback ),
+     m_callbackCtx( callbackCtx ),
+     m_lastFlow( nullptr ),
+     m_stats()
+{
+}
+
+bool PcapReader::readPcap()
+{
+   uint32_t magic = get32( this->m_map, false );
+   bool swapped = ( __builtin_bswap32( PCAP_MAGIC_MICROSECONDS ) == magic )
+                  || ( __builtin_bswap32( PCAP_MAGIC_NANOSECONDS ) == magic );
+   bool nanoseconds = ( PCAP_MAGIC_NANOSECONDS == magic )
+                      || ( __builtin_bswap32( PCAP_MAGIC_NANOSECONDS ) == magic );
+   // The top bits of the link type field hold FCS details
+   uint32_t linkType = get32( this->m_map + 20, swapped ) & 0x0FFFFFFF;
+   size_t offset = PCAP_HEADER_LENGTH;
+   while ( offset + PCAP_RECORD_HEADER_LENGTH <= this->m_mapLength )
+   {
+      const uint8_t* record = this->m_map + offset;
+      uint32_t captured = get32( record + 8, swapped );
+      if ( captured > this->m_mapLength - offset - PCAP_RECORD_HEADER_LENGTH )
+      {
+         return false;
+      }
+      uint64_t timestamp = get32( record, swapped ) * uint64_t( 1000000000 )
+                           + uint64_t( get32( record + 4, swapped ) ) * ( nanoseconds ? 1 : 1000 );
+      this->readPacket( linkType, timestamp, captured, record + PCAP_RECORD_HEADER_LENGTH );
+      offset += PCAP_RECORD_HEADER_LENGTH + captured;
+   }
+   return offset == this->m_mapLength;
+}
+
+bool PcapReader::readPcapng()
+{
+   std::vector< PcapInterface > interfaces;
+   bool swapped = false;
+   size_t offset = 0;
+   while ( offset + 12 <= this->m_mapLength )
+   {
+      const uint8_t* block = this->m_map + offset;
+      if ( PCAPNG_SECTION_HEADER == get32( block, false ) )
+      {
+         // A new section may change the byte order, and starts without interfaces
+         swapped = PCAPNG_BYTE_ORDER_MAGIC != get32( block + 8, false );
+         if ( swapped && ( PCAPNG_BYTE_ORDER_MAGIC != get32( block + 8, true ) ) )
+         {
+            return false;
+         }
+         interfaces.clear();
+      }
+      uint32_t type = get32( block, swapped );
+      uint32_t length = get32( block + 4, swapped );
+      if ( ( length < 12 ) || ( 0 != length % 4 ) || ( length > this->m_mapLength - offset ) )
+      {
+         return false;
+      }
+      const uint8_t* body = block + 8;
+      size_t bodyLength = length - 12;
+      switch ( type )
+      {
+         case PCAPNG_INTERFACE_DESCRIPTION: {
+            if ( bodyLength < 8 )
+            {
+               return false;
+            }
+            interfaces.push_back( readInterface( bodyLength, body, swapped ) );
+         }
+         break;
+         case PCAPNG_ENHANCED_PACKET: {
+            if ( bodyLength < 20 )
+            {
+               return false;
+            }
+            uint32_t interface = get32( body, swapped );
+            uint32_t captured = get32( body + 12, swapped );
+            if ( ( interface >= interfaces.size() ) || ( captured > bodyLength - 20 ) )
+            {
+               return false;
+            }
+            uint64_t ticks = ( static_cast< uint64_t >( get32( body + 4, swapped ) ) << 32 )
+                             | get32( body + 8, swapped );
+            this->readPacket( interfaces[ interface ].m_linkType,
+                              toNanoseconds( ticks, interfaces[ interface ] ),
+                              captured,
+                              body + 20 );
+         }
+         break;
+         case PCAPNG_SIMPLE_PACKET: {
+            // No timestamp, and always from the first interface
+            if ( ( bodyLength < 4 ) || interfaces.empty() )
+            {
+               return false;
+            }
+            size_t captured = get32( body, swapped );
+            if ( captured > bodyLength - 4 )
+            {
+               captured = bodyLength - 4;
+            }
+            this->readPacket( interfaces[ 0 ].m_linkType, 0, captured, body + 4 );
+         }
+         break;
+         default:
+            break;
+      }
+      offset += length;
+   }
+   return offset == this->m_mapLength;
+}
+
+void PcapReader::readPacket( uint32_t linkType,
+                             uint64_t timestamp,
+                             size_t length,
+                             const uint8_t* data )
+{
+   this->m_stats.records++;
+   // Find the IP header, and the version the link layer says it is (0 if it doesn't say)
+   size_t offset = 0;
+   uint16_t etherType = 0;
+   switch ( linkType )
+   {
+      case LINKTYPE_ETHERNET: {
+         offset = 14;
+         etherType = ( length >= offset ) ? getBe16( data + 12 ) : 0;
+         while ( ( ( ETHERTYPE_VLAN == etherType ) || ( ETHERTYPE_QINQ == etherType ) )
+                 && ( length >= offset + 4 ) )
+         {
+            etherType = getBe16( data + offset + 2 );
+            offset += 4;
+         }
+         if ( ( ETHERTYPE_IPV4 != etherType ) && ( ETHERTYPE_IPV6 != etherType ) )
+         {
+            this->m_stats.skipped++;
+            return;
+         }
+      }
+      break;
+      case LINKTYPE_LINUX_SLL:
+         offset = 16;
+         etherType = ( length >= offset ) ? getBe16( data + 14 ) : 0;
+         break;
+      case LINKTYPE_LINUX_SLL2:
+         offset = 20;
+         etherType = ( length >= offset ) ? getBe16( data ) : 0;
+         break;
+      case LINKTYPE_NULL:
+         // The address family is in the capturing host's byte order, and its value for IPv6
+         // differs between BSDs, so go by the IP header alone
+         offset = 4;
+         break;
+      case LINKTYPE_RAW:
+      case LINKTYPE_IPV4:
+      case LINKTYPE_IPV6:
+         break;
+      default:
+         this->m_stats.skipped++;
+         return;
+   }
+   if ( length < offset + 1 )
+   {
+      this->m_stats.skipped++;
+      return;
+   }
+   const uint8_t* ip = data + offset;
+   size_t ipLength = length - offset;
+   pkt_flow_key_t key;
+   memset( &key, 0, sizeof( key ) );
+   key.ip_version = ip[ 0 ] >> 4;
+   if ( ( 4 == key.ip_version ) && ( ETHERTYPE_IPV6 != etherType ) && ( ipLength >= 20 ) )
+   {
+      size_t headerLength = ( ip[ 0 ] & 0xF ) * 4;
+      size_t totalLength = getBe16( ip + 2 );
+      // A fragment (more to follow, or an offset) can't be parsed on its own
+      if ( ( headerLength < 20 ) || ( totalLength < headerLength ) || ( totalLength > ipLength )
+           || ( 0 != ( getBe16( ip + 6 ) & 0x3FFF ) ) )
+      {
+         this->m_stats.skipped++;
+         return;
+      }
+      key.protocol = ip[ 9 ];
+      memcpy( key.src_addr, ip + 12, 4 );
+      memcpy( key.dst_addr, ip + 16, 4 );
+      // Ethernet pads short packets, so go by the IP length rather than the captured length
+      this->readTransport( key, timestamp, totalLength - headerLength, ip + headerLength );
+   }
+   else if ( ( 6 == key.ip_version ) && ( ETHERTYPE_IPV4 != etherType ) && ( ipLength >= 40 ) )
+   {
+      size_t payloadLength = getBe16( ip + 4 );
+      if ( 40 + payloadLength > ipLength )
+      {
+         this->m_stats.skipped++;
+         return;
+      }
+      memcpy( key.src_addr, ip + 8, 16 );
+      memcpy( key.dst_addr, ip + 24, 16 );
+      uint8_t next = ip[ 6 ];
+      const uint8_t* header = ip + 40;
+      const uint8_t* end = header + payloadLength;
+      while ( ( IPPROTO_HOP_BY_HOP == next ) || ( IPPROTO_ROUTING == next )
+              || ( IPPROTO_DEST_OPTS == next ) || ( IPPROTO_AUTH == next ) )
+      {
+         if ( end - header < 8 )
+         {
+            this->m_stats.skipped++;
+            return;
+         }
+         size_t extensionLength =
+            ( IPPROTO_AUTH == next ) ? ( header[ 1 ] + 2 ) * 4 : ( header[ 1 ] + 1 ) * 8;
+         if ( static_cast< size_t >( end - header ) < extensionLength )
+         {
+            this->m_stats.skipped++;
+            return;
+         }
+         next = header[ 0 ];
+         header += extensionLength;
+      }
+      if ( IPPROTO_FRAGMENT == next )
+      {
+         this->m_stats.skipped++;
+         return;
+      }
+      key.protocol = next;
+      this->readTransport( key, timestamp, end - header, header );
+   }
+   else
+   {
+      this->m_stats.skipped++;
+   }
+}
+
+void PcapReader::readTransport( pkt_flow_key_t& key,
+                                uint64_t timestamp,
+                                size_t length,
+                                const uint8_t* data )
+{
+   if ( ( IPPROTO_UDP_ == key.protocol ) && ( length >= 8 ) )
+   {
+      size_t udpLength = getBe16( data + 4 );
+      if ( ( udpLength < 8 ) || ( udpLength > length ) )
+      {
+         this->m_stats.skipped++;
+         return;
+      }
+      key.src_port = getBe16( data );
+      key.dst_port = getBe16( data + 2 );
+      if ( udpLength > 8 )
+      {
+         this->flow( key, true )->deliver( timestamp, udpLength - 8, data + 8 );
+      }
+   }
+   else if ( ( IPPROTO_TCP_ == key.protocol ) && ( length >= 20 ) )
+   {
+      size_t headerLength = ( data[ 12 ] >> 4 ) * 4;
+      if ( ( headerLength < 20 ) || ( headerLength > length ) )
+      {
+         this->m_stats.skipped++;
+         return;
+      }
+      key.src_port = getBe16( data );
+      key.dst_port = getBe16( data + 2 );
+      uint32_t seq = getBe32( data + 4 );
+      uint8_t flags = data[ 13 ];
+      size_t payloadLength = length - headerLength;
+      bool syn = 0 != ( flags & TCP_SYN );
+      // Bare ACKs, and the FIN or RST of a flow that is already gone, don't make a flow
+      PcapFlow* flow = this->flow( key, syn || ( payloadLength > 0 ) );
+      if ( nullptr == flow )
+      {
+         return;
+      }
+      if ( syn )
+      {
+         // A SYN other than a retransmitted one (whose sequence number is the one the delivered
+         // data started from) is a new connection reusing the ports of one whose end wasn't
+         // captured
+         uint32_t start = flow->m_nextSeq - static_cast< uint32_t >( flow->m_position );
+         if ( flow->m_synced && ( seq + 1 != start ) )
+         {
+            this->closeFlow( flow );
+            flow = this->flow( key, true );
+         }
+         if ( !flow->m_synced )
+         {
+            flow->m_synced = true;
+            flow->m_nextSeq = seq + 1;
+         }
+         ++seq;
+      }
+      if ( !flow->m_synced && ( payloadLength > 0 ) )
+      {
+         // The capture started mid-connection: take the stream from here
+         flow->m_synced = true;
+         flow->m_nextSeq = seq;
+      }
+      if ( payloadLength > 0 )
+      {
+         flow->writeSegment( seq, timestamp, payloadLength, data + headerLength );
+      }
+      if ( 0 != ( flags & TCP_RST ) )
+      {
+         while ( !flow->m_held.empty() )
+         {
+            flow->skipGap();
+         }
+         this->closeFlow( flow );
+      }
+      else
+      {
+         if ( ( 0 != ( flags & TCP_FIN ) ) && !flow->m_closing )
+         {
+            int32_t ahead = static_cast< int32_t >( seq + payloadLength - flow->m_nextSeq );
+            flow->m_closing = true;
+            flow->m_finPosition = flow->m_position + std::max< int32_t >( ahead, 0 );
+         }
+         if ( flow->m_closing && ( flow->m_position >= flow->m_finPosition ) )
+         {
+            this->closeFlow( flow );
+         }
+      }
+   }
+   else
+   {
+      this->m_stats.skipped++;
+   }
+}
+
+PcapFlow* PcapReader::flow( const pkt_flow_key_t& key, bool create )
+{
+   if ( ( nullptr != this->m_lastFlow ) && PcapFlowEqual()( this->m_lastFlow->m_key, key ) )
+   {
+      return this->m_lastFlow;
+   }
+   auto found = this->m_flows.find( key );
+   if ( this->m_flows.end() != found )
+   {
+      this->m_lastFlow = found->second.get();
+   }
+   else if ( create )
+   {
+      this->m_lastFlow = new PcapFlow( this, key );
+      this->m_flows[ key ].reset( this->m_lastFlow );
+      this->m_stats.flows++;
+   }
+   else
+   {
+      return nullptr;
+   }
+   return this->m_lastFlow;
+}
+
+void PcapReader::closeFlow( PcapFlow* flow )
+{
+   if ( this->m_lastFlow == flow )
+   {
+      this->m_lastFlow = nullptr;
+   }
+   // The key is erased along with the flow, so look it up with a copy
+   pkt_flow_key_t key = flow->m_key;
+   this->m_flows.erase( key );
+}
+
+void PcapReader::finish()
+{
+   for ( auto& entry : this->m_flows )
+   {
+      while ( !entry.second->m_held.empty() )
+      {
+         entry.second->skipGap();
+      }
+   }
+}
+
+pkt_pcap_reader_t* pkt_pcap_open( const char* path,
+                                  pkt_pcap_frame_fn_t callback,
+                                  void* callback_ctx )
+{
+   int fd = open( path, O_RDONLY );
+   if ( fd < 0 )
+   {
+      return nullptr;
+   }
+   struct stat info;
+   void* map = MAP_FAILED;
+   if ( ( 0 == fstat( fd, &info ) )
+        && ( static_cast< size_t >( info.st_size ) >= PCAP_HEADER_LENGTH ) )
+   {
+      map = mmap( nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+   }
+   close( fd );
+   if ( MAP_FAILED == map )
+   {
+      return nullptr;
+   }
+   // Records are read once, front to back
+   madvise( map, info.st_size, MADV_SEQUENTIAL );
+
+   auto* reader =
+      new PcapReader( static_cast< const uint8_t* >( map ), info.st_size, callback, callback_ctx );
+   uint32_t magic = get32( reader->m_map, false );
+   bool pcap = ( PCAP_MAGIC_MICROSECONDS == magic ) || ( PCAP_MAGIC_NANOSECONDS == magic )
+               || ( __builtin_bswap32( PCAP_MAGIC_MICROSECONDS ) == magic )
+               || ( __builtin_bswap32( PCAP_MAGIC_NANOSECONDS ) == magic );
+   uint32_t byteOrder = get32( reader->m_map + 8, false );
+   bool pcapng = ( PCAPNG_SECTION_HEADER == magic )
+                 && ( ( PCAPNG_BYTE_ORDER_MAGIC == byteOrder )
+                      || ( __builtin_bswap32( PCAPNG_BYTE_ORDER_MAGIC ) == byteOrder ) );
+   if ( !pcap && !pcapng )
+   {
+      pkt_pcap_close( reader );
+      return nullptr;
+   }
+   return reader;
+}
+
+bool pkt_pcap_read_all( pkt_pcap_reader_t* reader )
+{
+   bool ok = ( PCAPNG_SECTION_HEADER == get32( reader->m_map, false ) ) ? reader->readPcapng()
+                                                                        : reader->readPcap();
+   reader->finish();
+   return ok;
+}
+
+void pkt_pcap_get_stats( const pkt_pcap_reader_t* reader, pkt_pcap_stats_t* stats )
+{
+   *stats = reader->m_stats;
+}
+
+void pkt_pcap_close( pkt_pcap_reader_t* reader )
+{
+   munmap( const_cast< uint8_t* >( reader->m_map ), reader->m_mapLength );
+   delete reader;
+}
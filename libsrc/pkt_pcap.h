@@ -0,0 +1,167 @@
+#ifndef PKT_PCAP_H_INCLUDED
+#define PKT_PCAP_H_INCLUDED
+
+#include "pkt_decoder.h"
+
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Offline reader for pcap and pcapng captures of framed serial-over-TCP/UDP traffic. The capture
+// is mapped, not read, and each flow (one direction of a TCP connection or UDP conversation,
+// keyed by its 5-tuple) is decoded by its own pkt_decoder, so frames split across segments come
+// out whole.
+//
+// Link types: Ethernet (with 802.1Q/802.1ad tags), raw IPv4/IPv6, Linux cooked (SLL) and BSD
+// loopback. IP fragments, and anything that isn't TCP or UDP over IPv4 or IPv6, are skipped.
+//
+// TCP payload is delivered in sequence order. Segments that arrive early are held until the gap
+// before them fills, and retransmitted data is delivered once. A gap that never fills (the
+// segment wasn't captured) is given up on once PKT_PCAP_MAX_HELD_BYTES are held for the flow, or
+// at a RST, or at the end of the capture: the flow's decoder is then reset, dropping any frame in
+// progress, and decoding resumes at the next STX. A flow is forgotten once it has been delivered
+// up to its FIN, or at a RST, so a later connection on the same ports starts afresh.
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+// Out-of-order TCP data held per flow before a gap is given up on
+#define PKT_PCAP_MAX_HELD_BYTES ( 4 * 1024 * 1024 )
+
+   class PcapReader;
+   class PcapFlow;
+
+   typedef struct PcapReader pkt_pcap_reader_t;
+
+   // One direction of a conversation. Ports are in host byte order, addresses as they appear on
+   // the wire (an IPv4 address is the first 4 bytes, the rest are 0)
+   typedef struct
+   {
+      uint8_t ip_version;
+      // 6 (TCP) or 17 (UDP)
+      uint8_t protocol;
+      uint16_t src_port;
+      uint16_t dst_port;
+      uint8_t src_addr[ 16 ];
+      uint8_t dst_addr[ 16 ];
+   } pkt_flow_key_t;
+
+   // Receives each decoded frame with its flow, and the capture time (ns since the epoch) of the
+   // packet that held its ETX
+   typedef void ( *pkt_pcap_frame_fn_t )( void* ctx,
+                                          const pkt_flow_key_t* flow,
+                                          uint64_t timestamp,
+                                          size_t data_length,
+                                          const uint8_t* data );
+
+   typedef struct
+   {
+      // Capture records read, and those skipped as not TCP or UDP over IP (or truncated)
+      uint64_t records;
+      uint64_t skipped;
+      // Flows seen, and TCP/UDP payload bytes passed to their decoders
+      uint64_t flows;
+      uint64_t payload_bytes;
+      uint64_t frames;
+      // TCP segments held until the gap before them filled, segments that carried only data
+      // already delivered, and gaps given up on
+      uint64_t out_of_order;
+      uint64_t retransmits;
+      uint64_t gaps;
+   } pkt_pcap_stats_t;
+
+   // Maps a pcap or pcapng file. Returns a nullptr if it can't be read or is neither
+   PKT_API pkt_pcap_reader_t* pkt_pcap_open( const char* path,
+                                             pkt_pcap_frame_fn_t callback,
+                                             void* callback_ctx );
+   // Decodes the whole capture. Returns false if it stops at a malformed or truncated record;
+   // the frames before it have been delivered
+   PKT_API bool pkt_pcap_read_all( pkt_pcap_reader_t* reader );
+   PKT_API void pkt_pcap_get_stats( const pkt_pcap_reader_t* reader, pkt_pcap_stats_t* stats );
+   PKT_API void pkt_pcap_close( pkt_pcap_reader_t* reader );
+
+   // A TCP segment that arrived ahead of the data before it
+   struct PcapSegment
+   {
+      uint64_t m_timestamp;
+      std::vector< uint8_t > m_data;
+   };
+
+   // Decoder and TCP reassembly state of one flow
+   class PcapFlow
+   {
+    public:
+      PcapFlow( PcapReader*, const pkt_flow_key_t& );
+      virtual ~PcapFlow();
+      // Passes payload to the decoder
+      void deliver( uint64_t timestamp, size_t length, const uint8_t* data );
+      // Delivers a TCP segment in sequence order, or holds it until it can be
+      void writeSegment( uint32_t seq, uint64_t timestamp, size_t length, const uint8_t* data );
+      // Delivers held segments that the data so far has reached
+      void deliverHeld();
+      // Gives up on the gap before the first held segment
+      void skipGap();
+
+      PcapReader* m_reader;
+      pkt_flow_key_t m_key;
+      pkt_decoder_t* m_decoder;
+      // TCP only: whether m_nextSeq is known, the sequence number of the next byte to deliver and
+      // its offset in the stream, and segments held until the stream reaches them, keyed by
+      // offset (which, unlike a sequence number, doesn't wrap)
+      bool m_synced;
+      uint32_t m_nextSeq;
+      uint64_t m_position;
+      std::map< uint64_t, PcapSegment > m_held;
+      size_t m_heldBytes;
+      // A FIN has been seen, and the flow closes once the stream reaches the FIN's offset (data
+      // sent before the FIN can still arrive after it)
+      bool m_closing;
+      uint64_t m_finPosition;
+   };
+
+   struct PcapFlowHash
+   {
+      size_t operator()( const pkt_flow_key_t& key ) const;
+   };
+
+   struct PcapFlowEqual
+   {
+      bool operator()( const pkt_flow_key_t& left, const pkt_flow_key_t& right ) const;
+   };
+
+   class PcapReader
+   {
+    public:
+      PcapReader( const uint8_t*, size_t, pkt_pcap_frame_fn_t, void* );
+      virtual ~PcapReader() = default;
+      bool readPcap();
+      bool readPcapng();
+      // Handles one captured packet of the given link type
+      void readPacket( uint32_t linkType, uint64_t timestamp, size_t length, const uint8_t* data );
+      // Handles the TCP or UDP header and payload of an IP packet
+      void readTransport( pkt_flow_key_t& key,
+                          uint64_t timestamp,
+                          size_t length,
+                          const uint8_t* data );
+      // The flow with the given key, made if there isn't one and create is set
+      PcapFlow* flow( const pkt_flow_key_t& key, bool create );
+      void closeFlow( PcapFlow* flow );
+      // Gives up on the gaps in every flow, at the end of the capture
+      void finish();
+
+      const uint8_t* m_map;
+      size_t m_mapLength;
+      pkt_pcap_frame_fn_t m_callback;
+      void* m_callbackCtx;
+      std::unordered_map< pkt_flow_key_t, std::unique_ptr< PcapFlow >, PcapFlowHash, PcapFlowEqual >
+         m_flows;
+      // The flow of the previous packet, which is usually the flow of the next one too
+      PcapFlow* m_lastFlow;
+      pkt_pcap_stats_t m_stats;
+   };
+
+#ifdef __cplusplus
+}
+#endif
+#endif // PKT_PCAP_H_INCLUDED
@@ -0,0 +1,49 @@
+#ifndef PKT_PROBES_H_INCLUDED
+#define PKT_PROBES_H_INCLUDED
+
+// USDT (user-level statically defined tracing) probes in the decode path, for tracing a running
+// decoder with bpftrace, perf or SystemTap. Each probe is a single nop until a tracer attaches,
+// plus an ELF note that tells the tracer where it is and where its arguments live. Without
+// <sys/sdt.h> (or with PKT_NO_PROBES defined) the probes compile to nothing.
+//
+//   pktdecoder:packet   decoder, length, data, stream offset of the ETX, as the packet is handed to
+//                       its route or read callback (after the filter and checksum, less trailer)
+//   pktdecoder:overflow decoder, length, stream offset of the byte that overflowed
+//   pktdecoder:abort    decoder, length, stream offset of the STX that aborted the packet
+//   pktdecoder:drop     decoder, length decoded when a filter or route rejected the packet
+//   pktdecoder:resync   decoder, garbage bytes skipped in this write, stream offset of the STX
+//
+// For example, a histogram of delivered packet lengths in a running process:
+//   bpftrace -p PID -e 'usdt:pktdecoder:packet { @length = hist( arg1 ); }'
+#if defined( PKT_HAVE_SDT ) && !defined( PKT_NO_PROBES )
+#include <sys/sdt.h>
+#define PKT_PROBE2( name, arg1, arg2 ) DTRACE_PROBE2( pktdecoder, name, arg1, arg2 )
+#define PKT_PROBE3( name, arg1, arg2, arg3 ) DTRACE_PROBE3( pktdecoder, name, arg1, arg2, arg3 )
+#define PKT_PROBE4( name, arg1, arg2, arg3, arg4 ) \
+   DTRACE_PROBE4( pktdecoder, name, arg1, arg2, arg3, arg4 )
+#else
+// sizeof keeps the arguments "used" without evaluating them
+#define PKT_PROBE2( name, arg1, arg2 ) \
+   do                                  \
+   {                                   \
+      ( void )sizeof( arg1 );          \
+      ( void )sizeof( arg2 );          \
+   } while ( 0 )
+#define PKT_PROBE3( name, arg1, arg2, arg3 ) \
+   do                                        \
+   {                                         \
+      ( void )sizeof( arg1 );                \
+      ( void )sizeof( arg2 );                \
+      ( void )sizeof( arg3 );                \
+   } while ( 0 )
+#define PKT_PROBE4( name, arg1, arg2, arg3, arg4 ) \
+   do                                              \
+   {                                               \
+      ( void )sizeof( arg1 );                      \
+      ( void )sizeof( arg2 );                      \
+      ( void )sizeof( arg3 );                      \
+      ( void )sizeof( arg4 );                      \
+   } while ( 0 )
+#endif
+
+#endif // PKT_PROBES_H_INCLUDED
@@ -0,0 +1,201 @@
+#include "pkt_scheduler.h"
+
+PacketScheduler::PacketScheduler( size_t numWorkers )
+   : m_stealing( true ),
+     m_readyCount( 0 ),
+     m_scheduledCount( 0 ),
+     m_stopping( false )
+{
+   for ( size_t worker = 0; worker < numWorkers; ++worker )
+   {
+      m_workers.emplace_back( new PacketWorker );
+   }
+}
+
+pkt_scheduler_t* pkt_scheduler_create( size_t num_workers )
+{
+   auto* scheduler = new PacketScheduler( ( num_workers > 0 ) ? num_workers : 1 );
+   for ( size_t worker = 0; worker < scheduler->m_workers.size(); ++worker )
+   {
+      scheduler->m_workers[ worker ]->m_thread =
+         std::thread( &PacketScheduler::run, scheduler, worker );
+   }
+   return scheduler;
+}
+
+void pkt_scheduler_destroy( pkt_scheduler_t* scheduler )
+{
+   pkt_scheduler_drain( scheduler );
+   {
+      std::lock_guard< std::mutex > idle( scheduler->m_idleLock );
+      scheduler->m_stopping = true;
+   }
+   scheduler->m_wake.notify_all();
+   for ( auto& worker : scheduler->m_workers )
+   {
+      worker->m_thread.join();
+   }
+   delete scheduler;
+}
+
+pkt_channel_t* pkt_scheduler_add_channel( pkt_scheduler_t* scheduler,
+                                          uint32_t channel_id,
+                                          pkt_decoder_t* decoder )
+{
+   auto* channel = new PacketChannel;
+   channel->m_id = channel_id;
+   channel->m_decoder = decoder;
+   channel->m_homeWorker = channel_id % scheduler->m_workers.size();
+   channel->m_scheduled = false;
+   std::lock_guard< std::mutex > idle( scheduler->m_idleLock );
+   scheduler->m_channels.emplace_back( channel );
+   return channel;
+}
+
+void pkt_scheduler_submit( pkt_scheduler_t* scheduler,
+                           pkt_channel_t* channel,
+                           size_t length,
+                           const uint8_t* data )
+{
+   bool wasScheduled;
+   {
+      std::lock_guard< std::mutex > lock( channel->m_lock );
+      channel->m_pending.insert( channel->m_pending.end(), data, data + length );
+      wasScheduled = channel->m_scheduled;
+      channel->m_scheduled = true;
+   }
+   // A channel that is already queued or being decoded will pick the new bytes up itself
+   if ( !wasScheduled )
+   {
+      scheduler->m_scheduledCount++;
+      scheduler->enqueue( channel->m_homeWorker, channel );
+   }
+}
+
+void pkt_scheduler_drain( pkt_scheduler_t* scheduler )
+{
+   std::unique_lock< std::mutex > idle( scheduler->m_idleLock );
+   scheduler->m_drained.wait( idle, [scheduler]() { return 0 == scheduler->m_scheduledCount; } );
+}
+
+void pkt_scheduler_set_work_stealing( pkt_scheduler_t* scheduler, bool enabled )
+{
+   scheduler->m_stealing = enabled;
+   // Workers sleeping on an empty queue may now be able to steal
+   scheduler->m_wake.notify_all();
+}
+
+void PacketScheduler::enqueue( size_t worker, PacketChannel* channel )
+{
+   {
+      std::lock_guard< std::mutex > lock( m_workers[ worker ]->m_lock );
+      m_workers[ worker ]->m_ready.push_back( channel );
+   }
+   m_readyCount++;
+   {
+      std::lock_guard< std::mutex > idle( m_idleLock );
+   }
+   if ( m_stealing )
+   {
+      // Whichever worker wakes up can take the channel
+      m_wake.notify_one();
+   }
+   else
+   {
+      m_wake.notify_all();
+   }
+}
+
+PacketChannel* PacketScheduler::dequeue( size_t worker )
+{
+   std::lock_guard< std::mutex > lock( m_workers[ worker ]->m_lock );
+   if ( m_workers[ worker ]->m_ready.empty() )
+   {
+      return nullptr;
+   }
+   PacketChannel* channel = m_workers[ worker ]->m_ready.front();
+   m_workers[ worker ]->m_ready.pop_front();
+   m_readyCount--;
+   return channel;
+}
+
+PacketChannel* PacketScheduler::steal( size_t worker )
+{
+   std::vector< PacketChannel* > stolen;
+   for ( size_t offset = 1; ( offset < m_workers.size() ) && stolen.empty(); ++offset )
+   {
+      PacketWorker& victim = *m_workers[ ( worker + offset ) % m_workers.size() ];
+      std::lock_guard< std::mutex > lock( victim.m_lock );
+      // Take the back half of the victim's queue: the channels it would get to last
+      size_t count = ( victim.m_ready.size() + 1 ) / 2;
+      stolen.assign( victim.m_ready.end() - count, victim.m_ready.end() );
+      victim.m_ready.erase( victim.m_ready.end() - count, victim.m_ready.end() );
+   }
+   if ( stolen.empty() )
+   {
+      return nullptr;
+   }
+   {
+      std::lock_guard< std::mutex > lock( m_workers[ worker ]->m_lock );
+      m_workers[ worker ]->m_ready.insert(
+         m_workers[ worker ]->m_ready.end(), stolen.begin() + 1, stolen.end() );
+   }
+   m_readyCount--;
+   return stolen.front();
+}
+
+void PacketScheduler::run( size_t worker )
+{
+   std::vector< uint8_t > batch;
+   while ( true )
+   {
+      PacketChannel* channel = dequeue( worker );
+      if ( ( nullptr == channel ) && m_stealing )
+      {
+         channel = steal( worker );
+      }
+      if ( nullptr == channel )
+      {
+         std::unique_lock< std::mutex > idle( m_idleLock );
+         m_wake.wait( idle, [this, worker]() {
+            if ( m_stopping || ( m_stealing && ( m_readyCount > 0 ) ) )
+            {
+               return true;
+            }
+            std::lock_guard< std::mutex > lock( m_workers[ worker ]->m_lock );
+            return !m_workers[ worker ]->m_ready.empty();
+         } );
+         if ( m_stopping && ( 0 == m_readyCount ) )
+         {
+            return;
+         }
+         continue;
+      }
+
+      // Decode everything the channel has queued in one write
+      {
+         std::lock_guard< std::mutex > lock( channel->m_lock );
+         batch.swap( channel->m_pending );
+      }
+      pkt_decoder_write_bytes( channel->m_decoder, batch.size(), batch.data() );
+      batch.clear();
+
+      bool done;
+      {
+         std::lock_guard< std::mutex > lock( channel->m_lock );
+         done = channel->m_pending.empty();
+         channel->m_scheduled = !done;
+      }
+      if ( !done )
+      {
+         // More bytes arrived while decoding; go to the back of the queue so other channels
+         // get a turn
+         enqueue( worker, channel );
+      }
+      else if ( 0 == --m_scheduledCount )
+      {
+         std::lock_guard< std::mutex > idle( m_idleLock );
+         m_drained.notify_all();
+      }
+   }
+}
@@ -0,0 +1,91 @@
+#ifndef PKT_SCHEDULER_H_INCLUDED
+#define PKT_SCHEDULER_H_INCLUDED
+
+#include "pkt_decoder.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs many decoders on a pool of worker threads. Each channel (one decoder) has a home worker
+// chosen by its id, and bytes submitted to it are decoded in order by one worker at a time, so a
+// channel's callbacks are never concurrent and arrive in stream order. Workers that run out of
+// ready channels steal half of another worker's ready queue.
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+   class PacketScheduler;
+   struct PacketChannel;
+
+   typedef struct PacketScheduler pkt_scheduler_t;
+   typedef struct PacketChannel pkt_channel_t;
+
+   // Starts num_workers worker threads (at least one)
+   PKT_API pkt_scheduler_t* pkt_scheduler_create( size_t num_workers );
+   // Decodes everything already submitted, then stops the workers. Decoders are not destroyed
+   PKT_API void pkt_scheduler_destroy( pkt_scheduler_t* scheduler );
+   // Registers a decoder. The returned channel is owned by the scheduler
+   PKT_API pkt_channel_t* pkt_scheduler_add_channel( pkt_scheduler_t* scheduler,
+                                                     uint32_t channel_id,
+                                                     pkt_decoder_t* decoder );
+   // Queues a copy of data to be written to the channel's decoder on a worker thread
+   PKT_API void pkt_scheduler_submit( pkt_scheduler_t* scheduler,
+                                      pkt_channel_t* channel,
+                                      size_t len,
+                                      const uint8_t* data );
+   // Blocks until every byte submitted so far has been decoded
+   PKT_API void pkt_scheduler_drain( pkt_scheduler_t* scheduler );
+   // Work stealing is on by default; turning it off pins every channel to its home worker
+   PKT_API void pkt_scheduler_set_work_stealing( pkt_scheduler_t* scheduler, bool enabled );
+
+   struct PacketChannel
+   {
+      uint32_t m_id;
+      pkt_decoder_t* m_decoder;
+      size_t m_homeWorker;
+      std::mutex m_lock;
+      // Bytes submitted but not yet handed to a worker
+      std::vector< uint8_t > m_pending;
+      // Set while the channel is on a ready queue or being decoded
+      bool m_scheduled;
+   };
+
+   struct PacketWorker
+   {
+      std::mutex m_lock;
+      std::deque< PacketChannel* > m_ready;
+      std::thread m_thread;
+   };
+
+   class PacketScheduler
+   {
+    public:
+      explicit PacketScheduler( size_t );
+      virtual ~PacketScheduler() = default;
+      void enqueue( size_t worker, PacketChannel* channel );
+      PacketChannel* dequeue( size_t worker );
+      PacketChannel* steal( size_t worker );
+      void run( size_t worker );
+
+      std::vector< std::unique_ptr< PacketWorker > > m_workers;
+      std::vector< std::unique_ptr< PacketChannel > > m_channels;
+      std::atomic< bool > m_stealing;
+      // Channels on ready queues, and channels that are ready or being decoded
+      std::atomic< size_t > m_readyCount;
+      std::atomic< size_t > m_scheduledCount;
+      // Idle workers sleep on m_wake; pkt_scheduler_drain sleeps on m_drained
+      std::mutex m_idleLock;
+      std::condition_variable m_wake;
+      std::condition_variable m_drained;
+      bool m_stopping;
+   };
+
+#ifdef __cplusplus
+}
+#endif
+#endif // PKT_SCHEDULER_H_INCLUDED
@@ -0,0 +1,220 @@
+#include "pkt_shm_ring.h"
+
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Shared layout: one header, then a power of two of slots. Both are written by the producer
+// only. Each slot is a seqlock: its sequence number has WRITING set while the data is changing
+struct PacketShmHeader
+{
+   char m_magic[ 8 ];
+   uint32_t m_version;
+   uint32_t m_slotCount;
+   // Sequence number of the last packet published, on its own cache line
+   alignas( 64 ) std::atomic< uint64_t > m_published;
+};
+
+struct PacketShmSlot
+{
+   std::atomic< uint64_t > m_sequence;
+   uint32_t m_length;
+   alignas( 16 ) uint8_t m_data[ MAX_DECODED_DATA_LENGTH ];
+};
+
+namespace
+{
+   const char MAGIC[] = "PKTSHM01";
+   const size_t MAGIC_LENGTH( 8 );
+   const uint32_t VERSION( 1 );
+   const uint64_t WRITING( 1ull << 63 );
+   // Slots start on a page boundary
+   const size_t SLOTS_OFFSET( 4096 );
+
+   size_t mapLength( size_t slotCount )
+   {
+      return SLOTS_OFFSET + slotCount * sizeof( PacketShmSlot );
+   }
+} // namespace
+
+PacketShmRing::PacketShmRing( int fd, uint8_t* map, size_t mapLength )
+   : m_fd( fd ),
+     m_map( map ),
+     m_mapLength( mapLength ),
+     m_header( reinterpret_cast< PacketShmHeader* >( map ) ),
+     m_slots( reinterpret_cast< PacketShmSlot* >( map + SLOTS_OFFSET ) ),
+     m_slotMask( 0 ),
+     m_sequence( 0 )
+{
+}
+
+PacketShmReader::PacketShmReader( uint8_t* map, size_t mapLength )
+   : m_map( map ),
+     m_mapLength( mapLength ),
+     m_header( reinterpret_cast< PacketShmHeader* >( map ) ),
+     m_slots( reinterpret_cast< PacketShmSlot* >( map + SLOTS_OFFSET ) ),
+     m_slotMask( 0 ),
+     m_sequence( 0 ),
+     m_lost( 0 )
+{
+}
+
+pkt_shm_ring_t* pkt_shm_ring_create( size_t capacity )
+{
+   size_t slotCount = 1;
+   while ( slotCount < capacity )
+   {
+      slotCount <<= 1;
+   }
+   int fd = memfd_create( "pktshm", MFD_CLOEXEC );
+   if ( fd < 0 )
+   {
+      return nullptr;
+   }
+   size_t length = mapLength( slotCount );
+   void* map = MAP_FAILED;
+   if ( 0 == ftruncate( fd, length ) )
+   {
+      map = mmap( nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+   }
+   if ( MAP_FAILED == map )
+   {
+      close( fd );
+      return nullptr;
+   }
+
+   // The file starts zeroed, so every slot's sequence number is 0 (never written)
+   auto* ring = new PacketShmRing( fd, static_cast< uint8_t* >( map ), length );
+   ring->m_slotMask = slotCount - 1;
+   ring->m_header->m_version = VERSION;
+   ring->m_header->m_slotCount = static_cast< uint32_t >( slotCount );
+   new ( &ring->m_header->m_published ) std::atomic< uint64_t >( 0 );
+   // Readers check the magic last
+   std::atomic_thread_fence( std::memory_order_release );
+   memcpy( ring->m_header->m_magic, MAGIC, MAGIC_LENGTH );
+   return ring;
+}
+
+void pkt_shm_ring_destroy( pkt_shm_ring_t* ring )
+{
+   munmap( ring->m_map, ring->m_mapLength );
+   close( ring->m_fd );
+   delete ring;
+}
+
+int pkt_shm_ring_fd( const pkt_shm_ring_t* ring )
+{
+   return ring->m_fd;
+}
+
+uint64_t pkt_shm_ring_publish( pkt_shm_ring_t* ring, size_t data_length, const uint8_t* data )
+{
+   if ( data_length > MAX_DECODED_DATA_LENGTH )
+   {
+      return 0;
+   }
+   uint64_t sequence = ++ring->m_sequence;
+   PacketShmSlot& slot = ring->m_slots[ sequence & ring->m_slotMask ];
+   slot.m_sequence.store( sequence | WRITING, std::memory_order_relaxed );
+   std::atomic_thread_fence( std::memory_order_release );
+   slot.m_length = static_cast< uint32_t >( data_length );
+   memcpy( slot.m_data, data, data_length );
+   slot.m_sequence.store( sequence, std::memory_order_release );
+   ring->m_header->m_published.store( sequence, std::memory_order_release );
+   return sequence;
+}
+
+void pkt_shm_ring_publish_packet( void* ring, size_t data_length, const uint8_t* data )
+{
+   pkt_shm_ring_publish( static_cast< pkt_shm_ring_t* >( ring ), data_length, data );
+}
+
+pkt_shm_reader_t* pkt_shm_reader_open( int fd )
+{
+   struct stat info;
+   if ( ( 0 != fstat( fd, &info ) ) || ( static_cast< size_t >( info.st_size ) < SLOTS_OFFSET ) )
+   {
+      return nullptr;
+   }
+   void* map = mmap( nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+   if ( MAP_FAILED == map )
+   {
+      return nullptr;
+   }
+   auto* reader = new PacketShmReader( static_cast< uint8_t* >( map ), info.st_size );
+   const PacketShmHeader* header = reader->m_header;
+   uint32_t slotCount = header->m_slotCount;
+   if ( ( 0 != memcmp( header->m_magic, MAGIC, MAGIC_LENGTH ) ) || ( VERSION != header->m_version )
+        || ( 0 == slotCount ) || ( 0 != ( slotCount & ( slotCount - 1 ) ) )
+        || ( mapLength( slotCount ) > reader->m_mapLength ) )
+   {
+      pkt_shm_reader_close( reader );
+      return nullptr;
+   }
+   reader->m_slotMask = header->m_slotCount - 1;
+   uint64_t published = header->m_published.load( std::memory_order_acquire );
+   reader->m_sequence = ( published > reader->m_slotMask ) ? published - reader->m_slotMask : 1;
+   return reader;
+}
+
+void pkt_shm_reader_close( pkt_shm_reader_t* reader )
+{
+   munmap( reader->m_map, reader->m_mapLength );
+   delete reader;
+}
+
+pkt_shm_result_t pkt_shm_reader_next( pkt_shm_reader_t* reader,
+                                      uint8_t* buffer,
+                                      size_t* data_length,
+                                      uint64_t* sequence )
+{
+   uint64_t published = reader->m_header->m_published.load( std::memory_order_acquire );
+   if ( reader->m_sequence > published )
+   {
+      return PKT_SHM_EMPTY;
+   }
+   if ( published - reader->m_sequence > reader->m_slotMask )
+   {
+      // The slot has been reused since; skip to the oldest packet still in the ring
+      uint64_t oldest = published - reader->m_slotMask;
+      reader->m_lost += oldest - reader->m_sequence;
+      reader->m_sequence = oldest;
+      return PKT_SHM_OVERRUN;
+   }
+
+   const PacketShmSlot& slot = reader->m_slots[ reader->m_sequence & reader->m_slotMask ];
+   uint64_t before = slot.m_sequence.load( std::memory_order_acquire );
+   size_t length = slot.m_length;
+   if ( length > MAX_DECODED_DATA_LENGTH )
+   {
+      length = MAX_DECODED_DATA_LENGTH;
+   }
+   memcpy( buffer, slot.m_data, length );
+   std::atomic_thread_fence( std::memory_order_acquire );
+   uint64_t after = slot.m_sequence.load( std::memory_order_relaxed );
+   if ( ( before != reader->m_sequence ) || ( after != before ) )
+   {
+      // The producer lapped the reader while it was copying. The packet is gone even if the one
+      // replacing it hasn't been published yet
+      uint64_t oldest = reader->m_header->m_published.load( std::memory_order_acquire )
+                        - reader->m_slotMask;
+      if ( oldest <= reader->m_sequence )
+      {
+         oldest = reader->m_sequence + 1;
+      }
+      reader->m_lost += oldest - reader->m_sequence;
+      reader->m_sequence = oldest;
+      return PKT_SHM_OVERRUN;
+   }
+   *data_length = length;
+   *sequence = reader->m_sequence++;
+   return PKT_SHM_PACKET;
+}
+
+uint64_t pkt_shm_reader_lost( const pkt_shm_reader_t* reader )
+{
+   return reader->m_lost;
+}
@@ -0,0 +1,97 @@
+#ifndef PKT_SHM_RING_H_INCLUDED
+#define PKT_SHM_RING_H_INCLUDED
+
+#include "pkt_decoder.h"
+
+// Single-producer, multi-consumer ring of decoded packets in shared memory (a memfd), so one
+// decoder can feed any number of reader processes on the same host. Packets are numbered from 1.
+// The producer never waits for readers: a reader that falls more than the ring's capacity behind
+// is told it was overrun and skips ahead to the oldest packet still in the ring.
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+   class PacketShmRing;
+   class PacketShmReader;
+   struct PacketShmHeader;
+   struct PacketShmSlot;
+
+   typedef struct PacketShmRing pkt_shm_ring_t;
+   typedef struct PacketShmReader pkt_shm_reader_t;
+
+   typedef enum
+   {
+      // A packet was read
+      PKT_SHM_PACKET = 0,
+      // Nothing new has been published
+      PKT_SHM_EMPTY,
+      // Packets were overwritten before they could be read. The reader has moved on to the
+      // oldest packet still in the ring
+      PKT_SHM_OVERRUN
+   } pkt_shm_result_t;
+
+   // Creates a ring holding the last capacity packets (rounded up to a power of two). Returns a
+   // nullptr if the shared memory can't be created
+   PKT_API pkt_shm_ring_t* pkt_shm_ring_create( size_t capacity );
+   // Unmaps and closes the producer's side. Readers keep their own mappings
+   PKT_API void pkt_shm_ring_destroy( pkt_shm_ring_t* ring );
+   // The memfd backing the ring, for readers to map (inherited across fork, passed over a unix
+   // socket, or opened through /proc/<pid>/fd)
+   PKT_API int pkt_shm_ring_fd( const pkt_shm_ring_t* ring );
+   // Publishes one packet and returns its sequence number (from 1), or 0 without publishing
+   // anything if it is longer than MAX_DECODED_DATA_LENGTH bytes
+   PKT_API uint64_t pkt_shm_ring_publish( pkt_shm_ring_t* ring,
+                                          size_t data_length,
+                                          const uint8_t* data );
+   // pkt_read_fn_t adapter, for publishing straight from a decoder (ctx is the ring)
+   PKT_API void pkt_shm_ring_publish_packet( void* ring, size_t data_length, const uint8_t* data );
+
+   // Maps a ring from its memfd, positioned at the oldest packet it holds. The fd can be closed
+   // afterwards. Returns a nullptr if fd isn't a packet ring
+   PKT_API pkt_shm_reader_t* pkt_shm_reader_open( int fd );
+   PKT_API void pkt_shm_reader_close( pkt_shm_reader_t* reader );
+   // Copies the next packet into buffer (MAX_DECODED_DATA_LENGTH bytes) without blocking. Sets
+   // data_length and sequence when it returns PKT_SHM_PACKET
+   PKT_API pkt_shm_result_t pkt_shm_reader_next( pkt_shm_reader_t* reader,
+                                                 uint8_t* buffer,
+                                                 size_t* data_length,
+                                                 uint64_t* sequence );
+   // Number of packets this reader has missed through overruns
+   PKT_API uint64_t pkt_shm_reader_lost( const pkt_shm_reader_t* reader );
+
+   class PacketShmRing
+   {
+    public:
+      PacketShmRing( int, uint8_t*, size_t );
+      virtual ~PacketShmRing() = default;
+
+      int m_fd;
+      uint8_t* m_map;
+      size_t m_mapLength;
+      PacketShmHeader* m_header;
+      PacketShmSlot* m_slots;
+      uint64_t m_slotMask;
+      // Sequence number of the last packet published
+      uint64_t m_sequence;
+   };
+
+   class PacketShmReader
+   {
+    public:
+      PacketShmReader( uint8_t*, size_t );
+      virtual ~PacketShmReader() = default;
+
+      uint8_t* m_map;
+      size_t m_mapLength;
+      PacketShmHeader* m_header;
+      PacketShmSlot* m_slots;
+      uint64_t m_slotMask;
+      // Sequence number of the next packet to read
+      uint64_t m_sequence;
+      uint64_t m_lost;
+   };
+
+#ifdef __cplusplus
+}
+#endif
+#endif // PKT_SHM_RING_H_INCLUDED
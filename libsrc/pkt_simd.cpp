@@ -0,0 +1,402 @@
+#include "pkt_simd.h"
+
+#include "pkt_decoder.h"
+
+#include <cstring>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#define PKT_HAVE_X86 ( 1 )
+#endif
+
+namespace
+{
+   const uint64_t ONES( 0x0101010101010101ULL );
+   const uint64_t HIGHS( 0x8080808080808080ULL );
+
+   // The high bit of every byte of word that is STX, ETX or DLE is set. Bytes above the first
+   // match can be set spuriously, so only the lowest set bit is meaningful
+   uint64_t controlBytes( uint64_t word )
+   {
+      // STX and ETX differ only in their low bit
+      uint64_t stxEtx = ( word & ~ONES ) ^ ( ONES * STX );
+      uint64_t dle = word ^ ( ONES * DLE );
+      return ( ( ( stxEtx - ONES ) & ~stxEtx ) | ( ( dle - ONES ) & ~dle ) ) & HIGHS;
+   }
+
+   size_t findControlScalar( size_t len, const uint8_t* data )
+   {
+      size_t idx = 0;
+#if defined( __BYTE_ORDER__ ) && ( __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ )
+      for ( ; idx + sizeof( uint64_t ) <= len; idx += sizeof( uint64_t ) )
+      {
+         uint64_t word;
+         memcpy( &word, data + idx, sizeof( word ) );
+         uint64_t matches = controlBytes( word );
+         if ( 0 != matches )
+         {
+            return idx + __builtin_ctzll( matches ) / 8;
+         }
+      }
+#endif
+      for ( ; idx < len; ++idx )
+      {
+         if ( ( STX == data[ idx ] ) || ( ETX == data[ idx ] ) || ( DLE == data[ idx ] ) )
+         {
+            break;
+         }
+      }
+      return idx;
+   }
+
+   // The high bit of every byte of word that equals value is set, and no other bit
+   uint64_t equalBytes( uint64_t word, uint8_t value )
+   {
+      const uint64_t lows = ~HIGHS;
+      uint64_t diff = word ^ ( ONES * value );
+      return ~( ( ( diff & lows ) + lows ) | diff ) & HIGHS;
+   }
+
+   // Packs the high bit of each byte of matches into a byte, byte 0 lowest
+   uint64_t packHighBits( uint64_t matches )
+   {
+      return ( ( matches >> 7 ) * 0x0102040810204080ULL ) >> 56;
+   }
+
+   // Fills the bitmaps a 64-byte word at a time. The tail is copied into a zeroed word first (0
+   // isn't a control byte), so no kernel reads past the end of data. Always inlined, so each
+   // level's copy is built for its target and inlines its word kernel
+   template < void ( *wordMasks )( const uint8_t*, uint64_t*, uint64_t*, uint64_t* ) >
+   inline __attribute__( ( always_inline ) ) void
+   controlBitmaps( size_t len, const uint8_t* data, uint64_t* stx, uint64_t* etx, uint64_t* dle )
+   {
+      size_t word = 0;
+      for ( ; ( word + 1 ) * 64 <= len; ++word )
+      {
+         wordMasks( data + word * 64, stx + word, etx + word, dle + word );
+      }
+      if ( word * 64 < len )
+      {
+         uint8_t tail[ 64 ] = {};
+         memcpy( tail, data + word * 64, len - word * 64 );
+         wordMasks( tail, stx + word, etx + word, dle + word );
+      }
+   }
+
+   void wordMasksScalar( const uint8_t* data, uint64_t* stx, uint64_t* etx, uint64_t* dle )
+   {
+      uint64_t stxBits = 0;
+      uint64_t etxBits = 0;
+      uint64_t dleBits = 0;
+#if defined( __BYTE_ORDER__ ) && ( __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ )
+      for ( size_t idx = 0; idx < 64; idx += sizeof( uint64_t ) )
+      {
+         uint64_t word;
+         memcpy( &word, data + idx, sizeof( word ) );
+         stxBits |= packHighBits( equalBytes( word, STX ) ) << idx;
+         etxBits |= packHighBits( equalBytes( word, ETX ) ) << idx;
+         dleBits |= packHighBits( equalBytes( word, DLE ) ) << idx;
+      }
+#else
+      for ( size_t idx = 0; idx < 64; ++idx )
+      {
+         stxBits |= uint64_t( STX == data[ idx ] ) << idx;
+         etxBits |= uint64_t( ETX == data[ idx ] ) << idx;
+         dleBits |= uint64_t( DLE == data[ idx ] ) << idx;
+      }
+#endif
+      *stx = stxBits;
+      *etx = etxBits;
+      *dle = dleBits;
+   }
+
+#ifdef PKT_HAVE_X86
+   __attribute__( ( target( "sse2" ) ) ) size_t findControlSse2( size_t len, const uint8_t* data )
+   {
+      const __m128i stxEtx = _mm_set1_epi8( STX | ETX );
+      const __m128i dle = _mm_set1_epi8( DLE );
+      const __m128i lowBit = _mm_set1_epi8( STX ^ ETX );
+      size_t idx = 0;
+      for ( ; idx + sizeof( __m128i ) <= len; idx += sizeof( __m128i ) )
+      {
+         __m128i bytes = _mm_loadu_si128( reinterpret_cast< const __m128i* >( data + idx ) );
+         int matches = _mm_movemask_epi8(
+            _mm_or_si128( _mm_cmpeq_epi8( _mm_or_si128( bytes, lowBit ), stxEtx ),
+                          _mm_cmpeq_epi8( bytes, dle ) ) );
+         if ( 0 != matches )
+         {
+            return idx + __builtin_ctz( matches );
+         }
+      }
+      return idx + findControlScalar( len - idx, data + idx );
+   }
+
+   __attribute__( ( target( "avx2" ) ) ) size_t findControlAvx2( size_t len, const uint8_t* data )
+   {
+      const __m256i stxEtx = _mm256_set1_epi8( STX | ETX );
+      const __m256i dle = _mm256_set1_epi8( DLE );
+      const __m256i lowBit = _mm256_set1_epi8( STX ^ ETX );
+      size_t idx = 0;
+      for ( ; idx + sizeof( __m256i ) <= len; idx += sizeof( __m256i ) )
+      {
+         __m256i bytes = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( data + idx ) );
+         uint32_t matches = static_cast< uint32_t >( _mm256_movemask_epi8(
+            _mm256_or_si256( _mm256_cmpeq_epi8( _mm256_or_si256( bytes, lowBit ), stxEtx ),
+                             _mm256_cmpeq_epi8( bytes, dle ) ) ) );
+         if ( 0 != matches )
+         {
+            return idx + __builtin_ctz( matches );
+         }
+      }
+      return idx + findControlSse2( len - idx, data + idx );
+   }
+
+   __attribute__( ( target( "avx512f,avx512bw" ) ) ) size_t findControlAvx512( size_t len,
+                                                                              const uint8_t* data )
+   {
+      const __m512i stxEtx = _mm512_set1_epi8( STX | ETX );
+      const __m512i dle = _mm512_set1_epi8( DLE );
+      const __m512i lowBit = _mm512_set1_epi8( STX ^ ETX );
+      for ( size_t idx = 0; idx < len; idx += sizeof( __m512i ) )
+      {
+         // The last block is loaded masked, so it can't fault past the end of data
+         __mmask64 valid = ( len - idx >= sizeof( __m512i ) ) ? ~0ULL
+                                                             : ( 1ULL << ( len - idx ) ) - 1;
+         __m512i bytes = _mm512_maskz_loadu_epi8( valid, data + idx );
+         __mmask64 matches =
+            _mm512_mask_cmpeq_epi8_mask( valid, _mm512_or_si512( bytes, lowBit ), stxEtx )
+            | _mm512_mask_cmpeq_epi8_mask( valid, bytes, dle );
+         if ( 0 != matches )
+         {
+            return idx + __builtin_ctzll( matches );
+         }
+      }
+      return len;
+   }
+
+   __attribute__( ( target( "sse2" ) ) ) void wordMasksSse2( const uint8_t* data,
+                                                             uint64_t* stx,
+                                                             uint64_t* etx,
+                                                             uint64_t* dle )
+   {
+      uint64_t stxBits = 0;
+      uint64_t etxBits = 0;
+      uint64_t dleBits = 0;
+      for ( size_t idx = 0; idx < 64; idx += sizeof( __m128i ) )
+      {
+         __m128i bytes = _mm_loadu_si128( reinterpret_cast< const __m128i* >( data + idx ) );
+         stxBits |= static_cast< uint64_t >( static_cast< uint16_t >(
+                       _mm_movemask_epi8( _mm_cmpeq_epi8( bytes, _mm_set1_epi8( STX ) ) ) ) )
+                    << idx;
+         etxBits |= static_cast< uint64_t >( static_cast< uint16_t >(
+                       _mm_movemask_epi8( _mm_cmpeq_epi8( bytes, _mm_set1_epi8( ETX ) ) ) ) )
+                    << idx;
+         dleBits |= static_cast< uint64_t >( static_cast< uint16_t >(
+                       _mm_movemask_epi8( _mm_cmpeq_epi8( bytes, _mm_set1_epi8( DLE ) ) ) ) )
+                    << idx;
+      }
+      *stx = stxBits;
+      *etx = etxBits;
+      *dle = dleBits;
+   }
+
+   __attribute__( ( target( "avx2" ) ) ) void wordMasksAvx2( const uint8_t* data,
+                                                             uint64_t* stx,
+                                                             uint64_t* etx,
+                                                             uint64_t* dle )
+   {
+      __m256i low = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( data ) );
+      __m256i high = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( data + 32 ) );
+      uint64_t* const out[] = { stx, etx, dle };
+      const uint8_t values[] = { STX, ETX, DLE };
+      for ( size_t which = 0; which < 3; ++which )
+      {
+         __m256i value = _mm256_set1_epi8( static_cast< char >( values[ which ] ) );
+         uint32_t lowBits =
+            static_cast< uint32_t >( _mm256_movemask_epi8( _mm256_cmpeq_epi8( low, value ) ) );
+         uint32_t highBits =
+            static_cast< uint32_t >( _mm256_movemask_epi8( _mm256_cmpeq_epi8( high, value ) ) );
+         *out[ which ] = ( static_cast< uint64_t >( highBits ) << 32 ) | lowBits;
+      }
+   }
+
+   __attribute__( ( target( "avx512f,avx512bw" ) ) ) void wordMasksAvx512( const uint8_t* data,
+                                                                           uint64_t* stx,
+                                                                           uint64_t* etx,
+                                                                           uint64_t* dle )
+   {
+      __m512i bytes = _mm512_loadu_si512( data );
+      *stx = _mm512_cmpeq_epi8_mask( bytes, _mm512_set1_epi8( STX ) );
+      *etx = _mm512_cmpeq_epi8_mask( bytes, _mm512_set1_epi8( ETX ) );
+      *dle = _mm512_cmpeq_epi8_mask( bytes, _mm512_set1_epi8( DLE ) );
+   }
+
+   __attribute__( ( target( "sse2" ) ) ) void controlBitmapsSse2(
+      size_t len, const uint8_t* data, uint64_t* stx, uint64_t* etx, uint64_t* dle )
+   {
+      controlBitmaps< wordMasksSse2 >( len, data, stx, etx, dle );
+   }
+
+   __attribute__( ( target( "avx2" ) ) ) void controlBitmapsAvx2(
+      size_t len, const uint8_t* data, uint64_t* stx, uint64_t* etx, uint64_t* dle )
+   {
+      controlBitmaps< wordMasksAvx2 >( len, data, stx, etx, dle );
+   }
+
+   __attribute__( ( target( "avx512f,avx512bw" ) ) ) void controlBitmapsAvx512(
+      size_t len, const uint8_t* data, uint64_t* stx, uint64_t* etx, uint64_t* dle )
+   {
+      controlBitmaps< wordMasksAvx512 >( len, data, stx, etx, dle );
+   }
+#endif
+
+   void controlBitmapsScalar(
+      size_t len, const uint8_t* data, uint64_t* stx, uint64_t* etx, uint64_t* dle )
+   {
+      controlBitmaps< wordMasksScalar >( len, data, stx, etx, dle );
+   }
+
+   const pkt_find_control_fn_t FIND_CONTROL[] = {
+      findControlScalar,
+#ifdef PKT_HAVE_X86
+      findControlSse2,
+      findControlAvx2,
+      findControlAvx512,
+#endif
+   };
+
+   const pkt_control_bitmaps_fn_t CONTROL_BITMAPS[] = {
+      controlBitmapsScalar,
+#ifdef PKT_HAVE_X86
+      controlBitmapsSse2,
+      controlBitmapsAvx2,
+      controlBitmapsAvx512,
+#endif
+   };
+
+   bool cpuSupports( pkt_simd_level_t level )
+   {
+#ifdef PKT_HAVE_X86
+      // This runs during static initialization, possibly before libgcc has probed the CPU
+      __builtin_cpu_init();
+      switch ( level )
+      {
+         case PKT_SIMD_SCALAR: {
+            return true;
+         }
+         case PKT_SIMD_SSE2: {
+            return __builtin_cpu_supports( "sse2" );
+         }
+         case PKT_SIMD_AVX2: {
+            return __builtin_cpu_supports( "avx2" );
+         }
+         case PKT_SIMD_AVX512: {
+            return __builtin_cpu_supports( "avx512f" ) && __builtin_cpu_supports( "avx512bw" );
+         }
+      }
+      return false;
+#else
+      return PKT_SIMD_SCALAR == level;
+#endif
+   }
+
+   pkt_simd_level_t selectLevel()
+   {
+      pkt_simd_level_t level = PKT_SIMD_SCALAR;
+      const char* cap = getenv( "PKT_SIMD" );
+      for ( int next = PKT_SIMD_SSE2; next <= PKT_SIMD_AVX512; ++next )
+      {
+         if ( !pkt_simd_supported( static_cast< pkt_simd_level_t >( next ) ) )
+         {
+            break;
+         }
+         if ( ( nullptr != cap ) && ( 0 == strcmp( cap, pkt_simd_level_name( level ) ) ) )
+         {
+            break;
+         }
+         level = static_cast< pkt_simd_level_t >( next );
+      }
+      return level;
+   }
+
+   pkt_simd_level_t selectedLevel()
+   {
+      static const pkt_simd_level_t LEVEL = selectLevel();
+      return LEVEL;
+   }
+
+   // Stands in for the kernel until the first call (or the library's static initialization)
+   // resolves it, so decoders used by other static initializers still work
+   size_t resolveFindControl( size_t len, const uint8_t* data )
+   {
+      pktFindControl = FIND_CONTROL[ selectedLevel() ];
+      return pktFindControl( len, data );
+   }
+
+   void resolveControlBitmaps(
+      size_t len, const uint8_t* data, uint64_t* stx, uint64_t* etx, uint64_t* dle )
+   {
+      pktControlBitmaps = CONTROL_BITMAPS[ selectedLevel() ];
+      pktControlBitmaps( len, data, stx, etx, dle );
+   }
+
+   // Resolved once, when the library is loaded
+   struct ResolveAtLoad
+   {
+      ResolveAtLoad()
+      {
+         pktFindControl = FIND_CONTROL[ selectedLevel() ];
+         pktControlBitmaps = CONTROL_BITMAPS[ selectedLevel() ];
+      }
+   } resolveAtLoad;
+} // namespace
+
+pkt_find_control_fn_t pktFindControl = resolveFindControl;
+pkt_control_bitmaps_fn_t pktControlBitmaps = resolveControlBitmaps;
+
+pkt_simd_level_t pkt_simd_level( void )
+{
+   return selectedLevel();
+}
+
+bool pkt_simd_supported( pkt_simd_level_t level )
+{
+   const size_t built = sizeof( FIND_CONTROL ) / sizeof( FIND_CONTROL[ 0 ] );
+   return ( level >= PKT_SIMD_SCALAR ) && ( static_cast< size_t >( level ) < built )
+          && cpuSupports( level );
+}
+
+const char* pkt_simd_level_name( pkt_simd_level_t level )
+{
+   switch ( level )
+   {
+      case PKT_SIMD_SCALAR: {
+         return "scalar";
+      }
+      case PKT_SIMD_SSE2: {
+         return "sse2";
+      }
+      case PKT_SIMD_AVX2: {
+         return "avx2";
+      }
+      case PKT_SIMD_AVX512: {
+         return "avx512";
+      }
+   }
+   return "unknown";
+}
+
+size_t pkt_simd_find_control( pkt_simd_level_t level, size_t len, const uint8_t* data )
+{
+   return FIND_CONTROL[ level ]( len, data );
+}
+
+void pkt_simd_control_bitmaps( pkt_simd_level_t level,
+                               size_t len,
+                               const uint8_t* data,
+                               uint64_t* stx,
+                               uint64_t* etx,
+                               uint64_t* dle )
+{
+   CONTROL_BITMAPS[ level ]( len, data, stx, etx, dle );
+}
@@ -0,0 +1,54 @@
+#ifndef PKT_SIMD_H_INCLUDED
+#define PKT_SIMD_H_INCLUDED
+
+#include "pkt_api.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+   // Instruction sets the decoders' kernels are built for. The library holds every variant its
+   // target supports and picks the best one the CPU has once, when it is loaded. Setting the
+   // environment variable PKT_SIMD to a level's name caps the choice at that level
+   typedef enum
+   {
+      // Portable code, eight bytes at a time
+      PKT_SIMD_SCALAR = 0,
+      PKT_SIMD_SSE2,
+      PKT_SIMD_AVX2,
+      PKT_SIMD_AVX512
+   } pkt_simd_level_t;
+
+   // The level the decoders are running at
+   PKT_API pkt_simd_level_t pkt_simd_level( void );
+   // Whether this CPU (and this build of the library) can run level
+   PKT_API bool pkt_simd_supported( pkt_simd_level_t level );
+   // "scalar", "sse2", "avx2" or "avx512"
+   PKT_API const char* pkt_simd_level_name( pkt_simd_level_t level );
+   // Returns the index of the first STX, ETX or DLE in data, or len if there isn't one, using
+   // level's kernel. level must be supported
+   PKT_API size_t pkt_simd_find_control( pkt_simd_level_t level, size_t len, const uint8_t* data );
+   // Marks where the STX, ETX and DLE bytes in data are, using level's kernel: bit ( idx % 64 )
+   // of word ( idx / 64 ) of stx is set if data[ idx ] is STX, and likewise for etx and dle. Each
+   // bitmap gets ( len + 63 ) / 64 words, and bits past len are clear. level must be supported
+   PKT_API void pkt_simd_control_bitmaps( pkt_simd_level_t level,
+                                          size_t len,
+                                          const uint8_t* data,
+                                          uint64_t* stx,
+                                          uint64_t* etx,
+                                          uint64_t* dle );
+
+   // The selected level's kernels, for the decoders
+   typedef size_t ( *pkt_find_control_fn_t )( size_t len, const uint8_t* data );
+   extern pkt_find_control_fn_t pktFindControl;
+   typedef void ( *pkt_control_bitmaps_fn_t )(
+      size_t len, const uint8_t* data, uint64_t* stx, uint64_t* etx, uint64_t* dle );
+   extern pkt_control_bitmaps_fn_t pktControlBitmaps;
+
+#ifdef __cplusplus
+}
+#endif
+#endif // PKT_SIMD_H_INCLUDED
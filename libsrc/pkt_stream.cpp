@@ -0,0 +1,133 @@
+#include "pkt_stream.h"
+
+#include <cerrno>
+#include <unistd.h>
+
+namespace
+{
+   void queuePacket( void* ctx, size_t length, const uint8_t* data )
+   {
+      auto* decoder = static_cast< PacketStreamDecoder* >( ctx );
+      // Keep the packet in the arena until the consumer has seen it, instead of copying it
+      pkt_arena_retain( decoder->m_arena, data );
+      decoder->m_ready.push_back( { length, data } );
+   }
+} // namespace
+
+PacketStreamDecoder::PacketStreamDecoder()
+   : m_arena( pkt_arena_create( PKT_ARENA_DEFAULT_CHUNK_SIZE ) ),
+     m_decoder( pkt_decoder_create_arena( queuePacket, this, m_arena ) )
+{
+}
+
+PacketStreamDecoder::~PacketStreamDecoder()
+{
+   while ( !m_ready.empty() )
+   {
+      pop();
+   }
+   pkt_decoder_destroy( m_decoder );
+   pkt_arena_destroy( m_arena );
+}
+
+void PacketStreamDecoder::write( size_t length, const uint8_t* data )
+{
+   pkt_decoder_write_bytes( m_decoder, length, data );
+}
+
+void PacketStreamDecoder::pop()
+{
+   pkt_arena_release( m_arena, m_ready.front().m_data );
+   m_ready.pop_front();
+}
+
+void PacketEventLoop::waitReadable( int fd, std::coroutine_handle<> waiter )
+{
+   m_fds.push_back( { fd, POLLIN, 0 } );
+   m_waiters.push_back( waiter );
+}
+
+bool PacketEventLoop::runOnce( int timeoutMs )
+{
+   if ( m_fds.empty() )
+   {
+      return false;
+   }
+   if ( poll( m_fds.data(), m_fds.size(), timeoutMs ) <= 0 )
+   {
+      return true;
+   }
+   // Take the ready waiters out first: resuming them may register new ones
+   std::vector< std::coroutine_handle<> > ready;
+   for ( size_t idx = 0; idx < m_fds.size(); )
+   {
+      if ( 0 != m_fds[ idx ].revents )
+      {
+         ready.push_back( m_waiters[ idx ] );
+         m_fds.erase( m_fds.begin() + idx );
+         m_waiters.erase( m_waiters.begin() + idx );
+      }
+      else
+      {
+         ++idx;
+      }
+   }
+   for ( std::coroutine_handle<> waiter : ready )
+   {
+      waiter.resume();
+   }
+   return true;
+}
+
+void PacketEventLoop::run()
+{
+   while ( runOnce( -1 ) )
+   {
+   }
+}
+
+PacketFdSource::PacketFdSource( int fd, PacketEventLoop& loop )
+   : m_fd( fd ),
+     m_loop( loop ),
+     m_error( 0 )
+{
+}
+
+bool PacketFdSource::ReadAwaiter::await_ready()
+{
+   ssize_t count;
+   do
+   {
+      count = ::read( m_source->m_fd, m_buffer, m_length );
+   } while ( ( count < 0 ) && ( EINTR == errno ) );
+   if ( count >= 0 )
+   {
+      m_result = count;
+      return true;
+   }
+   if ( ( EAGAIN == errno ) || ( EWOULDBLOCK == errno ) )
+   {
+      return false;
+   }
+   m_source->m_error = errno;
+   m_result = 0;
+   return true;
+}
+
+void PacketFdSource::ReadAwaiter::await_suspend( std::coroutine_handle<> reader )
+{
+   m_waited = true;
+   m_source->m_loop.waitReadable( m_source->m_fd, reader );
+}
+
+size_t PacketFdSource::ReadAwaiter::await_resume()
+{
+   // Resumed by the loop because the fd polled readable, but another reader may have drained it
+   // first, or the readiness may have been spurious (as it can be for UDP). Rather than spin,
+   // and stall every other coroutine on the loop, let the stream wait again
+   if ( m_waited && !await_ready() )
+   {
+      return PKT_STREAM_WOULD_BLOCK;
+   }
+   return m_result;
+}
@@ -0,0 +1,271 @@
+#ifndef PKT_STREAM_H_INCLUDED
+#define PKT_STREAM_H_INCLUDED
+
+#include "pkt_decoder.h"
+
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <poll.h>
+#include <vector>
+
+// C++20 coroutine interface to the decoder: pkt_decode_stream reads bytes from an awaitable
+// source and yields each decoded packet to a consumer that co_awaits it, on the consumer's own
+// thread. Unlike the rest of the library this header is C++ only, and needs C++20.
+//
+// A source is any object with a read( uint8_t* buffer, size_t length ) method returning an
+// awaitable that produces the number of bytes read, 0 at the end of the stream, or
+// PKT_STREAM_WOULD_BLOCK if it found nothing to read after all, in which case the stream reads
+// again.
+
+#define PKT_STREAM_WOULD_BLOCK ( SIZE_MAX )
+
+// A decoded packet. It points into the stream's arena and stays valid until the consumer next
+// awaits the stream
+struct PacketView
+{
+   size_t m_length;
+   const uint8_t* m_data;
+};
+
+// Arena decoder that queues retained packets for a stream to yield
+class PacketStreamDecoder
+{
+ public:
+   PacketStreamDecoder();
+   virtual ~PacketStreamDecoder();
+   void write( size_t length, const uint8_t* data );
+   // Releases the oldest queued packet
+   void pop();
+
+   pkt_arena_t* m_arena;
+   pkt_decoder_t* m_decoder;
+   std::deque< PacketView > m_ready;
+};
+
+// Return type of pkt_decode_stream. co_await next() resumes the decoding coroutine until it
+// yields a packet, and returns it, or a nullptr once the source is exhausted
+class PacketStream
+{
+ public:
+   struct promise_type;
+   typedef std::coroutine_handle< promise_type > handle_type;
+
+   // Hands control back to the consumer when a packet is ready or the stream ends
+   struct ResumeConsumer
+   {
+      bool await_ready() noexcept
+      {
+         return false;
+      }
+      std::coroutine_handle<> await_suspend( handle_type producer ) noexcept
+      {
+         return producer.promise().m_consumer;
+      }
+      void await_resume() noexcept
+      {
+      }
+   };
+
+   struct promise_type
+   {
+      PacketView m_current;
+      std::coroutine_handle<> m_consumer;
+
+      PacketStream get_return_object()
+      {
+         return PacketStream( handle_type::from_promise( *this ) );
+      }
+      std::suspend_always initial_suspend() noexcept
+      {
+         return {};
+      }
+      ResumeConsumer final_suspend() noexcept
+      {
+         return {};
+      }
+      ResumeConsumer yield_value( const PacketView& packet ) noexcept
+      {
+         m_current = packet;
+         return {};
+      }
+      void return_void()
+      {
+      }
+      void unhandled_exception()
+      {
+         std::terminate();
+      }
+   };
+
+   struct NextPacket
+   {
+      handle_type m_producer;
+
+      bool await_ready()
+      {
+         return m_producer.done();
+      }
+      std::coroutine_handle<> await_suspend( std::coroutine_handle<> consumer )
+      {
+         m_producer.promise().m_consumer = consumer;
+         return m_producer;
+      }
+      const PacketView* await_resume()
+      {
+         return m_producer.done() ? nullptr : &m_producer.promise().m_current;
+      }
+   };
+
+   explicit PacketStream( handle_type handle ) : m_handle( handle )
+   {
+   }
+   PacketStream( PacketStream&& other ) noexcept : m_handle( other.m_handle )
+   {
+      other.m_handle = nullptr;
+   }
+   PacketStream( const PacketStream& ) = delete;
+   PacketStream& operator=( const PacketStream& ) = delete;
+   virtual ~PacketStream()
+   {
+      if ( m_handle )
+      {
+         m_handle.destroy();
+      }
+   }
+   NextPacket next()
+   {
+      return { m_handle };
+   }
+
+   handle_type m_handle;
+};
+
+// Decodes source, read_size bytes at a time, yielding every packet
+template < typename Source >
+PacketStream pkt_decode_stream( Source& source, size_t read_size = 64 * 1024 )
+{
+   PacketStreamDecoder decoder;
+   std::vector< uint8_t > buffer( read_size );
+   while ( true )
+   {
+      size_t length = co_await source.read( buffer.data(), buffer.size() );
+      if ( PKT_STREAM_WOULD_BLOCK == length )
+      {
+         continue;
+      }
+      if ( 0 == length )
+      {
+         co_return;
+      }
+      decoder.write( length, buffer.data() );
+      while ( !decoder.m_ready.empty() )
+      {
+         co_yield decoder.m_ready.front();
+         decoder.pop();
+      }
+   }
+}
+
+// Eagerly started coroutine for consumers, which can be checked for completion
+class PacketTask
+{
+ public:
+   struct promise_type
+   {
+      PacketTask get_return_object()
+      {
+         return PacketTask( std::coroutine_handle< promise_type >::from_promise( *this ) );
+      }
+      std::suspend_never initial_suspend() noexcept
+      {
+         return {};
+      }
+      std::suspend_always final_suspend() noexcept
+      {
+         return {};
+      }
+      void return_void()
+      {
+      }
+      void unhandled_exception()
+      {
+         std::terminate();
+      }
+   };
+
+   explicit PacketTask( std::coroutine_handle< promise_type > handle ) : m_handle( handle )
+   {
+   }
+   PacketTask( PacketTask&& other ) noexcept : m_handle( other.m_handle )
+   {
+      other.m_handle = nullptr;
+   }
+   PacketTask( const PacketTask& ) = delete;
+   PacketTask& operator=( const PacketTask& ) = delete;
+   virtual ~PacketTask()
+   {
+      if ( m_handle )
+      {
+         m_handle.destroy();
+      }
+   }
+   bool done() const
+   {
+      return m_handle.done();
+   }
+
+   std::coroutine_handle< promise_type > m_handle;
+};
+
+// Minimal poll() loop that resumes coroutines waiting for their fd to become readable
+class PacketEventLoop
+{
+ public:
+   PacketEventLoop() = default;
+   virtual ~PacketEventLoop() = default;
+   void waitReadable( int fd, std::coroutine_handle<> waiter );
+   // Waits up to timeoutMs for a waiting fd to become readable and resumes its coroutine.
+   // Returns false if nothing is waiting
+   bool runOnce( int timeoutMs );
+   // Runs until nothing is waiting
+   void run();
+
+   std::vector< pollfd > m_fds;
+   std::vector< std::coroutine_handle<> > m_waiters;
+};
+
+// Source that reads a non-blocking fd, waiting on loop whenever it has nothing to read. Reads
+// interrupted by a signal are retried; other read errors end the stream, with errno saved in
+// m_error. Coroutines sharing an fd each get whichever reads they win
+class PacketFdSource
+{
+ public:
+   struct ReadAwaiter
+   {
+      PacketFdSource* m_source;
+      uint8_t* m_buffer;
+      size_t m_length;
+      size_t m_result;
+      bool m_waited;
+
+      // Reads straight away if the fd has data, or is at the end or in error
+      bool await_ready();
+      void await_suspend( std::coroutine_handle<> reader );
+      size_t await_resume();
+   };
+
+   PacketFdSource( int fd, PacketEventLoop& loop );
+   virtual ~PacketFdSource() = default;
+   ReadAwaiter read( uint8_t* buffer, size_t length )
+   {
+      return { this, buffer, length, 0, false };
+   }
+
+   int m_fd;
+   PacketEventLoop& m_loop;
+   int m_error;
+};
+
+#endif // PKT_STREAM_H_INCLUDED
@@ -0,0 +1,39 @@
+# Runs the PGO training workload and puts the profile where pktdecoder's compiles will find it.
+# Invoked with cmake -P by the pktdecoder_profile target
+
+# Counts from an earlier training run would otherwise be added to this one
+file( GLOB_RECURSE OLD_PROFILES ${PROFILE_DIR}/*.gcda ${PROFILE_DIR}/*.profraw )
+if ( OLD_PROFILES )
+   file( REMOVE ${OLD_PROFILES} )
+endif ()
+
+if ( COMPILER_ID STREQUAL "GNU" )
+   execute_process( COMMAND ${TRAINER} RESULT_VARIABLE RESULT )
+else ()
+   file( MAKE_DIRECTORY ${PROFILE_DIR} )
+   execute_process( COMMAND ${CMAKE_COMMAND} -E env
+                          LLVM_PROFILE_FILE=${PROFILE_DIR}/train-%p.profraw ${TRAINER}
+                    RESULT_VARIABLE RESULT )
+endif ()
+if ( NOT RESULT EQUAL 0 )
+   message( FATAL_ERROR "PGO training run failed: ${RESULT}" )
+endif ()
+
+file( MAKE_DIRECTORY ${PROFILE_USE_DIR} )
+if ( COMPILER_ID STREQUAL "GNU" )
+   # GCC looks for each object's profile next to the object, under the source file's name
+   file( GLOB_RECURSE PROFILES ${PROFILE_DIR}/*.gcda )
+   file( COPY ${PROFILES} DESTINATION ${PROFILE_USE_DIR} )
+   # The shared library's objects (if it is built) sit in a directory of their own
+   file( MAKE_DIRECTORY ${SHARED_PROFILE_USE_DIR} )
+   file( COPY ${PROFILES} DESTINATION ${SHARED_PROFILE_USE_DIR} )
+else ()
+   file( GLOB PROFILES ${PROFILE_DIR}/*.profraw )
+   execute_process( COMMAND ${LLVM_PROFDATA} merge -o ${PROFILE_USE_DIR}/pktdecoder.profdata
+                          ${PROFILES}
+                    RESULT_VARIABLE RESULT )
+   if ( NOT RESULT EQUAL 0 )
+      message( FATAL_ERROR "llvm-profdata failed: ${RESULT}" )
+   endif ()
+endif ()
+file( WRITE ${STAMP} "" )
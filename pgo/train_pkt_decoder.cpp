@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <libsrc/cobs_decoder.h>
+#include <libsrc/pkt_decoder.h>
+#include <random>
+#include <vector>
+
+// Training workload for the profile-guided build (PKT_PGO). It pushes a representative mix of
+// traffic through the library so the profile reflects where the branches really go: frame sizes
+// from 1 to 512 bytes, escape densities from none to heavy, writes split anywhere from one byte to
+// 4 KiB, line noise between frames, and the occasional checksum failure, overflow and COBS link.
+
+// Shape of one slice of the training traffic
+struct TrainingMix
+{
+   size_t minPayload;
+   size_t maxPayload;
+   double escapeRate;
+   double garbageRatio;
+   pkt_checksum_t checksum;
+   // Relative share of the total training bytes
+   size_t weight;
+};
+
+static const TrainingMix MIXES[] = {
+   { 8, 32, 0.0, 0.0, PKT_CHECKSUM_NONE, 4 },
+   { 8, 32, 0.05, 0.0, PKT_CHECKSUM_NONE, 3 },
+   { 1, 512, 0.01, 0.0, PKT_CHECKSUM_NONE, 4 },
+   { 512, 512, 0.0, 0.0, PKT_CHECKSUM_NONE, 2 },
+   { 512, 512, 0.05, 0.0, PKT_CHECKSUM_NONE, 2 },
+   { 1, 512, 0.25, 0.0, PKT_CHECKSUM_NONE, 1 },
+   { 1, 512, 0.01, 0.5, PKT_CHECKSUM_NONE, 1 },
+   { 8, 32, 0.01, 0.9, PKT_CHECKSUM_NONE, 1 },
+   { 1, 508, 0.01, 0.0, PKT_CHECKSUM_CRC16_CCITT, 1 },
+   { 1, 508, 0.01, 0.0, PKT_CHECKSUM_CRC32C, 1 },
+};
+
+// Payload bytes per unit of weight
+static const size_t BYTES_PER_WEIGHT( 2 * 1024 * 1024 );
+
+static void countPacket( void* ctx, size_t data_length, const uint8_t* data )
+{
+   ( void )data;
+   *static_cast< size_t* >( ctx ) += data_length;
+}
+
+static void dleFrame( const std::vector< uint8_t >& payload, std::vector< uint8_t >& stream )
+{
+   stream.push_back( STX );
+   for ( uint8_t byte : payload )
+   {
+      if ( STX == byte || ETX == byte || DLE == byte )
+      {
+         stream.push_back( DLE );
+         byte |= ENC;
+      }
+      stream.push_back( byte );
+   }
+   stream.push_back( ETX );
+}
+
+int main()
+{
+   std::mt19937 rng( 0x7a1 );
+   std::uniform_int_distribution< int > byteDist( 0x00, 0xFF );
+   // Mostly large writes, with a long tail of small ones
+   std::uniform_int_distribution< size_t > smallChunkDist( 1, 64 );
+   std::bernoulli_distribution smallChunk( 0.2 );
+   const uint8_t SPECIALS[] = { STX, ETX, DLE, COBS_DELIMITER };
+   size_t decoded = 0;
+
+   for ( const TrainingMix& mix : MIXES )
+   {
+      std::uniform_int_distribution< size_t > sizeDist( mix.minPayload, mix.maxPayload );
+      std::bernoulli_distribution escapeDist( mix.escapeRate );
+      std::bernoulli_distribution corruptDist( 0.01 );
+      std::vector< uint8_t > dle;
+      std::vector< uint8_t > cobs;
+      std::vector< uint8_t > payload;
+      size_t total = 0;
+      while ( total < mix.weight * BYTES_PER_WEIGHT )
+      {
+         payload.resize( sizeDist( rng ) );
+         for ( uint8_t& byte : payload )
+         {
+            byte = escapeDist( rng ) ? SPECIALS[ rng() % sizeof( SPECIALS ) ]
+                                     : static_cast< uint8_t >( 0x40 + byteDist( rng ) % 0xC0 );
+         }
+         total += payload.size();
+         if ( PKT_CHECKSUM_NONE != mix.checksum )
+         {
+            uint8_t trailer[ PKT_MAX_CHECKSUM_LENGTH ];
+            size_t trailerLength =
+               pkt_checksum_append( mix.checksum, payload.size(), payload.data(), trailer );
+            payload.insert( payload.end(), trailer, trailer + trailerLength );
+            if ( corruptDist( rng ) )
+            {
+               payload[ 0 ] ^= 0x01;
+            }
+         }
+         dleFrame( payload, dle );
+         size_t cobsStart = cobs.size();
+         cobs.resize( cobsStart + COBS_MAX_ENCODED_LENGTH( payload.size() ) );
+         cobs.resize( cobsStart
+                      + cobs_encode( payload.size(), payload.data(), &cobs[ cobsStart ] ) );
+         size_t garbage = static_cast< size_t >( payload.size() * mix.garbageRatio
+                                                 / ( 1.0 - mix.garbageRatio ) );
+         for ( ; garbage > 0; --garbage )
+         {
+            uint8_t byte = static_cast< uint8_t >( byteDist( rng ) );
+            dle.push_back( ( STX == byte ) ? 0x00 : byte );
+            cobs.push_back( ( COBS_DELIMITER == byte ) ? 0x01 : byte );
+         }
+      }
+      // The occasional frame that is too long
+      dle.push_back( STX );
+      dle.insert( dle.end(), MAX_DECODED_DATA_LENGTH + 16, 0x41 );
+      dle.push_back( ETX );
+
+      pkt_decoder_t* decoder = pkt_decoder_create( countPacket, &decoded );
+      pkt_decoder_set_checksum( decoder, mix.checksum, nullptr );
+      for ( size_t offset = 0; offset < dle.size(); )
+      {
+         size_t chunk = smallChunk( rng ) ? smallChunkDist( rng ) : 4096;
+         chunk = std::min( chunk, dle.size() - offset );
+         pkt_decoder_write_bytes( decoder, chunk, &dle[ offset ] );
+         offset += chunk;
+      }
+      pkt_decoder_destroy( decoder );
+
+      // COBS sees the same traffic. Its counts are per block rather than per byte, so a smaller
+      // share would leave its loop looking cold next to the DLE decoder's
+      cobs_decoder_t* cobsDecoder = cobs_decoder_create( countPacket, &decoded );
+      for ( size_t offset = 0; offset < cobs.size(); )
+      {
+         size_t chunk = smallChunk( rng ) ? smallChunkDist( rng ) : 4096;
+         chunk = std::min( chunk, cobs.size() - offset );
+         cobs_decoder_write_bytes( cobsDecoder, chunk, &cobs[ offset ] );
+         offset += chunk;
+      }
+      cobs_decoder_destroy( cobsDecoder );
+   }
+   printf( "trained on %zu decoded bytes\n", decoded );
+   return 0;
+}
@@ -0,0 +1,521 @@
+// Decodes a framed byte stream from stdin (or a file) to stdout, for use in shell pipelines:
+//
+//   socat -u /dev/ttyUSB0,raw - | pktdecode --format=hex
+//
+// Input is read in large blocks, and the pipe feeding it is enlarged so the writer rarely waits.
+// Decoded frames are packed into a batch buffer, which is written with one writev, or when stdout
+// is a pipe, handed to the pipe with vmsplice so its pages are never copied.
+//
+// With --pcap the input is a pcap or pcapng capture instead, and each TCP or UDP flow in it is
+// decoded as a stream of its own (see pkt_pcap.h).
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <getopt.h>
+#include <libsrc/cobs_decoder.h>
+#include <libsrc/pkt_decoder.h>
+#include <libsrc/pkt_pcap.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+enum Format
+{
+   // Each frame as a u16 little-endian length followed by its bytes
+   FORMAT_LENGTH,
+   // Each frame as a line of hex
+   FORMAT_HEX
+};
+
+struct Options
+{
+   const char* input = nullptr;
+   bool cobs = false;
+   bool pcap = false;
+   Format format = FORMAT_LENGTH;
+   size_t readSize = 1024 * 1024;
+   bool vmsplice = true;
+   bool stats = false;
+};
+
+struct Stats
+{
+   uint64_t inBytes = 0;
+   uint64_t packets = 0;
+   uint64_t packetBytes = 0;
+   uint64_t errors[ PKT_ERROR_NO_BUFFER + 1 ] = {};
+};
+
+// Largest record either format writes for one frame, and for the flow that prefixes it in hex
+static const size_t MAX_RECORD( 2 * MAX_DECODED_DATA_LENGTH + 1 );
+static const size_t MAX_FLOW_PREFIX( 2 * ( INET6_ADDRSTRLEN + 8 ) + 2 );
+// Output batch size, unless stdout is a pipe that can't be enlarged this far
+static const size_t BATCH_SIZE( 1024 * 1024 );
+
+// Frames waiting to be written to stdout. A batch is handed to the pipe with vmsplice only once it
+// is full: a full batch takes every slot in the pipe, so by the time it is in, the batch before it
+// has been read and its buffer can be refilled. A batch written early (the input went quiet) is
+// written with writev, which copies it, and its buffer is reused straight away
+class FrameWriter
+{
+ public:
+   FrameWriter( int fd, bool vmsplice )
+      : m_fd( fd ),
+        m_vmsplice( false ),
+        m_batchSize( BATCH_SIZE ),
+        m_buffers{ nullptr, nullptr },
+        m_current( 0 ),
+        m_used( 0 ),
+        m_failed( false )
+   {
+      struct stat info;
+      if ( vmsplice && ( 0 == fstat( fd, &info ) ) && S_ISFIFO( info.st_mode ) )
+      {
+         // The batch has to be exactly the pipe's size. If it can't be enlarged, use what it has
+         fcntl( fd, F_SETPIPE_SZ, static_cast< int >( BATCH_SIZE ) );
+         int pipeSize = fcntl( fd, F_GETPIPE_SZ );
+         if ( ( pipeSize > 0 ) && ( 0 == pipeSize % sysconf( _SC_PAGESIZE ) ) )
+         {
+            m_batchSize = static_cast< size_t >( pipeSize );
+            m_vmsplice = true;
+         }
+      }
+      for ( uint8_t*& buffer : m_buffers )
+      {
+         void* pages = mmap(
+            nullptr, m_batchSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+         buffer = ( MAP_FAILED == pages ) ? nullptr : static_cast< uint8_t* >( pages );
+         m_failed = m_failed || ( nullptr == buffer );
+      }
+   }
+
+   ~FrameWriter()
+   {
+      for ( uint8_t* buffer : m_buffers )
+      {
+         if ( nullptr != buffer )
+         {
+            munmap( buffer, m_batchSize );
+         }
+      }
+   }
+
+   bool failed() const { return m_failed; }
+   bool usesVmsplice() const { return m_vmsplice; }
+
+   // Space for a record of up to MAX_RECORD bytes, to be committed with commit()
+   uint8_t* reserve()
+   {
+      if ( m_batchSize - m_used < MAX_RECORD )
+      {
+         flush( true );
+      }
+      return m_buffers[ m_current ] + m_used;
+   }
+
+   void commit( size_t length ) { m_used += length; }
+
+   // Writes out the batch. Only a full batch may be spliced
+   void flush( bool full )
+   {
+      if ( ( 0 == m_used ) || m_failed )
+      {
+         m_used = 0;
+         return;
+      }
+      iovec batch = { m_buffers[ m_current ], m_used };
+      if ( full && m_vmsplice )
+      {
+         m_failed = !writeAll( batch, true );
+         m_current ^= 1;
+      }
+      else
+      {
+         m_failed = !writeAll( batch, false );
+      }
+      m_used = 0;
+   }
+
+ private:
+   bool writeAll( iovec batch, bool splice )
+   {
+      while ( batch.iov_len > 0 )
+      {
+         ssize_t put = splice ? ::vmsplice( m_fd, &batch, 1, 0 ) : writev( m_fd, &batch, 1 );
+         if ( put < 0 )
+         {
+            if ( EINTR == errno )
+            {
+               continue;
+            }
+            if ( EPIPE != errno )
+            {
+               perror( splice ? "vmsplice" : "writev" );
+            }
+            return false;
+         }
+         batch.iov_base = static_cast< uint8_t* >( batch.iov_base ) + put;
+         batch.iov_len -= put;
+      }
+      return true;
+   }
+
+   int m_fd;
+   bool m_vmsplice;
+   size_t m_batchSize;
+   uint8_t* m_buffers[ 2 ];
+   int m_current;
+   size_t m_used;
+   bool m_failed;
+};
+
+struct Output
+{
+   FrameWriter* writer;
+   Format format;
+   Stats* stats;
+   // The flow prefix last written in --pcap mode, kept since runs of frames share a flow
+   pkt_flow_key_t flow;
+   char flowPrefix[ MAX_FLOW_PREFIX ];
+   size_t flowPrefixLength;
+};
+
+static void frameCallback( void* ctx, size_t data_length, const uint8_t* data )
+{
+   static const char HEX[] = "0123456789abcdef";
+   auto* output = static_cast< Output* >( ctx );
+   output->stats->packets++;
+   output->stats->packetBytes += data_length;
+   uint8_t* record = output->writer->reserve();
+   if ( FORMAT_LENGTH == output->format )
+   {
+      record[ 0 ] = static_cast< uint8_t >( data_length );
+      record[ 1 ] = static_cast< uint8_t >( data_length >> 8 );
+      memcpy( record + 2, data, data_length );
+      output->writer->commit( 2 + data_length );
+   }
+   else
+   {
+      for ( size_t idx = 0; idx < data_length; ++idx )
+      {
+         record[ 2 * idx ] = HEX[ data[ idx ] >> 4 ];
+         record[ 2 * idx + 1 ] = HEX[ data[ idx ] & 0xF ];
+      }
+      record[ 2 * data_length ] = '\n';
+      output->writer->commit( 2 * data_length + 1 );
+   }
+}
+
+// In hex, each frame of a capture is prefixed with its flow: "src:port>dst:port ", with IPv6
+// addresses in brackets
+static void pcapFrameCallback( void* ctx,
+                               const pkt_flow_key_t* flow,
+                               uint64_t timestamp,
+                               size_t data_length,
+                               const uint8_t* data )
+{
+   ( void )timestamp;
+   auto* output = static_cast< Output* >( ctx );
+   if ( FORMAT_HEX == output->format )
+   {
+      if ( ( 0 == output->flowPrefixLength )
+           || ( 0 != memcmp( &output->flow, flow, sizeof( *flow ) ) ) )
+      {
+         int family = ( 6 == flow->ip_version ) ? AF_INET6 : AF_INET;
+         char addresses[ 2 ][ INET6_ADDRSTRLEN ];
+         inet_ntop( family, flow->src_addr, addresses[ 0 ], sizeof( addresses[ 0 ] ) );
+         inet_ntop( family, flow->dst_addr, addresses[ 1 ], sizeof( addresses[ 1 ] ) );
+         int length = snprintf( output->flowPrefix,
+                                MAX_FLOW_PREFIX,
+                                ( AF_INET6 == family ) ? "[%s]:%u>[%s]:%u " : "%s:%u>%s:%u ",
+                                addresses[ 0 ],
+                                flow->src_port,
+                                addresses[ 1 ],
+                                flow->dst_port );
+         output->flow = *flow;
+         output->flowPrefixLength = static_cast< size_t >( length );
+      }
+      memcpy( output->writer->reserve(), output->flowPrefix, output->flowPrefixLength );
+      output->writer->commit( output->flowPrefixLength );
+   }
+   frameCallback( ctx, data_length, data );
+}
+
+static void errorCallback( void* ctx, pkt_error_t reason, size_t partialLength, uint64_t offset )
+{
+   ( void )partialLength;
+   ( void )offset;
+   static_cast< Stats* >( ctx )->errors[ reason ]++;
+}
+
+static void usage( const char* argv0 )
+{
+   fprintf( stderr,
+            "usage: %s [options] [FILE]\n"
+            "  -c, --cobs            input is COBS framed (default DLE)\n"
+            "  -p, --pcap            FILE is a pcap or pcapng capture: decode each TCP and UDP\n"
+            "                        flow in it, prefixing hex lines with the flow\n"
+            "  -o, --format=length|hex  write each frame as a u16 little-endian length and its\n"
+            "                        bytes (default), or as a line of hex\n"
+            "  -b, --buffer=BYTES    read size (default 1 MiB)\n"
+            "  -C, --copy            write with writev even when stdout is a pipe\n"
+            "  -s, --stats           report totals on stderr at the end\n",
+            argv0 );
+}
+
+static bool parseOptions( int argc, char** argv, Options& options )
+{
+   static const option LONG_OPTIONS[] = { { "cobs", no_argument, nullptr, 'c' },
+                                          { "pcap", no_argument, nullptr, 'p' },
+                                          { "format", required_argument, nullptr, 'o' },
+                                          { "buffer", required_argument, nullptr, 'b' },
+                                          { "copy", no_argument, nullptr, 'C' },
+                                          { "stats", no_argument, nullptr, 's' },
+                                          { nullptr, 0, nullptr, 0 } };
+   int opt;
+   while ( -1 != ( opt = getopt_long( argc, argv, "cpo:b:Cs", LONG_OPTIONS, nullptr ) ) )
+   {
+      switch ( opt )
+      {
+         case 'c':
+            options.cobs = true;
+            break;
+         case 'p':
+            options.pcap = true;
+            break;
+         case 'o': {
+            std::string format( optarg );
+            if ( "length" == format )
+            {
+               options.format = FORMAT_LENGTH;
+            }
+            else if ( "hex" == format )
+            {
+               options.format = FORMAT_HEX;
+            }
+            else
+            {
+               return false;
+            }
+         }
+         break;
+         case 'b':
+            options.readSize = strtoul( optarg, nullptr, 0 );
+            if ( 0 == options.readSize )
+            {
+               return false;
+            }
+            break;
+         case 'C':
+            options.vmsplice = false;
+            break;
+         case 's':
+            options.stats = true;
+            break;
+         default:
+            return false;
+      }
+   }
+   if ( optind + 1 == argc )
+   {
+      options.input = argv[ optind ];
+   }
+   // A capture is mapped, so has to be a file, and is always DLE framed
+   if ( options.pcap && ( options.cobs || ( nullptr == options.input ) ) )
+   {
+      return false;
+   }
+   return optind + ( ( nullptr == options.input ) ? 0 : 1 ) == argc;
+}
+
+// Decodes every flow of a capture file to stdout. Returns main's exit code
+static int decodeCapture( const Options& options )
+{
+   Stats stats;
+   FrameWriter writer( STDOUT_FILENO, options.vmsplice );
+   if ( writer.failed() )
+   {
+      fprintf( stderr, "can't allocate output buffers\n" );
+      return 1;
+   }
+   Output output = {};
+   output.writer = &writer;
+   output.format = options.format;
+   output.stats = &stats;
+   pkt_pcap_reader_t* reader = pkt_pcap_open( options.input, pcapFrameCallback, &output );
+   if ( nullptr == reader )
+   {
+      fprintf( stderr, "%s: can't read, or not a pcap or pcapng capture\n", options.input );
+      return 1;
+   }
+   auto start = std::chrono::steady_clock::now();
+   bool complete = pkt_pcap_read_all( reader );
+   writer.flush( false );
+   double elapsed =
+      std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+   if ( !complete )
+   {
+      fprintf( stderr, "%s: stopped at a truncated or malformed record\n", options.input );
+   }
+
+   if ( options.stats )
+   {
+      pkt_pcap_stats_t pcapStats;
+      pkt_pcap_get_stats( reader, &pcapStats );
+      fprintf( stderr,
+               "decoded %llu packets (%.1f MB) from %.1f MB of payload in %llu flows in %.3f s: "
+               "%.1f MB/s%s\n",
+               static_cast< unsigned long long >( stats.packets ),
+               stats.packetBytes / 1e6,
+               pcapStats.payload_bytes / 1e6,
+               static_cast< unsigned long long >( pcapStats.flows ),
+               elapsed,
+               pcapStats.payload_bytes / elapsed / 1e6,
+               writer.usesVmsplice() ? " (vmsplice)" : "" );
+      fprintf( stderr,
+               "records: %llu read, %llu skipped; tcp: %llu out of order, %llu retransmitted, "
+               "%llu gaps\n",
+               static_cast< unsigned long long >( pcapStats.records ),
+               static_cast< unsigned long long >( pcapStats.skipped ),
+               static_cast< unsigned long long >( pcapStats.out_of_order ),
+               static_cast< unsigned long long >( pcapStats.retransmits ),
+               static_cast< unsigned long long >( pcapStats.gaps ) );
+   }
+   pkt_pcap_close( reader );
+   return ( complete && !writer.failed() ) ? 0 : 1;
+}
+
+int main( int argc, char** argv )
+{
+   Options options;
+   if ( !parseOptions( argc, argv, options ) )
+   {
+      usage( argv[ 0 ] );
+      return 2;
+   }
+   if ( options.pcap )
+   {
+      return decodeCapture( options );
+   }
+   int inFd = STDIN_FILENO;
+   if ( nullptr != options.input )
+   {
+      inFd = open( options.input, O_RDONLY );
+      if ( inFd < 0 )
+      {
+         perror( options.input );
+         return 1;
+      }
+   }
+   struct stat info;
+   if ( ( 0 == fstat( inFd, &info ) ) && S_ISFIFO( info.st_mode ) )
+   {
+      // A bigger pipe lets the writer run further ahead between our reads
+      size_t pipeSize = std::min< size_t >( options.readSize, INT_MAX );
+      fcntl( inFd, F_SETPIPE_SZ, static_cast< int >( pipeSize ) );
+   }
+
+   Stats stats;
+   FrameWriter writer( STDOUT_FILENO, options.vmsplice );
+   if ( writer.failed() )
+   {
+      fprintf( stderr, "can't allocate output buffers\n" );
+      return 1;
+   }
+   Output output = {};
+   output.writer = &writer;
+   output.format = options.format;
+   output.stats = &stats;
+   pkt_decoder_t* decoder = nullptr;
+   cobs_decoder_t* cobsDecoder = nullptr;
+   if ( options.cobs )
+   {
+      cobsDecoder = cobs_decoder_create( frameCallback, &output );
+   }
+   else
+   {
+      decoder = pkt_decoder_create( frameCallback, &output );
+      pkt_decoder_set_error_callback( decoder, errorCallback, &stats );
+   }
+
+   std::vector< uint8_t > buffer( options.readSize );
+   auto start = std::chrono::steady_clock::now();
+   bool readFailed = false;
+   while ( !writer.failed() )
+   {
+      ssize_t got = read( inFd, buffer.data(), buffer.size() );
+      if ( got < 0 )
+      {
+         if ( EINTR == errno )
+         {
+            continue;
+         }
+         perror( "read" );
+         readFailed = true;
+         break;
+      }
+      if ( 0 == got )
+      {
+         break;
+      }
+      stats.inBytes += got;
+      if ( options.cobs )
+      {
+         cobs_decoder_write_bytes( cobsDecoder, got, buffer.data() );
+      }
+      else
+      {
+         pkt_decoder_write_bytes( decoder, got, buffer.data() );
+      }
+      if ( static_cast< size_t >( got ) < buffer.size() )
+      {
+         // The input has gone quiet, so pass on what has been decoded instead of holding it
+         writer.flush( false );
+      }
+   }
+   writer.flush( false );
+   double elapsed =
+      std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+
+   if ( options.stats )
+   {
+      fprintf( stderr,
+               "decoded %llu packets (%.1f MB) from %.1f MB in %.3f s: %.1f MB/s%s\n",
+               static_cast< unsigned long long >( stats.packets ),
+               stats.packetBytes / 1e6,
+               stats.inBytes / 1e6,
+               elapsed,
+               stats.inBytes / elapsed / 1e6,
+               writer.usesVmsplice() ? " (vmsplice)" : "" );
+      if ( !options.cobs )
+      {
+         fprintf( stderr,
+                  "dropped: %llu overflowed, %llu aborted, %llu empty\n",
+                  static_cast< unsigned long long >( stats.errors[ PKT_ERROR_OVERFLOW ] ),
+                  static_cast< unsigned long long >( stats.errors[ PKT_ERROR_ABORTED ] ),
+                  static_cast< unsigned long long >( stats.errors[ PKT_ERROR_EMPTY ] ) );
+      }
+   }
+   if ( options.cobs )
+   {
+      cobs_decoder_destroy( cobsDecoder );
+   }
+   else
+   {
+      pkt_decoder_destroy( decoder );
+   }
+   if ( STDIN_FILENO != inFd )
+   {
+      close( inFd );
+   }
+   return ( readFailed || writer.failed() ) ? 1 : 0;
+}
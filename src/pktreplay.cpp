@@ -0,0 +1,464 @@
+// Replays a raw serial capture into a packet decoder, either directly or through a socketpair or
+// pty, and reports decode throughput and callback latency.
+//
+// The capture is either a raw byte stream or a packet log (see pkt_log.h) whose records are the
+// raw chunks as they were read from the line, stamped with their arrival time in nanoseconds.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <getopt.h>
+#include <libsrc/pkt_decoder.h>
+#include <libsrc/pkt_log.h>
+#include <random>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+enum Output
+{
+   OUTPUT_DECODER,
+   OUTPUT_SOCKETPAIR,
+   OUTPUT_PTY
+};
+
+struct Options
+{
+   const char* capture = nullptr;
+   Output output = OUTPUT_DECODER;
+   // Write sizes for raw captures; a random size in [ chunkMin, chunkMax ] is used for each write
+   size_t chunkMin = 4096;
+   size_t chunkMax = 4096;
+   // Pacing: recorded timestamps scaled by 1 / speed, a fixed byte rate, or neither (flat out)
+   double speed = 1.0;
+   bool flat = false;
+   double byteRate = 0.0;
+   size_t repeat = 1;
+};
+
+// One write into the decoder (or the line), and when it should be issued relative to the start
+struct Chunk
+{
+   const uint8_t* data;
+   size_t length;
+   uint64_t dueNs;
+};
+
+// Packets seen by the decoder, and the latency from issuing the write that completed each one
+// to its callback
+struct Stats
+{
+   size_t packets = 0;
+   size_t bytes = 0;
+   std::vector< uint64_t > latencyNs;
+};
+
+static Clock::time_point replayStart;
+
+static uint64_t sinceStartNs()
+{
+   return std::chrono::duration_cast< std::chrono::nanoseconds >( Clock::now() - replayStart )
+      .count();
+}
+
+static void statsCallback( void* ctx,
+                           size_t data_length,
+                           const uint8_t* data,
+                           const pkt_timestamps_t* timestamps )
+{
+   ( void )data;
+   auto* stats = static_cast< Stats* >( ctx );
+   stats->packets++;
+   stats->bytes += data_length;
+   stats->latencyNs.push_back( sinceStartNs() - timestamps->etx_time );
+}
+
+static void usage( const char* argv0 )
+{
+   fprintf( stderr,
+            "usage: %s [options] CAPTURE\n"
+            "  -o, --output=decoder|socketpair|pty  where to send the bytes (default decoder)\n"
+            "  -c, --chunk=N[-M]     write size for raw captures, or a random size from N to M\n"
+            "  -s, --speed=X         replay a packet-log capture at X times its recorded pace\n"
+            "  -r, --rate=BYTES/S    pace a raw capture at a fixed line rate\n"
+            "  -f, --flat            ignore all timing and replay as fast as possible\n"
+            "  -n, --repeat=N        replay the capture N times\n",
+            argv0 );
+}
+
+static bool parseOptions( int argc, char** argv, Options& options )
+{
+   static const option LONG_OPTIONS[] = { { "output", required_argument, nullptr, 'o' },
+                                          { "chunk", required_argument, nullptr, 'c' },
+                                          { "speed", required_argument, nullptr, 's' },
+                                          { "rate", required_argument, nullptr, 'r' },
+                                          { "flat", no_argument, nullptr, 'f' },
+                                          { "repeat", required_argument, nullptr, 'n' },
+                                          { nullptr, 0, nullptr, 0 } };
+   int opt;
+   while ( -1 != ( opt = getopt_long( argc, argv, "o:c:s:r:fn:", LONG_OPTIONS, nullptr ) ) )
+   {
+      switch ( opt )
+      {
+         case 'o': {
+            std::string output( optarg );
+            if ( "decoder" == output )
+            {
+               options.output = OUTPUT_DECODER;
+            }
+            else if ( "socketpair" == output )
+            {
+               options.output = OUTPUT_SOCKETPAIR;
+            }
+            else if ( "pty" == output )
+            {
+               options.output = OUTPUT_PTY;
+            }
+            else
+            {
+               return false;
+            }
+         }
+         break;
+         case 'c': {
+            char* end;
+            options.chunkMin = options.chunkMax = strtoul( optarg, &end, 0 );
+            if ( '-' == *end )
+            {
+               options.chunkMax = strtoul( end + 1, &end, 0 );
+            }
+            if ( ( 0 == options.chunkMin ) || ( options.chunkMax < options.chunkMin ) )
+            {
+               return false;
+            }
+         }
+         break;
+         case 's':
+            options.speed = strtod( optarg, nullptr );
+            break;
+         case 'r':
+            options.byteRate = strtod( optarg, nullptr );
+            break;
+         case 'f':
+            options.flat = true;
+            break;
+         case 'n':
+            options.repeat = strtoul( optarg, nullptr, 0 );
+            break;
+         default:
+            return false;
+      }
+   }
+   if ( ( optind + 1 != argc ) || !( options.speed > 0.0 ) )
+   {
+      return false;
+   }
+   options.capture = argv[ optind ];
+   return true;
+}
+
+// Splits a capture into the writes to replay. Packet-log captures keep their recorded chunks and
+// timing; raw captures are cut into chunk-sized writes, paced at the byte rate if there is one
+static void planChunks( const Options& options,
+                        const uint8_t* map,
+                        size_t mapLength,
+                        pkt_log_reader_t* log,
+                        std::vector< Chunk >& chunks )
+{
+   if ( nullptr != log )
+   {
+      pkt_log_record_t record;
+      uint64_t firstTimestamp = 0;
+      while ( pkt_log_reader_next( log, &record ) )
+      {
+         if ( chunks.empty() )
+         {
+            firstTimestamp = record.timestamp;
+         }
+         uint64_t due = options.flat
+                           ? 0
+                           : static_cast< uint64_t >( ( record.timestamp - firstTimestamp )
+                                                      / options.speed );
+         chunks.push_back( { record.data, record.data_length, due } );
+      }
+      return;
+   }
+
+   std::mt19937 rng( 0x5eed );
+   std::uniform_int_distribution< size_t > chunkDist( options.chunkMin, options.chunkMax );
+   for ( size_t offset = 0; offset < mapLength; )
+   {
+      size_t length = std::min( chunkDist( rng ), mapLength - offset );
+      uint64_t due = ( options.flat || !( options.byteRate > 0.0 ) )
+                        ? 0
+                        : static_cast< uint64_t >( offset * 1e9 / options.byteRate );
+      chunks.push_back( { map + offset, length, due } );
+      offset += length;
+   }
+}
+
+// Sleeps until dueNs after the start of the replay, spinning for the last stretch so short gaps
+// are still paced accurately
+static void waitUntil( uint64_t dueNs )
+{
+   const uint64_t SPIN_NS( 200000 );
+   uint64_t now = sinceStartNs();
+   if ( dueNs > now + SPIN_NS )
+   {
+      std::this_thread::sleep_for( std::chrono::nanoseconds( dueNs - now - SPIN_NS ) );
+   }
+   while ( sinceStartNs() < dueNs )
+   {
+   }
+}
+
+// Opens a pty pair in raw mode, so the line discipline passes every byte through untouched
+static bool openPty( int& master, int& slave )
+{
+   master = posix_openpt( O_RDWR | O_NOCTTY );
+   if ( ( master < 0 ) || ( 0 != grantpt( master ) ) || ( 0 != unlockpt( master ) ) )
+   {
+      return false;
+   }
+   slave = open( ptsname( master ), O_RDWR | O_NOCTTY );
+   if ( slave < 0 )
+   {
+      return false;
+   }
+   termios attributes;
+   tcgetattr( slave, &attributes );
+   cfmakeraw( &attributes );
+   tcsetattr( slave, TCSANOW, &attributes );
+   return true;
+}
+
+// Replays the chunks straight into a decoder
+static void replayToDecoder( const Options& options,
+                             const std::vector< Chunk >& chunks,
+                             Stats& stats )
+{
+   pkt_decoder_t* decoder = pkt_decoder_create_ts( statsCallback, &stats );
+   for ( size_t pass = 0; pass < options.repeat; ++pass )
+   {
+      uint64_t passStart = sinceStartNs();
+      for ( const Chunk& chunk : chunks )
+      {
+         waitUntil( passStart + chunk.dueNs );
+         pkt_decoder_write_bytes_ts( decoder, chunk.length, chunk.data, sinceStartNs() );
+      }
+   }
+   pkt_decoder_destroy( decoder );
+}
+
+// Replays the chunks into one end of a socketpair or pty while a second thread decodes whatever
+// arrives at the other end. Each read is stamped with the time the write holding its last byte
+// was issued. Returns false if the bytes couldn't all be written and read back
+static bool replayToLine( const Options& options, const std::vector< Chunk >& chunks, Stats& stats )
+{
+   int writeFd;
+   int readFd;
+   if ( OUTPUT_PTY == options.output )
+   {
+      if ( !openPty( writeFd, readFd ) )
+      {
+         perror( "pty" );
+         return false;
+      }
+   }
+   else
+   {
+      int fds[ 2 ];
+      if ( 0 != socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) )
+      {
+         perror( "socketpair" );
+         return false;
+      }
+      writeFd = fds[ 0 ];
+      readFd = fds[ 1 ];
+   }
+
+   size_t totalChunks = chunks.size() * options.repeat;
+   std::vector< uint64_t > chunkEnd( totalChunks );
+   std::vector< uint64_t > issuedNs( totalChunks );
+   std::atomic< size_t > chunksIssued( 0 );
+   uint64_t totalBytes = 0;
+   uint64_t received = 0;
+   for ( size_t idx = 0; idx < totalChunks; ++idx )
+   {
+      totalBytes += chunks[ idx % chunks.size() ].length;
+      chunkEnd[ idx ] = totalBytes;
+   }
+
+   std::thread reader( [&]() {
+      pkt_decoder_t* decoder = pkt_decoder_create_ts( statsCallback, &stats );
+      std::vector< uint8_t > buffer( 64 * 1024 );
+      size_t chunk = 0;
+      while ( received < totalBytes )
+      {
+         ssize_t got = read( readFd, buffer.data(), buffer.size() );
+         if ( ( got < 0 ) && ( EINTR == errno ) )
+         {
+            continue;
+         }
+         if ( got <= 0 )
+         {
+            break;
+         }
+         received += got;
+         while ( chunkEnd[ chunk ] < received )
+         {
+            ++chunk;
+         }
+         // The write can't have been issued yet if we read its bytes, but wait for its time to
+         // be published
+         while ( chunksIssued.load( std::memory_order_acquire ) <= chunk )
+         {
+         }
+         pkt_decoder_write_bytes_ts( decoder, got, buffer.data(), issuedNs[ chunk ] );
+      }
+      pkt_decoder_destroy( decoder );
+   } );
+
+   size_t idx = 0;
+   bool failed = false;
+   for ( size_t pass = 0; ( pass < options.repeat ) && !failed; ++pass )
+   {
+      uint64_t passStart = sinceStartNs();
+      for ( size_t next = 0; ( next < chunks.size() ) && !failed; ++next )
+      {
+         const Chunk& chunk = chunks[ next ];
+         waitUntil( passStart + chunk.dueNs );
+         issuedNs[ idx ] = sinceStartNs();
+         chunksIssued.store( ++idx, std::memory_order_release );
+         for ( size_t written = 0; written < chunk.length; )
+         {
+            ssize_t put = write( writeFd, chunk.data + written, chunk.length - written );
+            if ( ( put < 0 ) && ( EINTR == errno ) )
+            {
+               continue;
+            }
+            if ( put <= 0 )
+            {
+               perror( "write" );
+               failed = true;
+               break;
+            }
+            written += put;
+         }
+      }
+   }
+   if ( failed )
+   {
+      // The reader is waiting for bytes that will never come: hang up so its read returns
+      if ( OUTPUT_SOCKETPAIR == options.output )
+      {
+         shutdown( writeFd, SHUT_WR );
+      }
+      close( writeFd );
+      writeFd = -1;
+   }
+   reader.join();
+   if ( writeFd >= 0 )
+   {
+      close( writeFd );
+   }
+   close( readFd );
+   if ( !failed && ( received < totalBytes ) )
+   {
+      fprintf( stderr,
+               "read: line closed after %lu of %lu bytes\n",
+               static_cast< unsigned long >( received ),
+               static_cast< unsigned long >( totalBytes ) );
+   }
+   return !failed && ( received == totalBytes );
+}
+
+static uint64_t percentile( const std::vector< uint64_t >& sorted, double fraction )
+{
+   return sorted[ std::min( sorted.size() - 1, static_cast< size_t >( fraction * sorted.size() ) ) ];
+}
+
+int main( int argc, char** argv )
+{
+   Options options;
+   if ( !parseOptions( argc, argv, options ) )
+   {
+      usage( argv[ 0 ] );
+      return 2;
+   }
+
+   int fd = open( options.capture, O_RDONLY );
+   struct stat info;
+   if ( ( fd < 0 ) || ( 0 != fstat( fd, &info ) ) || ( 0 == info.st_size ) )
+   {
+      fprintf( stderr, "%s: can't read capture\n", options.capture );
+      return 1;
+   }
+   void* map = mmap( nullptr, info.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0 );
+   close( fd );
+   if ( MAP_FAILED == map )
+   {
+      perror( "mmap" );
+      return 1;
+   }
+   // A capture that opens as a packet log is replayed with its recorded timing
+   pkt_log_reader_t* log = pkt_log_reader_open( options.capture );
+
+   std::vector< Chunk > chunks;
+   planChunks( options, static_cast< const uint8_t* >( map ), info.st_size, log, chunks );
+   uint64_t captureBytes = 0;
+   for ( const Chunk& chunk : chunks )
+   {
+      captureBytes += chunk.length;
+   }
+
+   Stats stats;
+   replayStart = Clock::now();
+   if ( OUTPUT_DECODER == options.output )
+   {
+      replayToDecoder( options, chunks, stats );
+   }
+   else if ( !replayToLine( options, chunks, stats ) )
+   {
+      return 1;
+   }
+   double elapsed = sinceStartNs() / 1e9;
+
+   printf( "replayed %zu writes, %.1f MB in %.3f s: %.1f MB/s, %zu packets (%.2f Mpkt/s, "
+           "%.1f MB payload)\n",
+           chunks.size() * options.repeat,
+           captureBytes * options.repeat / 1e6,
+           elapsed,
+           captureBytes * options.repeat / elapsed / 1e6,
+           stats.packets,
+           stats.packets / elapsed / 1e6,
+           stats.bytes / 1e6 );
+   if ( !stats.latencyNs.empty() )
+   {
+      std::sort( stats.latencyNs.begin(), stats.latencyNs.end() );
+      printf( "callback latency (ns): p50 %lu  p90 %lu  p99 %lu  p99.9 %lu  max %lu\n",
+              static_cast< unsigned long >( percentile( stats.latencyNs, 0.50 ) ),
+              static_cast< unsigned long >( percentile( stats.latencyNs, 0.90 ) ),
+              static_cast< unsigned long >( percentile( stats.latencyNs, 0.99 ) ),
+              static_cast< unsigned long >( percentile( stats.latencyNs, 0.999 ) ),
+              static_cast< unsigned long >( stats.latencyNs.back() ) );
+   }
+
+   if ( nullptr != log )
+   {
+      pkt_log_reader_close( log );
+   }
+   munmap( map, info.st_size );
+   return 0;
+}
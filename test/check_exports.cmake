@@ -0,0 +1,32 @@
+# Fails unless every symbol LIBRARY exports is part of the C API. Run by ctest as
+#   cmake -DNM=nm -DLIBRARY=libpktdecoder.so -P check_exports.cmake
+execute_process(
+      COMMAND ${NM} -D --defined-only ${LIBRARY}
+      OUTPUT_VARIABLE SYMBOLS
+      RESULT_VARIABLE RESULT )
+if ( NOT RESULT EQUAL 0 )
+   message( FATAL_ERROR "${NM} failed on ${LIBRARY}" )
+endif ()
+
+string( REPLACE "\n" ";" SYMBOLS "${SYMBOLS}" )
+set( API_COUNT 0 )
+set( LEAKED )
+foreach ( SYMBOL ${SYMBOLS} )
+   # Value, type, name[@version]
+   if ( SYMBOL MATCHES "^[0-9a-fA-F]* *[A-Za-z] ([^@ ]+)" )
+      set( NAME ${CMAKE_MATCH_1} )
+      if ( NAME MATCHES "^(pkt|cobs)_" )
+         math( EXPR API_COUNT "${API_COUNT} + 1" )
+      elseif ( NOT NAME MATCHES "^PKTDECODER_" )
+         list( APPEND LEAKED ${NAME} )
+      endif ()
+   endif ()
+endforeach ()
+
+if ( LEAKED )
+   message( FATAL_ERROR "${LIBRARY} exports symbols outside the C API: ${LEAKED}" )
+endif ()
+if ( API_COUNT EQUAL 0 )
+   message( FATAL_ERROR "${LIBRARY} exports no pkt_ or cobs_ functions" )
+endif ()
+message( STATUS "${LIBRARY} exports ${API_COUNT} C API symbols and nothing else" )
@@ -0,0 +1,40 @@
+# Runs a known DLE stream through pktdecode, from a pipe to a pipe (so large outputs are spliced)
+# and from a file to a file, and checks the frames it writes. Run by ctest as
+#   cmake -DPKTDECODE=pktdecode -DWORK_DIR=dir -P check_pktdecode.cmake
+string( ASCII 2 STX )
+string( ASCII 3 ETX )
+string( ASCII 16 DLE )
+
+# Escaped STX, ETX and DLE are sent as DLE followed by the byte with 0x20 set
+set( FRAMES
+      "${STX}hello${ETX}"
+      "xyz${STX}a${DLE}\"b${ETX}"
+      "${STX}abc${STX}de${ETX}"
+      "${STX}${DLE}0${DLE}#${ETX}" )
+string( CONCAT STREAM ${FRAMES} )
+set( EXPECTED "68656c6c6f\n610262\n6465\n1003\n" )
+
+# Enough copies to fill several output batches
+string( REPEAT "${STREAM}" 100000 STREAM )
+string( REPEAT "${EXPECTED}" 100000 EXPECTED )
+file( WRITE ${WORK_DIR}/pktdecode_in.bin "${STREAM}" )
+
+set( PIPELINE "cat pktdecode_in.bin | '${PKTDECODE}' -o hex -b 4096 | cat > pktdecode_piped.txt" )
+execute_process(
+      COMMAND sh -c "${PIPELINE}"
+      WORKING_DIRECTORY ${WORK_DIR}
+      RESULT_VARIABLE RESULT )
+file( READ ${WORK_DIR}/pktdecode_piped.txt PIPED )
+if ( NOT RESULT EQUAL 0 OR NOT PIPED STREQUAL EXPECTED )
+   message( FATAL_ERROR "pktdecode from a pipe to a pipe wrote the wrong frames" )
+endif ()
+
+execute_process(
+      COMMAND ${PKTDECODE} -o hex pktdecode_in.bin
+      WORKING_DIRECTORY ${WORK_DIR}
+      OUTPUT_FILE ${WORK_DIR}/pktdecode_file.txt
+      RESULT_VARIABLE RESULT )
+file( READ ${WORK_DIR}/pktdecode_file.txt FROM_FILE )
+if ( NOT RESULT EQUAL 0 OR NOT FROM_FILE STREQUAL EXPECTED )
+   message( FATAL_ERROR "pktdecode from a file to a file wrote the wrong frames" )
+endif ()
@@ -0,0 +1,32 @@
+# Replays a small generated capture through pktreplay, straight into a decoder and across a
+# socketpair and a pty, and checks every packet in it is decoded. Run by ctest as
+#   cmake -DPKTREPLAY=pktreplay -DWORK_DIR=dir -P check_pktreplay.cmake
+string( ASCII 2 STX )
+string( ASCII 3 ETX )
+string( ASCII 16 DLE )
+
+# Four packets: the aborted frame "abc" and the garbage before the second STX are dropped
+set( FRAMES
+      "${STX}hello${ETX}"
+      "xyz${STX}a${DLE}\"b${ETX}"
+      "${STX}abc${STX}de${ETX}"
+      "${STX}${DLE}0${DLE}#${ETX}" )
+string( CONCAT STREAM ${FRAMES} )
+string( REPEAT "${STREAM}" 1000 STREAM )
+file( WRITE ${WORK_DIR}/pktreplay_in.bin "${STREAM}" )
+
+# Three passes in writes of random sizes, so packets straddle writes and reads
+foreach ( OUTPUT decoder socketpair pty )
+   execute_process(
+         COMMAND ${PKTREPLAY} -o ${OUTPUT} -c 1-300 -f -n 3 pktreplay_in.bin
+         WORKING_DIRECTORY ${WORK_DIR}
+         OUTPUT_VARIABLE REPORT
+         ERROR_VARIABLE ERRORS
+         RESULT_VARIABLE RESULT
+         TIMEOUT 60 )
+   if ( OUTPUT STREQUAL "pty" AND ERRORS MATCHES "^pty:" )
+      message( STATUS "pktreplay: no ptys here, skipping pty output" )
+   elseif ( NOT RESULT EQUAL 0 OR NOT REPORT MATCHES " 12000 packets " )
+      message( FATAL_ERROR "pktreplay to ${OUTPUT} failed (${RESULT}): ${REPORT}${ERRORS}" )
+   endif ()
+endforeach ()
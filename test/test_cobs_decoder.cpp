@@ -0,0 +1,110 @@
+#include "catch.hpp"
+
+#include <cstring>
+#include <libsrc/cobs_decoder.h>
+#include <vector>
+
+// Every packet delivered by the COBS decoder under test
+static std::vector< std::vector< uint8_t > > cobsPackets;
+
+static void cobsCallbackFunc( void* ctx, size_t bufferLength, const uint8_t* dataBuffer )
+{
+   ( void )ctx;
+   cobsPackets.emplace_back( dataBuffer, dataBuffer + bufferLength );
+}
+
+static std::vector< uint8_t > encode( const std::vector< uint8_t >& payload )
+{
+   std::vector< uint8_t > encoded( COBS_MAX_ENCODED_LENGTH( payload.size() ) );
+   encoded.resize( cobs_encode( payload.size(), payload.data(), encoded.data() ) );
+   return encoded;
+}
+
+TEST_CASE( "Validate COBS encoding", "[cobs]" )
+{
+   SECTION( "Verify zero bytes are replaced by block codes" )
+   {
+      const std::vector< uint8_t > PAYLOAD = { 0x11, 0x22, 0x00, 0x33 };
+      const std::vector< uint8_t > EXPECTED = { 0x03, 0x11, 0x22, 0x02, 0x33, COBS_DELIMITER };
+      REQUIRE( encode( PAYLOAD ) == EXPECTED );
+   }
+
+   SECTION( "Verify a run of 254 non-zero bytes starts a new block" )
+   {
+      std::vector< uint8_t > payload( 254, 0x41 );
+      std::vector< uint8_t > encoded = encode( payload );
+      REQUIRE( encoded.size() <= COBS_MAX_ENCODED_LENGTH( payload.size() ) );
+      REQUIRE( 0xFF == encoded[ 0 ] );
+      REQUIRE( COBS_DELIMITER == encoded.back() );
+      REQUIRE( nullptr == memchr( encoded.data(), COBS_DELIMITER, encoded.size() - 1 ) );
+   }
+}
+
+TEST_CASE( "Validate COBS decoding & callbacks", "[cobs]" )
+{
+   cobsPackets.clear();
+
+   SECTION( "Verify every possible byte value round-trips" )
+   {
+      std::vector< uint8_t > payload;
+      for ( size_t value = 0; value <= 0xFF; ++value )
+      {
+         payload.push_back( static_cast< uint8_t >( value ) );
+      }
+      std::vector< uint8_t > encoded = encode( payload );
+
+      cobs_decoder_t* decoder = cobs_decoder_create( cobsCallbackFunc, nullptr );
+      cobs_decoder_write_bytes( decoder, encoded.size(), encoded.data() );
+      REQUIRE( 1 == cobsPackets.size() );
+      REQUIRE( payload == cobsPackets[ 0 ] );
+      cobs_decoder_destroy( decoder );
+   }
+
+   SECTION( "Verify a packet that spans writes, one byte at a time" )
+   {
+      const std::vector< uint8_t > PAYLOAD = { 0x00, 0x01, 0x00, 0x00, 0x02, 0x03 };
+      std::vector< uint8_t > encoded = encode( PAYLOAD );
+
+      cobs_decoder_t* decoder = cobs_decoder_create( cobsCallbackFunc, nullptr );
+      for ( uint8_t byte : encoded )
+      {
+         cobs_decoder_write_bytes( decoder, 1, &byte );
+      }
+      REQUIRE( 1 == cobsPackets.size() );
+      REQUIRE( PAYLOAD == cobsPackets[ 0 ] );
+      cobs_decoder_destroy( decoder );
+   }
+
+   SECTION( "Verify a max-size packet is handled and a larger one is dropped" )
+   {
+      std::vector< uint8_t > maxPayload( MAX_DECODED_DATA_LENGTH, 0x5A );
+      std::vector< uint8_t > tooLarge( MAX_DECODED_DATA_LENGTH + 1, 0x5A );
+      const std::vector< uint8_t > SMALL = { 0x01 };
+      std::vector< uint8_t > stream = encode( tooLarge );
+      std::vector< uint8_t > tail = encode( maxPayload );
+      stream.insert( stream.end(), tail.begin(), tail.end() );
+      tail = encode( SMALL );
+      stream.insert( stream.end(), tail.begin(), tail.end() );
+
+      cobs_decoder_t* decoder = cobs_decoder_create( cobsCallbackFunc, nullptr );
+      cobs_decoder_write_bytes( decoder, stream.size(), stream.data() );
+      REQUIRE( 2 == cobsPackets.size() );
+      REQUIRE( maxPayload == cobsPackets[ 0 ] );
+      REQUIRE( SMALL == cobsPackets[ 1 ] );
+      cobs_decoder_destroy( decoder );
+   }
+
+   SECTION( "Verify empty and truncated frames are silently dropped" )
+   {
+      // An empty frame, a frame whose block is cut short by a delimiter, then a valid frame
+      const uint8_t BYTESTREAM[] = { COBS_DELIMITER, 0x05, 0x11, 0x22, COBS_DELIMITER,
+                                     0x02,           0x44, COBS_DELIMITER };
+      const std::vector< uint8_t > EXPECTED = { 0x44 };
+
+      cobs_decoder_t* decoder = cobs_decoder_create( cobsCallbackFunc, nullptr );
+      cobs_decoder_write_bytes( decoder, sizeof( BYTESTREAM ), BYTESTREAM );
+      REQUIRE( 1 == cobsPackets.size() );
+      REQUIRE( EXPECTED == cobsPackets[ 0 ] );
+      cobs_decoder_destroy( decoder );
+   }
+}
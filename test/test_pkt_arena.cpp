@@ -0,0 +1,124 @@
+#include "catch.hpp"
+
+#include <cstring>
+#include <libsrc/pkt_decoder.h>
+#include <thread>
+#include <vector>
+
+// Packets kept by the arena callback, pointing into the arena
+struct RetainedPacket
+{
+   size_t length;
+   const uint8_t* data;
+};
+static pkt_arena_t* retainArena( nullptr );
+static bool retainPackets( true );
+static std::vector< RetainedPacket > retainedPackets;
+
+static void arenaCallbackFunc( void* ctx, size_t bufferLength, const uint8_t* dataBuffer )
+{
+   ( void )ctx;
+   if ( retainPackets )
+   {
+      pkt_arena_retain( retainArena, dataBuffer );
+   }
+   retainedPackets.push_back( { bufferLength, dataBuffer } );
+}
+
+// Frames a packet of length bytes, all set to value
+static std::vector< uint8_t > framePacket( size_t length, uint8_t value )
+{
+   std::vector< uint8_t > frame( length + 2, value );
+   frame.front() = STX;
+   frame.back() = ETX;
+   return frame;
+}
+
+TEST_CASE( "Validate arena decoding with retained packets", "[arena]" )
+{
+   retainArena = pkt_arena_create( 4096 );
+   retainPackets = true;
+   retainedPackets.clear();
+   pkt_decoder_t* decoder = pkt_decoder_create_arena( arenaCallbackFunc, nullptr, retainArena );
+
+   SECTION( "Verify retained packets survive the packets after them" )
+   {
+      for ( size_t packet = 0; packet < 100; ++packet )
+      {
+         std::vector< uint8_t > frame = framePacket( 1 + packet, 0x40 + packet % 32 );
+         pkt_decoder_write_bytes( decoder, frame.size(), frame.data() );
+      }
+      REQUIRE( 100 == retainedPackets.size() );
+      for ( size_t packet = 0; packet < 100; ++packet )
+      {
+         REQUIRE( 1 + packet == retainedPackets[ packet ].length );
+         std::vector< uint8_t > expected( 1 + packet, 0x40 + packet % 32 );
+         REQUIRE( 0 == memcmp( expected.data(), retainedPackets[ packet ].data, 1 + packet ) );
+      }
+      REQUIRE( pkt_arena_chunk_count( retainArena ) > 1 );
+      REQUIRE( 0 == pkt_arena_free_chunk_count( retainArena ) );
+      for ( const RetainedPacket& packet : retainedPackets )
+      {
+         pkt_arena_release( retainArena, packet.data );
+      }
+      // Every chunk but the one the decoder is writing into is free again
+      REQUIRE( pkt_arena_chunk_count( retainArena ) - 1
+               == pkt_arena_free_chunk_count( retainArena ) );
+   }
+
+   SECTION( "Verify chunks are recycled instead of growing the arena" )
+   {
+      std::vector< uint8_t > frame = framePacket( 300, 0x41 );
+      for ( size_t round = 0; round < 50; ++round )
+      {
+         for ( size_t packet = 0; packet < 20; ++packet )
+         {
+            pkt_decoder_write_bytes( decoder, frame.size(), frame.data() );
+         }
+         for ( const RetainedPacket& packet : retainedPackets )
+         {
+            pkt_arena_release( retainArena, packet.data );
+         }
+         retainedPackets.clear();
+      }
+      REQUIRE( pkt_arena_chunk_count( retainArena ) <= 3 );
+   }
+
+   SECTION( "Verify packets that aren't retained reuse one chunk" )
+   {
+      retainPackets = false;
+      std::vector< uint8_t > frame = framePacket( MAX_DECODED_DATA_LENGTH, 0x41 );
+      for ( size_t packet = 0; packet < 100; ++packet )
+      {
+         pkt_decoder_write_bytes( decoder, frame.size(), frame.data() );
+      }
+      REQUIRE( 100 == retainedPackets.size() );
+      REQUIRE( 1 == pkt_arena_chunk_count( retainArena ) );
+      REQUIRE( retainedPackets.front().data == retainedPackets.back().data );
+   }
+
+   SECTION( "Verify packets can be released on another thread" )
+   {
+      std::vector< uint8_t > frame = framePacket( 200, 0x41 );
+      for ( size_t packet = 0; packet < 60; ++packet )
+      {
+         pkt_decoder_write_bytes( decoder, frame.size(), frame.data() );
+      }
+      std::thread consumer( []() {
+         for ( const RetainedPacket& packet : retainedPackets )
+         {
+            pkt_arena_release( retainArena, packet.data );
+         }
+      } );
+      consumer.join();
+      pkt_decoder_destroy( decoder );
+      decoder = nullptr;
+      REQUIRE( pkt_arena_chunk_count( retainArena ) == pkt_arena_free_chunk_count( retainArena ) );
+   }
+
+   if ( nullptr != decoder )
+   {
+      pkt_decoder_destroy( decoder );
+   }
+   pkt_arena_destroy( retainArena );
+}
@@ -0,0 +1,149 @@
+#include "catch.hpp"
+
+#include <libsrc/pkt_decoder.h>
+#include <set>
+#include <thread>
+#include <vector>
+
+// Number of packets delivered by pooled decoders, and drops reported by them
+static size_t pooledPackets( 0 );
+static std::vector< pkt_error_t > pooledDrops;
+
+static void pooledCallbackFunc( void* ctx, size_t bufferLength, const uint8_t* dataBuffer )
+{
+   ( void )ctx;
+   ( void )bufferLength;
+   ( void )dataBuffer;
+   pooledPackets++;
+}
+
+static void pooledErrorFunc( void* ctx, pkt_error_t reason, size_t partialLength, uint64_t offset )
+{
+   ( void )ctx;
+   ( void )partialLength;
+   ( void )offset;
+   pooledDrops.push_back( reason );
+}
+
+TEST_CASE( "Validate the shared packet buffer pool", "[pool]" )
+{
+   pooledPackets = 0;
+   pooledDrops.clear();
+
+   SECTION( "Verify buffers are distinct and the pool runs dry" )
+   {
+      pkt_buffer_pool_t* pool = pkt_buffer_pool_create( 3 );
+      std::set< uint8_t* > buffers;
+      for ( size_t idx = 0; idx < 3; ++idx )
+      {
+         buffers.insert( pkt_buffer_pool_acquire( pool ) );
+      }
+      REQUIRE( 3 == buffers.size() );
+      REQUIRE( 0 == buffers.count( nullptr ) );
+      REQUIRE( 0 == pkt_buffer_pool_available( pool ) );
+      REQUIRE( nullptr == pkt_buffer_pool_acquire( pool ) );
+      for ( uint8_t* buffer : buffers )
+      {
+         pkt_buffer_pool_release( pool, buffer );
+      }
+      REQUIRE( 3 == pkt_buffer_pool_available( pool ) );
+      pkt_buffer_pool_destroy( pool );
+   }
+
+   SECTION( "Verify many decoders share a few buffers" )
+   {
+      const size_t NUM_DECODERS( 1000 );
+      const uint8_t BYTESTREAM_START[] = { 0x01, STX, 0x04 };
+      const uint8_t BYTESTREAM_END[] = { 0x05, ETX, 0x07 };
+      pkt_buffer_pool_t* pool = pkt_buffer_pool_create( 2 );
+      std::vector< pkt_decoder_t* > decoders;
+      for ( size_t idx = 0; idx < NUM_DECODERS; ++idx )
+      {
+         decoders.push_back( pkt_decoder_create_pooled( pooledCallbackFunc, nullptr, pool ) );
+         pkt_decoder_set_error_callback( decoders.back(), pooledErrorFunc, nullptr );
+      }
+      REQUIRE( 2 == pkt_buffer_pool_available( pool ) );
+
+      // One packet at a time: every decoder borrows and returns a buffer
+      for ( pkt_decoder_t* decoder : decoders )
+      {
+         pkt_decoder_write_bytes( decoder, sizeof( BYTESTREAM_START ), BYTESTREAM_START );
+         pkt_decoder_write_bytes( decoder, sizeof( BYTESTREAM_END ), BYTESTREAM_END );
+      }
+      REQUIRE( NUM_DECODERS == pooledPackets );
+      REQUIRE( 2 == pkt_buffer_pool_available( pool ) );
+
+      // Three packets in flight at once: the third can't get a buffer
+      for ( size_t idx = 0; idx < 3; ++idx )
+      {
+         pkt_decoder_write_bytes( decoders[ idx ], sizeof( BYTESTREAM_START ), BYTESTREAM_START );
+      }
+      REQUIRE( 0 == pkt_buffer_pool_available( pool ) );
+      REQUIRE( 1 == pooledDrops.size() );
+      REQUIRE( PKT_ERROR_NO_BUFFER == pooledDrops[ 0 ] );
+      for ( size_t idx = 0; idx < 3; ++idx )
+      {
+         pkt_decoder_write_bytes( decoders[ idx ], sizeof( BYTESTREAM_END ), BYTESTREAM_END );
+      }
+      REQUIRE( NUM_DECODERS + 2 == pooledPackets );
+      REQUIRE( 2 == pkt_buffer_pool_available( pool ) );
+
+      // A decoder destroyed mid-packet gives its buffer back
+      pkt_decoder_write_bytes( decoders[ 0 ], sizeof( BYTESTREAM_START ), BYTESTREAM_START );
+      REQUIRE( 1 == pkt_buffer_pool_available( pool ) );
+      for ( pkt_decoder_t* decoder : decoders )
+      {
+         pkt_decoder_destroy( decoder );
+      }
+      REQUIRE( 2 == pkt_buffer_pool_available( pool ) );
+      pkt_buffer_pool_destroy( pool );
+   }
+
+   SECTION( "Verify an overflowing packet returns its buffer" )
+   {
+      std::vector< uint8_t > bytestream( MAX_DECODED_DATA_LENGTH + 2, 0x41 );
+      bytestream[ 0 ] = STX;
+      pkt_buffer_pool_t* pool = pkt_buffer_pool_create( 1 );
+      pkt_decoder_t* decoder = pkt_decoder_create_pooled( pooledCallbackFunc, nullptr, pool );
+      pkt_decoder_write_bytes( decoder, bytestream.size(), bytestream.data() );
+      REQUIRE( 1 == pkt_buffer_pool_available( pool ) );
+      pkt_decoder_destroy( decoder );
+      pkt_buffer_pool_destroy( pool );
+   }
+
+   SECTION( "Verify concurrent acquire and release never hand out a buffer twice" )
+   {
+      const size_t NUM_THREADS( 4 );
+      pkt_buffer_pool_t* pool = pkt_buffer_pool_create( NUM_THREADS * 2 );
+      std::vector< std::thread > threads;
+      std::vector< bool > clean( NUM_THREADS, true );
+      for ( size_t thread = 0; thread < NUM_THREADS; ++thread )
+      {
+         threads.emplace_back( [pool, thread, &clean]() {
+            for ( size_t round = 0; round < 20000; ++round )
+            {
+               uint8_t* first = pkt_buffer_pool_acquire( pool );
+               uint8_t* second = pkt_buffer_pool_acquire( pool );
+               first[ 0 ] = second[ 0 ] = static_cast< uint8_t >( thread );
+               std::this_thread::yield();
+               if ( first[ 0 ] != thread || second[ 0 ] != thread )
+               {
+                  clean[ thread ] = false;
+               }
+               pkt_buffer_pool_release( pool, second );
+               pkt_buffer_pool_release( pool, first );
+            }
+         } );
+      }
+      for ( std::thread& thread : threads )
+      {
+         thread.join();
+      }
+      for ( size_t thread = 0; thread < NUM_THREADS; ++thread )
+      {
+         REQUIRE( clean[ thread ] );
+      }
+      REQUIRE( NUM_THREADS * 2 == pkt_buffer_pool_available( pool ) );
+      pkt_buffer_pool_destroy( pool );
+   }
+}
@@ -0,0 +1,164 @@
+#include "catch.hpp"
+
+#include <libsrc/pkt_checkpoint.h>
+#include <vector>
+
+typedef std::vector< std::vector< uint8_t > > PacketList;
+
+// Records every packet delivered, with its STX time as a final byte
+static void checkpointTimestampFunc( void* ctx,
+                                     size_t bufferLength,
+                                     const uint8_t* dataBuffer,
+                                     const pkt_timestamps_t* timestamps )
+{
+   auto* packets = static_cast< PacketList* >( ctx );
+   packets->emplace_back( dataBuffer, dataBuffer + bufferLength );
+   packets->back().push_back( static_cast< uint8_t >( timestamps->stx_time ) );
+}
+
+static void checkpointCallbackFunc( void* ctx, size_t bufferLength, const uint8_t* dataBuffer )
+{
+   static_cast< PacketList* >( ctx )->emplace_back( dataBuffer, dataBuffer + bufferLength );
+}
+
+static bool checkpointFilterFunc( void* ctx, size_t bufferLength, const uint8_t* dataBuffer )
+{
+   ( void )ctx;
+   ( void )bufferLength;
+   return 0x06 != dataBuffer[ 1 ];
+}
+
+TEST_CASE( "Validate decoder checkpoints", "[checkpoint]" )
+{
+   // Garbage with a DLE, packets with escapes, a filtered packet and a hanging DLE
+   const uint8_t BYTESTREAM[] = { 0x41, DLE, 0x42, STX, 0x61, 0x62, DLE, 0x22, 0x63, ETX,
+                                  STX,  0x41, 0x06, 0x43, DLE, ETX,  STX, 0x61, ETX,  0x01,
+                                  STX,  0x41, 0x42, DLE,  0x23, 0x43, 0x44, DLE, ETX };
+   PacketList expected;
+   PacketList packets;
+
+   SECTION( "Verify a stream moved to a new decoder at any byte decodes the same" )
+   {
+      pkt_decoder_t* whole = pkt_decoder_create_ts( checkpointTimestampFunc, &expected );
+      pkt_decoder_set_filter( whole, 2, checkpointFilterFunc, nullptr );
+      for ( size_t idx = 0; idx < sizeof( BYTESTREAM ); ++idx )
+      {
+         pkt_decoder_write_bytes_ts( whole, 1, BYTESTREAM + idx, idx );
+      }
+      pkt_decoder_destroy( whole );
+      REQUIRE( 3 == expected.size() );
+
+      for ( size_t split = 0; split <= sizeof( BYTESTREAM ); ++split )
+      {
+         packets.clear();
+         pkt_decoder_t* first = pkt_decoder_create_ts( checkpointTimestampFunc, &packets );
+         pkt_decoder_set_filter( first, 2, checkpointFilterFunc, nullptr );
+         for ( size_t idx = 0; idx < split; ++idx )
+         {
+            pkt_decoder_write_bytes_ts( first, 1, BYTESTREAM + idx, idx );
+         }
+         uint8_t checkpoint[ PKT_CHECKPOINT_MAX_LENGTH ];
+         size_t length = pkt_checkpoint_save( first, checkpoint );
+         REQUIRE( pkt_checkpoint_length( first ) == length );
+         pkt_decoder_destroy( first );
+
+         pkt_decoder_t* second = pkt_decoder_create_ts( checkpointTimestampFunc, &packets );
+         pkt_decoder_set_filter( second, 2, checkpointFilterFunc, nullptr );
+         REQUIRE( length == pkt_checkpoint_restore( second, length, checkpoint ) );
+         REQUIRE( split == second->m_streamOffset );
+         for ( size_t idx = split; idx < sizeof( BYTESTREAM ); ++idx )
+         {
+            pkt_decoder_write_bytes_ts( second, 1, BYTESTREAM + idx, idx );
+         }
+         pkt_decoder_destroy( second );
+         REQUIRE( expected == packets );
+      }
+   }
+
+   SECTION( "Verify thousands of decoders move in bulk, into pooled decoders" )
+   {
+      const size_t NUM_DECODERS( 2000 );
+      std::vector< pkt_decoder_t* > sources;
+      std::vector< pkt_decoder_t* > targets;
+      std::vector< size_t > splits;
+      pkt_buffer_pool_t* pool = pkt_buffer_pool_create( NUM_DECODERS );
+      for ( size_t idx = 0; idx < NUM_DECODERS; ++idx )
+      {
+         sources.push_back( pkt_decoder_create( checkpointCallbackFunc, &packets ) );
+         targets.push_back( pkt_decoder_create_pooled( checkpointCallbackFunc, &packets, pool ) );
+         // Every other decoder is part way through a packet; the rest are hunting
+         splits.push_back( ( 0 == idx % 2 ) ? 3 : 14 );
+         pkt_decoder_write_bytes( sources.back(), splits.back(), BYTESTREAM );
+      }
+
+      std::vector< uint8_t > checkpoints(
+         pkt_checkpoint_length_all( sources.data(), sources.size() ) );
+      REQUIRE( checkpoints.size()
+               == pkt_checkpoint_save_all( sources.data(), sources.size(), checkpoints.data() ) );
+      REQUIRE( pkt_checkpoint_restore_all(
+         targets.data(), targets.size(), checkpoints.size(), checkpoints.data() ) );
+      REQUIRE( NUM_DECODERS / 2 == pkt_buffer_pool_available( pool ) );
+
+      for ( size_t idx = 0; idx < NUM_DECODERS; ++idx )
+      {
+         pkt_decoder_write_bytes(
+            targets[ idx ], sizeof( BYTESTREAM ) - splits[ idx ], BYTESTREAM + splits[ idx ] );
+      }
+      REQUIRE( NUM_DECODERS * 4 == packets.size() );
+      REQUIRE( NUM_DECODERS == pkt_buffer_pool_available( pool ) );
+
+      for ( size_t idx = 0; idx < NUM_DECODERS; ++idx )
+      {
+         pkt_decoder_destroy( sources[ idx ] );
+         pkt_decoder_destroy( targets[ idx ] );
+      }
+      pkt_buffer_pool_destroy( pool );
+   }
+
+   SECTION( "Verify a packet restored into a filtering decoder is still filtered" )
+   {
+      // The filtered packet, part way through, then the rest of it and a good packet
+      const uint8_t HEAD[] = { STX, 0x41, 0x06, 0x43 };
+      const uint8_t TAIL[] = { 0x44, ETX, STX, 0x61, ETX };
+      uint8_t checkpoint[ PKT_CHECKPOINT_MAX_LENGTH ];
+      pkt_decoder_t* first = pkt_decoder_create( checkpointCallbackFunc, &packets );
+      pkt_decoder_write_bytes( first, sizeof( HEAD ), HEAD );
+      size_t length = pkt_checkpoint_save( first, checkpoint );
+      pkt_decoder_destroy( first );
+
+      pkt_decoder_t* filtered = pkt_decoder_create( checkpointCallbackFunc, &packets );
+      pkt_decoder_set_filter( filtered, 2, checkpointFilterFunc, nullptr );
+      REQUIRE( length == pkt_checkpoint_restore( filtered, length, checkpoint ) );
+      REQUIRE_FALSE( filtered->m_pktValid );
+      pkt_decoder_write_bytes( filtered, sizeof( TAIL ), TAIL );
+      pkt_decoder_destroy( filtered );
+      REQUIRE( 1 == packets.size() );
+      REQUIRE( std::vector< uint8_t >{ 0x61 } == packets[ 0 ] );
+
+      packets.clear();
+      pkt_decoder_t* routed = pkt_decoder_create( checkpointCallbackFunc, &packets );
+      pkt_decoder_set_route_offset( routed, 1 );
+      pkt_decoder_set_route_drop( routed, 0x06, true );
+      REQUIRE( length == pkt_checkpoint_restore( routed, length, checkpoint ) );
+      REQUIRE_FALSE( routed->m_pktValid );
+      pkt_decoder_write_bytes( routed, sizeof( TAIL ), TAIL );
+      pkt_decoder_destroy( routed );
+      REQUIRE( 1 == packets.size() );
+      REQUIRE( std::vector< uint8_t >{ 0x61 } == packets[ 0 ] );
+   }
+
+   SECTION( "Verify malformed checkpoints are rejected" )
+   {
+      pkt_decoder_t* decoder = pkt_decoder_create( checkpointCallbackFunc, &packets );
+      pkt_decoder_write_bytes( decoder, 6, BYTESTREAM );
+      uint8_t checkpoint[ PKT_CHECKPOINT_MAX_LENGTH ];
+      size_t length = pkt_checkpoint_save( decoder, checkpoint );
+      REQUIRE( 0 == pkt_checkpoint_restore( decoder, length - 1, checkpoint ) );
+      REQUIRE_FALSE( decoder->m_pktValid );
+      checkpoint[ 0 ] = 0x7F;
+      REQUIRE( 0 == pkt_checkpoint_restore( decoder, length, checkpoint ) );
+      pkt_decoder_t* decoders[] = { decoder, decoder };
+      REQUIRE_FALSE( pkt_checkpoint_restore_all( decoders, 2, length, checkpoint ) );
+      pkt_decoder_destroy( decoder );
+   }
+}
@@ -0,0 +1,137 @@
+#include "catch.hpp"
+
+#include <cstring>
+#include <libsrc/pkt_decoder.h>
+#include <vector>
+
+// Packets delivered to the read and checksum-error callbacks of the decoder under test
+static std::vector< std::vector< uint8_t > > goodPackets;
+static std::vector< std::vector< uint8_t > > badPackets;
+
+static void goodCallbackFunc( void* ctx, size_t bufferLength, const uint8_t* dataBuffer )
+{
+   ( void )ctx;
+   goodPackets.emplace_back( dataBuffer, dataBuffer + bufferLength );
+}
+
+static void badCallbackFunc( void* ctx, size_t bufferLength, const uint8_t* dataBuffer )
+{
+   ( void )ctx;
+   badPackets.emplace_back( dataBuffer, dataBuffer + bufferLength );
+}
+
+// Frame a payload plus its trailer, byte-stuffing wherever needed
+static std::vector< uint8_t > frame( pkt_checksum_t type, std::vector< uint8_t > payload )
+{
+   uint8_t trailer[ PKT_MAX_CHECKSUM_LENGTH ];
+   size_t trailerLength = pkt_checksum_append( type, payload.size(), payload.data(), trailer );
+   payload.insert( payload.end(), trailer, trailer + trailerLength );
+
+   std::vector< uint8_t > stream = { STX };
+   for ( uint8_t byte : payload )
+   {
+      if ( STX == byte || ETX == byte || DLE == byte )
+      {
+         stream.push_back( DLE );
+         byte |= ENC;
+      }
+      stream.push_back( byte );
+   }
+   stream.push_back( ETX );
+   return stream;
+}
+
+TEST_CASE( "Validate checksum algorithms", "[checksum]" )
+{
+   const char* CHECK_STRING = "123456789";
+   const uint8_t* CHECK_DATA = reinterpret_cast< const uint8_t* >( CHECK_STRING );
+
+   SECTION( "Verify the CRC-16/CCITT check value" )
+   {
+      REQUIRE( 0x29B1 == pkt_crc16_ccitt( PKT_CRC16_CCITT_INIT, 9, CHECK_DATA ) );
+   }
+
+   SECTION( "Verify the CRC-32C check value, in one call and in pieces" )
+   {
+      REQUIRE( 0xE3069283 == pkt_crc32c( PKT_CRC32C_INIT, 9, CHECK_DATA ) );
+      uint32_t crc = pkt_crc32c( PKT_CRC32C_INIT, 4, CHECK_DATA );
+      REQUIRE( 0xE3069283 == pkt_crc32c( crc, 5, CHECK_DATA + 4 ) );
+   }
+
+   SECTION( "Verify the software and hardware CRC-32C against known vectors" )
+   {
+      // RFC 3720 B.4: 32 zero bytes, 32 0xFF bytes and 32 ascending bytes
+      uint8_t zeros[ 32 ] = {};
+      uint8_t ones[ 32 ];
+      uint8_t ascending[ 32 ];
+      memset( ones, 0xFF, sizeof( ones ) );
+      for ( size_t idx = 0; idx < sizeof( ascending ); ++idx )
+      {
+         ascending[ idx ] = static_cast< uint8_t >( idx );
+      }
+      typedef uint32_t ( *crc32c_fn_t )( uint32_t, size_t, const uint8_t* );
+      std::vector< crc32c_fn_t > impls = { pkt_crc32c, pkt_crc32c_software };
+      if ( pkt_crc32c_hardware_supported() )
+      {
+         impls.push_back( pkt_crc32c_hardware );
+      }
+      for ( crc32c_fn_t impl : impls )
+      {
+         REQUIRE( 0xE3069283 == impl( PKT_CRC32C_INIT, 9, CHECK_DATA ) );
+         REQUIRE( 0x8A9136AA == impl( PKT_CRC32C_INIT, sizeof( zeros ), zeros ) );
+         REQUIRE( 0x62A8AB43 == impl( PKT_CRC32C_INIT, sizeof( ones ), ones ) );
+         REQUIRE( 0x46DD794E == impl( PKT_CRC32C_INIT, sizeof( ascending ), ascending ) );
+         // Lengths that leave the hardware path a tail of single bytes
+         REQUIRE( pkt_crc32c_software( PKT_CRC32C_INIT, 13, ascending + 3 )
+                  == impl( PKT_CRC32C_INIT, 13, ascending + 3 ) );
+         REQUIRE( PKT_CRC32C_INIT == impl( PKT_CRC32C_INIT, 0, CHECK_DATA ) );
+      }
+   }
+}
+
+TEST_CASE( "Validate packet decoding & callbacks - Trailer checksums", "[checksum]" )
+{
+   goodPackets.clear();
+   badPackets.clear();
+   const std::vector< uint8_t > PAYLOAD = { 0x01, STX, 0x7F, ETX, DLE, 0xFF };
+
+   SECTION( "Verify valid packets are delivered without their trailer" )
+   {
+      for ( pkt_checksum_t type : { PKT_CHECKSUM_CRC16_CCITT, PKT_CHECKSUM_CRC32C } )
+      {
+         goodPackets.clear();
+         std::vector< uint8_t > stream = frame( type, PAYLOAD );
+         pkt_decoder_t* decoder = pkt_decoder_create( goodCallbackFunc, nullptr );
+         pkt_decoder_set_checksum( decoder, type, badCallbackFunc );
+         pkt_decoder_write_bytes( decoder, stream.size(), stream.data() );
+         REQUIRE( 1 == goodPackets.size() );
+         REQUIRE( PAYLOAD == goodPackets[ 0 ] );
+         REQUIRE( badPackets.empty() );
+         pkt_decoder_destroy( decoder );
+      }
+   }
+
+   SECTION( "Verify a corrupted packet goes to the error callback" )
+   {
+      std::vector< uint8_t > stream = frame( PKT_CHECKSUM_CRC32C, PAYLOAD );
+      stream[ 1 ] ^= 0x40;
+      pkt_decoder_t* decoder = pkt_decoder_create( goodCallbackFunc, nullptr );
+      pkt_decoder_set_checksum( decoder, PKT_CHECKSUM_CRC32C, badCallbackFunc );
+      pkt_decoder_write_bytes( decoder, stream.size(), stream.data() );
+      REQUIRE( goodPackets.empty() );
+      REQUIRE( 1 == badPackets.size() );
+      REQUIRE( PAYLOAD.size() + 4 == badPackets[ 0 ].size() );
+      pkt_decoder_destroy( decoder );
+   }
+
+   SECTION( "Verify a packet shorter than the trailer fails the check" )
+   {
+      const uint8_t BYTESTREAM[] = { STX, 0x01, ETX };
+      pkt_decoder_t* decoder = pkt_decoder_create( goodCallbackFunc, nullptr );
+      pkt_decoder_set_checksum( decoder, PKT_CHECKSUM_CRC16_CCITT, badCallbackFunc );
+      pkt_decoder_write_bytes( decoder, sizeof( BYTESTREAM ), BYTESTREAM );
+      REQUIRE( goodPackets.empty() );
+      REQUIRE( 1 == badPackets.size() );
+      pkt_decoder_destroy( decoder );
+   }
+}
@@ -0,0 +1,200 @@
+#include "catch.hpp"
+
+#include <libsrc/cobs_decoder.h>
+#include <libsrc/pkt_corpus.h>
+#include <vector>
+
+namespace
+{
+   struct CorpusResult
+   {
+      std::vector< std::vector< uint8_t > > packets;
+      size_t aborted;
+      size_t overflows;
+      size_t otherErrors;
+   };
+
+   void corpusPacketFunc( void* ctx, size_t bufferLength, const uint8_t* dataBuffer )
+   {
+      static_cast< CorpusResult* >( ctx )->packets.emplace_back( dataBuffer,
+                                                                 dataBuffer + bufferLength );
+   }
+
+   void corpusErrorFunc( void* ctx, pkt_error_t reason, size_t partialLength, uint64_t offset )
+   {
+      ( void )partialLength;
+      ( void )offset;
+      auto* result = static_cast< CorpusResult* >( ctx );
+      if ( PKT_ERROR_ABORTED == reason )
+      {
+         result->aborted++;
+      }
+      else if ( PKT_ERROR_OVERFLOW == reason )
+      {
+         result->overflows++;
+      }
+      else
+      {
+         result->otherErrors++;
+      }
+   }
+
+   std::vector< std::vector< uint8_t > > corpusPackets( const pkt_corpus_t* corpus )
+   {
+      std::vector< std::vector< uint8_t > > packets;
+      for ( size_t index = 0; index < pkt_corpus_packet_count( corpus ); ++index )
+      {
+         size_t length;
+         const uint8_t* packet = pkt_corpus_packet( corpus, index, &length );
+         packets.emplace_back( packet, packet + length );
+      }
+      return packets;
+   }
+
+   // FNV-1a
+   uint64_t corpusHash( const pkt_corpus_t* corpus )
+   {
+      uint64_t hash = 0xcbf29ce484222325ULL;
+      for ( size_t idx = 0; idx < pkt_corpus_stream_length( corpus ); ++idx )
+      {
+         hash = ( hash ^ pkt_corpus_stream( corpus )[ idx ] ) * 0x100000001b3ULL;
+      }
+      return hash;
+   }
+} // namespace
+
+TEST_CASE( "Validate the traffic corpus generator", "[corpus]" )
+{
+   pkt_corpus_config_t config;
+   pkt_corpus_default_config( &config );
+   config.seed = 42;
+   config.payload_bytes = 32 * 1024;
+   config.escape_rate = 0.05;
+   config.truncated_rate = 0.05;
+   config.overflow_rate = 0.05;
+   config.min_chunk = 1;
+   config.max_chunk = 300;
+
+   SECTION( "Verify the same config generates the same corpus, and another seed a different one" )
+   {
+      pkt_corpus_t* first = pkt_corpus_create( &config );
+      pkt_corpus_t* second = pkt_corpus_create( &config );
+      config.seed = 43;
+      pkt_corpus_t* other = pkt_corpus_create( &config );
+      REQUIRE( nullptr != first );
+      REQUIRE( first->m_stream == second->m_stream );
+      REQUIRE( first->m_chunks == second->m_chunks );
+      REQUIRE( first->m_payloads == second->m_payloads );
+      REQUIRE( first->m_stream != other->m_stream );
+      pkt_corpus_destroy( first );
+      pkt_corpus_destroy( second );
+      pkt_corpus_destroy( other );
+   }
+
+   SECTION( "Verify the corpus for a fixed config never changes" )
+   {
+      // Benchmark results are only comparable if they were run on the same bytes
+      pkt_corpus_t* corpus = pkt_corpus_create( &config );
+      REQUIRE( 0x6b73ac099bccba88ULL == corpusHash( corpus ) );
+      pkt_corpus_destroy( corpus );
+   }
+
+   SECTION( "Verify a DLE decoder delivers exactly the corpus packets and errors" )
+   {
+      config.garbage_ratio = 0.3;
+      pkt_corpus_t* corpus = pkt_corpus_create( &config );
+      REQUIRE( nullptr != corpus );
+      REQUIRE( pkt_corpus_truncated_count( corpus ) > 0 );
+      REQUIRE( pkt_corpus_overflow_count( corpus ) > 0 );
+
+      size_t offset = 0;
+      for ( size_t chunk = 0; chunk < pkt_corpus_chunk_count( corpus ); ++chunk )
+      {
+         REQUIRE( pkt_corpus_chunks( corpus )[ chunk ] >= 1 );
+         REQUIRE( pkt_corpus_chunks( corpus )[ chunk ] <= 300 );
+         offset += pkt_corpus_chunks( corpus )[ chunk ];
+      }
+      REQUIRE( pkt_corpus_stream_length( corpus ) == offset );
+
+      CorpusResult result = {};
+      pkt_decoder_t* decoder = pkt_decoder_create( corpusPacketFunc, &result );
+      pkt_decoder_set_error_callback( decoder, corpusErrorFunc, &result );
+      offset = 0;
+      for ( size_t chunk = 0; chunk < pkt_corpus_chunk_count( corpus ); ++chunk )
+      {
+         size_t length = pkt_corpus_chunks( corpus )[ chunk ];
+         pkt_decoder_write_bytes( decoder, length, pkt_corpus_stream( corpus ) + offset );
+         offset += length;
+      }
+      pkt_decoder_destroy( decoder );
+
+      REQUIRE( corpusPackets( corpus ) == result.packets );
+      REQUIRE( pkt_corpus_truncated_count( corpus ) == result.aborted );
+      REQUIRE( pkt_corpus_overflow_count( corpus ) == result.overflows );
+      REQUIRE( 0 == result.otherErrors );
+      pkt_corpus_destroy( corpus );
+   }
+
+   SECTION( "Verify a COBS decoder delivers the same packets from the same config" )
+   {
+      pkt_corpus_t* dleCorpus = pkt_corpus_create( &config );
+      config.framing = PKT_CORPUS_COBS;
+      pkt_corpus_t* corpus = pkt_corpus_create( &config );
+      REQUIRE( nullptr != corpus );
+
+      CorpusResult result = {};
+      cobs_decoder_t* decoder = cobs_decoder_create( corpusPacketFunc, &result );
+      size_t offset = 0;
+      for ( size_t chunk = 0; chunk < pkt_corpus_chunk_count( corpus ); ++chunk )
+      {
+         size_t length = pkt_corpus_chunks( corpus )[ chunk ];
+         cobs_decoder_write_bytes( decoder, length, pkt_corpus_stream( corpus ) + offset );
+         offset += length;
+      }
+      cobs_decoder_destroy( decoder );
+
+      REQUIRE( corpusPackets( corpus ) == result.packets );
+      REQUIRE( corpusPackets( dleCorpus ) == result.packets );
+      REQUIRE( pkt_corpus_payload_length( corpus ) >= config.payload_bytes );
+      pkt_corpus_destroy( corpus );
+      pkt_corpus_destroy( dleCorpus );
+   }
+
+   SECTION( "Verify bimodal sizes use only the two lengths" )
+   {
+      config.size_distribution = PKT_CORPUS_SIZE_BIMODAL;
+      config.min_payload = 8;
+      config.max_payload = 400;
+      pkt_corpus_t* corpus = pkt_corpus_create( &config );
+      size_t shortCount = 0;
+      for ( const auto& packet : corpusPackets( corpus ) )
+      {
+         REQUIRE( ( ( 8 == packet.size() ) || ( 400 == packet.size() ) ) );
+         shortCount += ( 8 == packet.size() ) ? 1 : 0;
+      }
+      REQUIRE( shortCount > 0 );
+      REQUIRE( shortCount < pkt_corpus_packet_count( corpus ) );
+      pkt_corpus_destroy( corpus );
+   }
+
+   SECTION( "Verify out-of-range configs are rejected" )
+   {
+      pkt_corpus_config_t bad = config;
+      bad.min_payload = 0;
+      REQUIRE( nullptr == pkt_corpus_create( &bad ) );
+      bad = config;
+      bad.max_payload = MAX_DECODED_DATA_LENGTH + 1;
+      REQUIRE( nullptr == pkt_corpus_create( &bad ) );
+      bad = config;
+      bad.truncated_rate = 0.5;
+      bad.overflow_rate = 0.5;
+      REQUIRE( nullptr == pkt_corpus_create( &bad ) );
+      bad = config;
+      bad.min_chunk = 0;
+      REQUIRE( nullptr == pkt_corpus_create( &bad ) );
+      bad = config;
+      bad.framing = PKT_CORPUS_COBS;
+      bad.garbage_ratio = 0.1;
+      REQUIRE( nullptr == pkt_corpus_create( &bad ) );
+   }
+}
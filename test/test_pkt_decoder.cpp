@@ -3,6 +3,7 @@
 
 #include <cstring>
 #include <libsrc/pkt_decoder.h>
+#include <vector>
 
 using std::ostringstream;
 
@@ -357,6 +358,43 @@ TEST_CASE( "Validate packet decoding & callbacks - Invalid packets", "[validatio
       pkt_decoder_destroy( decoder );
    }
 
+   SECTION( "Verify garbage after an overflow is skipped until the next STX" )
+   {
+      std::vector< uint8_t > bytestream( MAX_DECODED_DATA_LENGTH + 2, 0x41 );
+      bytestream[ 0 ] = STX;
+      // Garbage that would be a valid packet body, but with no STX in front of it
+      const uint8_t GARBAGE[] = { 0x01, ETX, 0x04, 0x05, ETX, 0x06 };
+      const uint8_t BYTESTREAM_END[] = { STX, 0x07, ETX };
+
+      REQUIRE_FALSE( callbackWasCalled );
+      pkt_decoder_t* decoder = pkt_decoder_create( myCallbackFunc, nullptr );
+      pkt_decoder_write_bytes( decoder, bytestream.size(), bytestream.data() );
+      REQUIRE_FALSE( decoder->m_pktValid );
+      pkt_decoder_write_bytes( decoder, sizeof( GARBAGE ), GARBAGE );
+      REQUIRE_FALSE( decoder->m_pktValid );
+      REQUIRE_FALSE( callbackWasCalled );
+      pkt_decoder_write_bytes( decoder, sizeof( BYTESTREAM_END ), BYTESTREAM_END );
+      REQUIRE( numCallbacks == 1 );
+      REQUIRE( actualBufferLength == 1 );
+      REQUIRE( 0x07 == decoder->m_packetBuffer[ 0 ] );
+
+      pkt_decoder_destroy( decoder );
+   }
+
+   SECTION( "Verify a DLE in skipped garbage still de-stuffs the next packet's first byte" )
+   {
+      const uint8_t BYTESTREAM[] = { 0x41, DLE, 0x42, STX, 0x30, 0x05, ETX };
+
+      REQUIRE_FALSE( callbackWasCalled );
+      pkt_decoder_t* decoder = pkt_decoder_create( myCallbackFunc, nullptr );
+      pkt_decoder_write_bytes( decoder, sizeof( BYTESTREAM ), BYTESTREAM );
+      REQUIRE( numCallbacks == 1 );
+      REQUIRE( actualBufferLength == 2 );
+      REQUIRE( DLE == decoder->m_packetBuffer[ 0 ] );
+
+      pkt_decoder_destroy( decoder );
+   }
+
    SECTION( "Verify incomplete packet is dropped and valid packet is handled" )
    {
       const uint8_t BYTESTREAM[] = { STX, 0x01, 0x02, STX, 0x04, 0x05, ETX };
@@ -376,3 +414,415 @@ TEST_CASE( "Validate packet decoding & callbacks - Invalid packets", "[validatio
       pkt_decoder_destroy( decoder );
    }
 }
+
+// A dropped packet, as reported to the error callback
+struct DropReport
+{
+   pkt_error_t reason;
+   size_t partialLength;
+   uint64_t streamOffset;
+};
+
+static void myErrorFunc( void* ctx,
+                         pkt_error_t reason,
+                         size_t partialLength,
+                         uint64_t streamOffset )
+{
+   static_cast< std::vector< DropReport >* >( ctx )->push_back(
+      { reason, partialLength, streamOffset } );
+}
+
+TEST_CASE( "Validate packet decoding & callbacks - Error callback", "[validation]" )
+{
+   std::vector< DropReport > drops;
+
+   SECTION( "Verify each kind of drop is reported with its partial length and offset" )
+   {
+      const uint8_t BYTESTREAM_START[] = { 0x01, STX, 0x01, 0x04, STX, ETX };
+      const uint8_t BYTESTREAM_END[] = { STX, 0x04, ETX, ETX };
+
+      pkt_decoder_t* decoder = pkt_decoder_create( myCallbackFunc, nullptr );
+      pkt_decoder_set_error_callback( decoder, myErrorFunc, &drops );
+      pkt_decoder_write_bytes( decoder, sizeof( BYTESTREAM_START ), BYTESTREAM_START );
+      pkt_decoder_write_bytes( decoder, sizeof( BYTESTREAM_END ), BYTESTREAM_END );
+      REQUIRE( numCallbacks == 1 );
+      // The lone ETX after the valid packet isn't a dropped packet, so it isn't reported
+      REQUIRE( 2 == drops.size() );
+      REQUIRE( PKT_ERROR_ABORTED == drops[ 0 ].reason );
+      REQUIRE( 2 == drops[ 0 ].partialLength );
+      REQUIRE( 4 == drops[ 0 ].streamOffset );
+      REQUIRE( PKT_ERROR_EMPTY == drops[ 1 ].reason );
+      REQUIRE( 0 == drops[ 1 ].partialLength );
+      REQUIRE( 5 == drops[ 1 ].streamOffset );
+
+      pkt_decoder_destroy( decoder );
+   }
+
+   SECTION( "Verify an overflow is reported once" )
+   {
+      std::vector< uint8_t > bytestream( MAX_DECODED_DATA_LENGTH + 8, 0x41 );
+      bytestream[ 0 ] = STX;
+      bytestream.push_back( ETX );
+
+      pkt_decoder_t* decoder = pkt_decoder_create( myCallbackFunc, nullptr );
+      pkt_decoder_set_error_callback( decoder, myErrorFunc, &drops );
+      pkt_decoder_write_bytes( decoder, bytestream.size(), bytestream.data() );
+      REQUIRE_FALSE( callbackWasCalled );
+      REQUIRE( 1 == drops.size() );
+      REQUIRE( PKT_ERROR_OVERFLOW == drops[ 0 ].reason );
+      REQUIRE( MAX_DECODED_DATA_LENGTH == drops[ 0 ].partialLength );
+      REQUIRE( MAX_DECODED_DATA_LENGTH + 1 == drops[ 0 ].streamOffset );
+
+      pkt_decoder_destroy( decoder );
+   }
+}
+
+// Arrival times of every packet delivered to myTimestampFunc
+static void myTimestampFunc( void* ctx,
+                             size_t bufferLength,
+                             const uint8_t* dataBuffer,
+                             const pkt_timestamps_t* timestamps )
+{
+   myCallbackFunc( nullptr, bufferLength, dataBuffer );
+   static_cast< std::vector< pkt_timestamps_t >* >( ctx )->push_back( *timestamps );
+}
+
+TEST_CASE( "Validate packet decoding & callbacks - Timestamps", "[validation]" )
+{
+   std::vector< pkt_timestamps_t > stamps;
+
+   SECTION( "Verify a packet that spans writes is stamped with its STX and ETX times" )
+   {
+      const uint8_t BYTESTREAM_START[] = { STX, 0x01, ETX, STX, 0x04 };
+      const uint8_t BYTESTREAM_END[] = { 0x05, ETX };
+
+      pkt_decoder_t* decoder = pkt_decoder_create_ts( myTimestampFunc, &stamps );
+      pkt_decoder_write_bytes_ts( decoder, sizeof( BYTESTREAM_START ), BYTESTREAM_START, 100 );
+      pkt_decoder_write_bytes_ts( decoder, sizeof( BYTESTREAM_END ), BYTESTREAM_END, 250 );
+      REQUIRE( numCallbacks == 2 );
+      REQUIRE( 2 == stamps.size() );
+      REQUIRE( 100 == stamps[ 0 ].stx_time );
+      REQUIRE( 100 == stamps[ 0 ].etx_time );
+      REQUIRE( 100 == stamps[ 1 ].stx_time );
+      REQUIRE( 250 == stamps[ 1 ].etx_time );
+
+      pkt_decoder_destroy( decoder );
+   }
+
+   SECTION( "Verify the library clock can stamp packets" )
+   {
+      const uint8_t BYTESTREAM_START[] = { STX, 0x01 };
+      const uint8_t BYTESTREAM_END[] = { ETX };
+
+      pkt_decoder_t* decoder = pkt_decoder_create_ts( myTimestampFunc, &stamps );
+      uint64_t before = pkt_clock_now();
+      pkt_decoder_write_bytes_ts(
+         decoder, sizeof( BYTESTREAM_START ), BYTESTREAM_START, PKT_TIMESTAMP_NOW );
+      pkt_decoder_write_bytes_ts(
+         decoder, sizeof( BYTESTREAM_END ), BYTESTREAM_END, PKT_TIMESTAMP_NOW );
+      REQUIRE( 1 == stamps.size() );
+      REQUIRE( before <= stamps[ 0 ].stx_time );
+      REQUIRE( stamps[ 0 ].stx_time <= stamps[ 0 ].etx_time );
+      REQUIRE( pkt_clock_ns_per_tick() > 0.0 );
+
+      pkt_decoder_destroy( decoder );
+   }
+}
+
+// Records every packet a route handler receives
+static void myRouteFunc( void* ctx, size_t bufferLength, const uint8_t* dataBuffer )
+{
+   static_cast< std::vector< std::vector< uint8_t > >* >( ctx )->emplace_back(
+      dataBuffer, dataBuffer + bufferLength );
+}
+
+TEST_CASE( "Validate packet decoding & callbacks - Routing", "[validation]" )
+{
+   std::vector< std::vector< uint8_t > > routed;
+   std::vector< DropReport > drops;
+
+   SECTION( "Verify packets are dispatched on their type byte" )
+   {
+      const uint8_t BYTESTREAM[] = { STX, 0x7F, 0x04, 0x01, ETX, STX, 0x7F, 0x05, ETX,
+                                     STX, 0x7F, 0x04, ETX,  STX, 0x7F, ETX };
+
+      pkt_decoder_t* decoder = pkt_decoder_create( myCallbackFunc, nullptr );
+      pkt_decoder_set_route_offset( decoder, 1 );
+      pkt_decoder_set_route( decoder, 0x04, myRouteFunc, &routed );
+      pkt_decoder_write_bytes( decoder, sizeof( BYTESTREAM ), BYTESTREAM );
+      REQUIRE( 2 == routed.size() );
+      REQUIRE( std::vector< uint8_t >( { 0x7F, 0x04, 0x01 } ) == routed[ 0 ] );
+      REQUIRE( std::vector< uint8_t >( { 0x7F, 0x04 } ) == routed[ 1 ] );
+      // Type 0x05 has no handler, and the last packet is too short to have a type
+      REQUIRE( numCallbacks == 2 );
+
+      pkt_decoder_set_route( decoder, 0x04, nullptr, nullptr );
+      pkt_decoder_write_bytes( decoder, sizeof( BYTESTREAM ), BYTESTREAM );
+      REQUIRE( 2 == routed.size() );
+      REQUIRE( numCallbacks == 6 );
+
+      pkt_decoder_destroy( decoder );
+   }
+
+   SECTION( "Verify dropped types are discarded without being buffered" )
+   {
+      // The dropped packet has an escaped type byte, and ends in a DLE that still applies to
+      // the first byte of the next packet
+      const uint8_t BYTESTREAM[] = { STX, 0x7F, DLE, 0x26, 0x01, 0x02 + ENC, DLE, ETX,
+                                     STX, 0x24, 0x04, ETX,  STX, 0x7F, 0x06, 0x41, ETX };
+
+      pkt_decoder_t* decoder = pkt_decoder_create( myCallbackFunc, nullptr );
+      pkt_decoder_set_error_callback( decoder, myErrorFunc, &drops );
+      pkt_decoder_set_route_offset( decoder, 1 );
+      pkt_decoder_set_route( decoder, 0x04, myRouteFunc, &routed );
+      pkt_decoder_set_route( decoder, 0x06, myRouteFunc, &routed );
+      pkt_decoder_set_route_drop( decoder, 0x06, true );
+      pkt_decoder_write_bytes( decoder, 4, BYTESTREAM );
+      // Only the header and the type byte were buffered
+      REQUIRE( 2 == decoder->m_pktBufIdx );
+      pkt_decoder_write_bytes( decoder, sizeof( BYTESTREAM ) - 4, BYTESTREAM + 4 );
+      REQUIRE( 1 == routed.size() );
+      REQUIRE( std::vector< uint8_t >( { 0x04, 0x04 } ) == routed[ 0 ] );
+      REQUIRE_FALSE( callbackWasCalled );
+      REQUIRE( drops.empty() );
+
+      pkt_decoder_destroy( decoder );
+   }
+
+   SECTION( "Verify removing the last dropped type resumes bulk decoding" )
+   {
+      const uint8_t BYTESTREAM[] = { STX, 0x7F, 0x06, 0x41, ETX, STX, 0x7F, 0x07, ETX };
+
+      pkt_decoder_t* decoder = pkt_decoder_create( myCallbackFunc, nullptr );
+      REQUIRE( decoder->decodesInBulk() );
+      pkt_decoder_set_route_offset( decoder, 1 );
+      pkt_decoder_set_route_drop( decoder, 0x06, true );
+      pkt_decoder_set_route_drop( decoder, 0x07, true );
+      REQUIRE_FALSE( decoder->decodesInBulk() );
+      pkt_decoder_set_route_drop( decoder, 0x06, false );
+      REQUIRE_FALSE( decoder->decodesInBulk() );
+      pkt_decoder_write_bytes( decoder, sizeof( BYTESTREAM ), BYTESTREAM );
+      REQUIRE( 1 == numCallbacks );
+
+      pkt_decoder_set_route_drop( decoder, 0x07, false );
+      REQUIRE( 0 == decoder->m_routeDropIdx );
+      REQUIRE( decoder->decodesInBulk() );
+      pkt_decoder_write_bytes( decoder, sizeof( BYTESTREAM ), BYTESTREAM );
+      REQUIRE( 3 == numCallbacks );
+
+      pkt_decoder_destroy( decoder );
+   }
+}
+
+// Keeps packets without a 0x06 in their first two bytes, counting the packets it sees
+static size_t filterCalls( 0 );
+static bool myFilterFunc( void* ctx, size_t bufferLength, const uint8_t* dataBuffer )
+{
+   ( void )ctx;
+   filterCalls++;
+   return ( 0x06 != dataBuffer[ 0 ] ) && ( ( bufferLength < 2 ) || ( 0x06 != dataBuffer[ 1 ] ) );
+}
+
+// Applies myFilterFunc after the fact, as a consumer without an early filter would
+static void myFilteringCallbackFunc( void* ctx, size_t bufferLength, const uint8_t* dataBuffer )
+{
+   if ( myFilterFunc( nullptr, std::min( bufferLength, size_t( 2 ) ), dataBuffer ) )
+   {
+      myRouteFunc( ctx, bufferLength, dataBuffer );
+   }
+}
+
+TEST_CASE( "Validate packet decoding & callbacks - Early filtering", "[validation]" )
+{
+   std::vector< std::vector< uint8_t > > delivered;
+   std::vector< DropReport > drops;
+   filterCalls = 0;
+
+   SECTION( "Verify rejected packets are skipped and short packets are filtered at ETX" )
+   {
+      const uint8_t BYTESTREAM[] = { STX, 0x41, 0x06, 0x42, 0x43, ETX, STX, 0x41, 0x42, 0x43, ETX,
+                                     STX, 0x06, ETX,  STX,  0x41, ETX };
+
+      pkt_decoder_t* decoder = pkt_decoder_create( myRouteFunc, &delivered );
+      pkt_decoder_set_error_callback( decoder, myErrorFunc, &drops );
+      pkt_decoder_set_filter( decoder, 2, myFilterFunc, nullptr );
+      pkt_decoder_write_bytes( decoder, 4, BYTESTREAM );
+      // The rejected packet stopped being buffered after two bytes
+      REQUIRE_FALSE( decoder->m_pktValid );
+      REQUIRE( decoder->m_dropPacket );
+      pkt_decoder_write_bytes( decoder, sizeof( BYTESTREAM ) - 4, BYTESTREAM + 4 );
+      REQUIRE( 2 == delivered.size() );
+      REQUIRE( std::vector< uint8_t >( { 0x41, 0x42, 0x43 } ) == delivered[ 0 ] );
+      REQUIRE( std::vector< uint8_t >( { 0x41 } ) == delivered[ 1 ] );
+      REQUIRE( 4 == filterCalls );
+      REQUIRE( drops.empty() );
+
+      pkt_decoder_destroy( decoder );
+   }
+
+   SECTION( "Verify filtering early delivers what filtering in the callback would" )
+   {
+      // Random streams heavy in control bytes, written in random pieces
+      const uint8_t ALPHABET[] = { STX, ETX, DLE, 0x06, 0x26, 0x41, 0x42, 0x43 };
+      std::vector< std::vector< uint8_t > > expected;
+      uint32_t seed = 12345;
+      for ( size_t round = 0; round < 200; ++round )
+      {
+         std::vector< uint8_t > bytestream;
+         for ( size_t idx = 0; idx < 300; ++idx )
+         {
+            seed = seed * 1103515245 + 12345;
+            bytestream.push_back( ALPHABET[ ( seed >> 16 ) % sizeof( ALPHABET ) ] );
+         }
+         pkt_decoder_t* reference = pkt_decoder_create( myFilteringCallbackFunc, &expected );
+         pkt_decoder_write_bytes( reference, bytestream.size(), bytestream.data() );
+         pkt_decoder_destroy( reference );
+
+         pkt_decoder_t* decoder = pkt_decoder_create( myRouteFunc, &delivered );
+         pkt_decoder_set_filter( decoder, 2, myFilterFunc, nullptr );
+         for ( size_t idx = 0; idx < bytestream.size(); )
+         {
+            seed = seed * 1103515245 + 12345;
+            size_t count = std::min( size_t( ( seed >> 16 ) % 8 ), bytestream.size() - idx );
+            pkt_decoder_write_bytes( decoder, count, bytestream.data() + idx );
+            idx += count;
+         }
+         pkt_decoder_destroy( decoder );
+         REQUIRE( expected == delivered );
+      }
+      REQUIRE( expected.size() > 100 );
+   }
+
+   SECTION( "Verify a rejected packet too long to deliver is dropped as an overflow would be" )
+   {
+      // Past the overflow every DLE is kept for the next packet, even with data bytes after it
+      std::vector< uint8_t > bytestream = { STX, 0x06 };
+      bytestream.insert( bytestream.end(), MAX_DECODED_DATA_LENGTH + 8, 0x41 );
+      bytestream.insert( bytestream.end(), { DLE, 0x42, ETX, 0x43, STX, 0x7C, ETX } );
+
+      for ( size_t split = 1; split < bytestream.size(); ++split )
+      {
+         pkt_decoder_t* decoder = pkt_decoder_create( myRouteFunc, &delivered );
+         pkt_decoder_set_filter( decoder, 2, myFilterFunc, nullptr );
+         pkt_decoder_write_bytes( decoder, split, bytestream.data() );
+         pkt_decoder_write_bytes( decoder, bytestream.size() - split, bytestream.data() + split );
+         pkt_decoder_destroy( decoder );
+         REQUIRE( 1 == delivered.size() );
+         REQUIRE( std::vector< uint8_t >( { 0x7C & ~ENC } ) == delivered[ 0 ] );
+         delivered.clear();
+      }
+   }
+}
+
+// Short frames with the odd escape, abort, empty frame and run of garbage between them
+static std::vector< uint8_t > shortFrameStream( uint32_t seed, size_t length )
+{
+   const uint8_t GARBAGE[] = { ETX, DLE, 0x41, 0x42 };
+   std::vector< uint8_t > bytestream;
+   while ( bytestream.size() < length )
+   {
+      seed = seed * 1103515245 + 12345;
+      uint32_t choice = ( seed >> 16 ) % 64;
+      if ( choice < 4 )
+      {
+         bytestream.push_back( GARBAGE[ choice ] );
+         continue;
+      }
+      bytestream.push_back( STX );
+      size_t frameLength = choice % 33;
+      for ( size_t idx = 0; idx < frameLength; ++idx )
+      {
+         seed = seed * 1103515245 + 12345;
+         uint8_t value = static_cast< uint8_t >( seed >> 16 );
+         if ( ( STX == value ) || ( ETX == value ) || ( DLE == value ) )
+         {
+            bytestream.push_back( DLE );
+            value |= ENC;
+         }
+         bytestream.push_back( value );
+      }
+      if ( choice != 63 )
+      {
+         // The last choice leaves the frame to be aborted by the next STX
+         bytestream.push_back( ETX );
+      }
+   }
+   return bytestream;
+}
+
+TEST_CASE( "Validate packet decoding & callbacks - Short frames", "[validation]" )
+{
+   std::vector< std::vector< uint8_t > > delivered;
+   std::vector< DropReport > drops;
+
+   SECTION( "Verify frames decoded in bulk match those decoded a byte at a time" )
+   {
+      // Long enough to span several blocks of control-byte bitmaps
+      std::vector< uint8_t > bytestream = shortFrameStream( 4321, 20000 );
+
+      std::vector< std::vector< uint8_t > > expected;
+      std::vector< DropReport > expectedDrops;
+      pkt_decoder_t* reference = pkt_decoder_create( myRouteFunc, &expected );
+      pkt_decoder_set_error_callback( reference, myErrorFunc, &expectedDrops );
+      for ( size_t idx = 0; idx < bytestream.size(); ++idx )
+      {
+         pkt_decoder_write_bytes( reference, 1, bytestream.data() + idx );
+      }
+      REQUIRE( expected.size() > 500 );
+      REQUIRE( expectedDrops.size() > 10 );
+
+      uint32_t seed = 999;
+      for ( size_t round = 0; round < 3; ++round )
+      {
+         pkt_decoder_t* decoder = pkt_decoder_create( myRouteFunc, &delivered );
+         pkt_decoder_set_error_callback( decoder, myErrorFunc, &drops );
+         for ( size_t idx = 0; idx < bytestream.size(); )
+         {
+            // One write, then writes of up to 8 KiB
+            seed = seed * 1103515245 + 12345;
+            size_t count = ( 0 == round ) ? bytestream.size() : ( seed >> 16 ) % 8192;
+            count = std::min( count, bytestream.size() - idx );
+            pkt_decoder_write_bytes( decoder, count, bytestream.data() + idx );
+            idx += count;
+         }
+         REQUIRE( expected == delivered );
+         REQUIRE( expectedDrops.size() == drops.size() );
+         for ( size_t idx = 0; idx < drops.size(); ++idx )
+         {
+            REQUIRE( expectedDrops[ idx ].reason == drops[ idx ].reason );
+            REQUIRE( expectedDrops[ idx ].partialLength == drops[ idx ].partialLength );
+            REQUIRE( expectedDrops[ idx ].streamOffset == drops[ idx ].streamOffset );
+         }
+         REQUIRE( reference->m_pktValid == decoder->m_pktValid );
+         REQUIRE( reference->m_pktBufIdx == decoder->m_pktBufIdx );
+         REQUIRE( reference->m_deStuffNextByte == decoder->m_deStuffNextByte );
+         REQUIRE( memcmp( reference->m_packetBuffer,
+                          decoder->m_packetBuffer,
+                          MAX_DECODED_DATA_LENGTH )
+                  == 0 );
+         pkt_decoder_destroy( decoder );
+         delivered.clear();
+         drops.clear();
+      }
+      pkt_decoder_destroy( reference );
+   }
+
+   SECTION( "Verify the packet buffer is left cleared past a short frame after a long one" )
+   {
+      std::vector< uint8_t > bytestream = { STX };
+      bytestream.insert( bytestream.end(), 300, 0x41 );
+      bytestream.insert( bytestream.end(), { ETX, STX, 0x42, 0x43, ETX } );
+
+      pkt_decoder_t* decoder = pkt_decoder_create( myRouteFunc, &delivered );
+      pkt_decoder_write_bytes( decoder, bytestream.size(), bytestream.data() );
+      REQUIRE( 2 == delivered.size() );
+      REQUIRE( std::vector< uint8_t >( { 0x42, 0x43 } ) == delivered[ 1 ] );
+      REQUIRE( 2 == decoder->m_pktBufIdx );
+      std::vector< uint8_t > expected( MAX_DECODED_DATA_LENGTH, 0 );
+      expected[ 0 ] = 0x42;
+      expected[ 1 ] = 0x43;
+      REQUIRE( memcmp( expected.data(), decoder->m_packetBuffer, MAX_DECODED_DATA_LENGTH ) == 0 );
+
+      pkt_decoder_destroy( decoder );
+   }
+}
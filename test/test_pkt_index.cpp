@@ -0,0 +1,226 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <libsrc/pkt_index.h>
+#include <vector>
+
+namespace
+{
+   typedef std::vector< uint8_t > Bytes;
+
+   struct Drop
+   {
+      pkt_error_t m_reason;
+      size_t m_partialLength;
+      uint64_t m_streamOffset;
+   };
+
+   // Random bytes, about one in twelve of them a control byte, with the odd run of data too long
+   // for a packet. Ends with a frame, so no frame is left open
+   Bytes randomStream( uint32_t seed, size_t length )
+   {
+      Bytes data;
+      while ( data.size() < length )
+      {
+         seed = seed * 1103515245 + 12345;
+         uint32_t choice = ( seed >> 16 ) % 1000;
+         if ( 0 == choice )
+         {
+            data.insert( data.end(), MAX_DECODED_DATA_LENGTH + choice % 64 + 1, 0x41 );
+         }
+         else if ( choice < 30 )
+         {
+            data.push_back( STX );
+         }
+         else if ( choice < 60 )
+         {
+            data.push_back( ETX );
+         }
+         else if ( choice < 80 )
+         {
+            data.push_back( DLE );
+         }
+         else
+         {
+            data.push_back( static_cast< uint8_t >( 0x20 + choice % 64 ) );
+         }
+      }
+      data.insert( data.end(), { STX, 0x41, ETX } );
+      return data;
+   }
+
+   void recordFrame( void* ctx, size_t length, const uint8_t* data )
+   {
+      static_cast< std::vector< Bytes >* >( ctx )->emplace_back( data, data + length );
+   }
+
+   void recordDrop( void* ctx, pkt_error_t reason, size_t partialLength, uint64_t streamOffset )
+   {
+      static_cast< std::vector< Drop >* >( ctx )->push_back(
+         { reason, partialLength, streamOffset } );
+   }
+
+   std::vector< Bytes > decode( size_t length, const uint8_t* data, std::vector< Drop >* drops )
+   {
+      std::vector< Bytes > frames;
+      pkt_decoder_t* decoder = pkt_decoder_create( recordFrame, &frames );
+      if ( nullptr != drops )
+      {
+         pkt_decoder_set_error_callback( decoder, recordDrop, drops );
+      }
+      pkt_decoder_write_bytes( decoder, length, data );
+      pkt_decoder_destroy( decoder );
+      return frames;
+   }
+} // namespace
+
+TEST_CASE( "Validate position index of raw streams", "[index]" )
+{
+   const uint8_t CONTROLS[] = { STX, ETX, DLE };
+
+   SECTION( "Verify bitmaps, counts and positions match the buffer, with one thread or several" )
+   {
+      // Long enough for three threads
+      Bytes data = randomStream( 1, 2 * PKT_INDEX_MIN_THREAD_BYTES + 77 );
+      pkt_index_t* single = pkt_index_create( data.size(), data.data(), 1 );
+      pkt_index_t* index = pkt_index_create( data.size(), data.data(), 4 );
+      size_t words = ( data.size() + 63 ) / 64;
+      for ( uint8_t control : CONTROLS )
+      {
+         std::vector< uint64_t > expected( words );
+         std::vector< size_t > positions;
+         for ( size_t idx = 0; idx < data.size(); ++idx )
+         {
+            if ( control == data[ idx ] )
+            {
+               expected[ idx / 64 ] |= 1ULL << ( idx % 64 );
+               positions.push_back( idx );
+            }
+         }
+         for ( pkt_index_t* built : { single, index } )
+         {
+            const uint64_t* bitmap = pkt_index_bitmap( built, control );
+            REQUIRE( std::equal( expected.begin(), expected.end(), bitmap ) );
+            REQUIRE( positions.size() == pkt_index_count( built, control ) );
+         }
+
+         // Fetched in batches, from the start and from partway through
+         std::vector< size_t > fetched( positions.size() + 1 );
+         size_t count = 0;
+         for ( size_t batch = 1; count < positions.size(); batch = 1 + batch * 7 % 1000 )
+         {
+            size_t from = ( 0 == count ) ? 0 : fetched[ count - 1 ] + 1;
+            size_t written = pkt_index_positions( index, control, from, batch, &fetched[ count ] );
+            REQUIRE( written > 0 );
+            count += written;
+         }
+         REQUIRE( 0 == pkt_index_positions( index, control, data.size(), 1, &fetched[ count ] ) );
+         fetched.resize( count );
+         REQUIRE( positions == fetched );
+         size_t middle = positions[ positions.size() / 2 ];
+         REQUIRE( 1 == pkt_index_positions( index, control, middle, 1, &fetched[ 0 ] ) );
+         REQUIRE( middle == fetched[ 0 ] );
+      }
+      REQUIRE( nullptr == pkt_index_bitmap( index, 0x41 ) );
+      REQUIRE( 0 == pkt_index_count( index, 0x41 ) );
+      REQUIRE( decode( data.size(), data.data(), nullptr ).size()
+               == pkt_index_count_frames( index ) );
+      REQUIRE( pkt_index_count_frames( single ) == pkt_index_count_frames( index ) );
+      pkt_index_destroy( single );
+      pkt_index_destroy( index );
+   }
+
+   SECTION( "Verify the frames listed are the ones a decoder delivers and drops" )
+   {
+      Bytes data = randomStream( 2, 200000 );
+      std::vector< Drop > drops;
+      std::vector< Bytes > delivered = decode( data.size(), data.data(), &drops );
+      pkt_index_t* index = pkt_index_create( data.size(), data.data(), 0 );
+
+      std::vector< pkt_index_frame_t > frames( pkt_index_count( index, STX ) + 1 );
+      size_t count = 0;
+      for ( size_t batch = 1;; batch = 1 + batch * 7 % 100 )
+      {
+         size_t from = ( 0 == count ) ? 0 : frames[ count - 1 ].start + 1;
+         size_t written = pkt_index_frames( index, from, batch, &frames[ count ] );
+         count += written;
+         if ( written < batch )
+         {
+            break;
+         }
+      }
+      frames.resize( count );
+
+      size_t valid = 0;
+      size_t dropped = 0;
+      for ( const pkt_index_frame_t& frame : frames )
+      {
+         REQUIRE( STX == data[ frame.start ] );
+         if ( frame.valid )
+         {
+            REQUIRE( ETX == data[ frame.end ] );
+            REQUIRE( delivered[ valid++ ].size() == frame.data_length );
+            continue;
+         }
+         const Drop& drop = drops[ dropped++ ];
+         REQUIRE( frame.error == drop.m_reason );
+         if ( PKT_ERROR_OVERFLOW == frame.error )
+         {
+            REQUIRE( frame.data_length > MAX_DECODED_DATA_LENGTH );
+            REQUIRE( frame.start < drop.m_streamOffset );
+            REQUIRE( drop.m_streamOffset < frame.end );
+         }
+         else
+         {
+            REQUIRE( frame.data_length == drop.m_partialLength );
+            REQUIRE( frame.end == drop.m_streamOffset );
+         }
+      }
+      REQUIRE( delivered.size() == valid );
+      REQUIRE( drops.size() == dropped );
+      REQUIRE( valid == pkt_index_count_frames( index ) );
+      // Every kind of frame turned up
+      REQUIRE( std::count_if( drops.begin(), drops.end(), []( const Drop& drop ) {
+                  return PKT_ERROR_OVERFLOW == drop.m_reason;
+               } ) > 0 );
+      REQUIRE( std::count_if( drops.begin(), drops.end(), []( const Drop& drop ) {
+                  return PKT_ERROR_EMPTY == drop.m_reason;
+               } ) > 0 );
+      REQUIRE( std::count_if( drops.begin(), drops.end(), []( const Drop& drop ) {
+                  return PKT_ERROR_ABORTED == drop.m_reason;
+               } ) > 0 );
+      pkt_index_destroy( index );
+   }
+
+   SECTION( "Verify the pieces of a split decode to the frames of the whole" )
+   {
+      Bytes data = randomStream( 3, 100000 );
+      std::vector< Bytes > expected = decode( data.size(), data.data(), nullptr );
+      pkt_index_t* index = pkt_index_create( data.size(), data.data(), 0 );
+      for ( size_t parts : { 1, 2, 7, 64 } )
+      {
+         std::vector< size_t > offsets( parts );
+         REQUIRE( parts == pkt_index_split( index, parts, offsets.data() ) );
+         REQUIRE( 0 == offsets[ 0 ] );
+         offsets.push_back( data.size() );
+         std::vector< Bytes > delivered;
+         for ( size_t piece = 0; piece < parts; ++piece )
+         {
+            REQUIRE( offsets[ piece ] < offsets[ piece + 1 ] );
+            std::vector< Bytes > frames = decode(
+               offsets[ piece + 1 ] - offsets[ piece ], data.data() + offsets[ piece ], nullptr );
+            delivered.insert( delivered.end(), frames.begin(), frames.end() );
+         }
+         REQUIRE( expected == delivered );
+      }
+      pkt_index_destroy( index );
+
+      // Nowhere to cut
+      const uint8_t UNCUTTABLE[] = { 0x41, STX, 0x41, DLE, ETX, STX, 0x41, 0x42 };
+      index = pkt_index_create( sizeof( UNCUTTABLE ), UNCUTTABLE, 1 );
+      size_t offsets[ 4 ];
+      REQUIRE( 1 == pkt_index_split( index, 4, offsets ) );
+      REQUIRE( 0 == offsets[ 0 ] );
+      pkt_index_destroy( index );
+   }
+}
@@ -0,0 +1,182 @@
+#include "catch.hpp"
+
+#include <cstdio>
+#include <libsrc/pkt_log.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Scratch file for a log, removed when the test section ends
+struct TempLogFile
+{
+   TempLogFile()
+   {
+      char path[] = "/tmp/pktlog_test_XXXXXX";
+      int fd = mkstemp( path );
+      close( fd );
+      m_path = path;
+   }
+   ~TempLogFile() { unlink( m_path.c_str() ); }
+
+   std::string m_path;
+};
+
+// Payload of packet number sequence: its length and contents both depend on the sequence
+static std::vector< uint8_t > logPayload( uint64_t sequence )
+{
+   return std::vector< uint8_t >( 1 + sequence % 40, static_cast< uint8_t >( sequence ) );
+}
+
+static const uint64_t NUM_PACKETS( 1000 );
+
+static void writeLog( const std::string& path )
+{
+   pkt_log_writer_t* writer = pkt_log_writer_open( path.c_str(), 256 );
+   REQUIRE( nullptr != writer );
+   for ( uint64_t sequence = 0; sequence < NUM_PACKETS; ++sequence )
+   {
+      std::vector< uint8_t > payload = logPayload( sequence );
+      REQUIRE( pkt_log_writer_append( writer, sequence * 10, payload.size(), payload.data() ) );
+   }
+   REQUIRE( pkt_log_writer_close( writer ) );
+}
+
+static void requireRecord( const pkt_log_record_t& record, uint64_t sequence )
+{
+   REQUIRE( sequence == record.sequence );
+   REQUIRE( sequence * 10 == record.timestamp );
+   REQUIRE( logPayload( sequence )
+            == std::vector< uint8_t >( record.data, record.data + record.data_length ) );
+}
+
+TEST_CASE( "Validate packet log writing & reading", "[log]" )
+{
+   TempLogFile file;
+   writeLog( file.m_path );
+   pkt_log_record_t record;
+
+   SECTION( "Verify every packet reads back in order" )
+   {
+      pkt_log_reader_t* reader = pkt_log_reader_open( file.m_path.c_str() );
+      REQUIRE( nullptr != reader );
+      REQUIRE( NUM_PACKETS == pkt_log_reader_count( reader ) );
+      for ( uint64_t sequence = 0; sequence < NUM_PACKETS; ++sequence )
+      {
+         REQUIRE( pkt_log_reader_next( reader, &record ) );
+         requireRecord( record, sequence );
+      }
+      REQUIRE_FALSE( pkt_log_reader_next( reader, &record ) );
+      pkt_log_reader_close( reader );
+   }
+
+   SECTION( "Verify seeking by sequence number and by time" )
+   {
+      pkt_log_reader_t* reader = pkt_log_reader_open( file.m_path.c_str() );
+      for ( uint64_t sequence : { 0, 1, 499, 500, 998, 999 } )
+      {
+         REQUIRE( pkt_log_reader_seek( reader, sequence ) );
+         REQUIRE( pkt_log_reader_next( reader, &record ) );
+         requireRecord( record, sequence );
+
+         // Any time after the previous packet finds this one
+         REQUIRE( pkt_log_reader_seek_time( reader, sequence * 10 - ( sequence ? 9 : 0 ) ) );
+         REQUIRE( pkt_log_reader_next( reader, &record ) );
+         requireRecord( record, sequence );
+      }
+      REQUIRE_FALSE( pkt_log_reader_seek( reader, NUM_PACKETS ) );
+      REQUIRE_FALSE( pkt_log_reader_seek_time( reader, NUM_PACKETS * 10 ) );
+      pkt_log_reader_close( reader );
+   }
+
+   SECTION( "Verify a log that was never closed is still readable" )
+   {
+      // Chop off the index and footer, and part of the last record
+      pkt_log_reader_t* reader = pkt_log_reader_open( file.m_path.c_str() );
+      uint64_t dataEnd = reader->m_dataEnd;
+      pkt_log_reader_close( reader );
+      REQUIRE( 0 == truncate( file.m_path.c_str(), dataEnd - 1 ) );
+
+      reader = pkt_log_reader_open( file.m_path.c_str() );
+      REQUIRE( nullptr != reader );
+      REQUIRE( NUM_PACKETS - 1 == pkt_log_reader_count( reader ) );
+      REQUIRE( pkt_log_reader_seek( reader, 777 ) );
+      REQUIRE( pkt_log_reader_next( reader, &record ) );
+      requireRecord( record, 777 );
+      pkt_log_reader_close( reader );
+   }
+
+   SECTION( "Verify a corrupt index or record is never read past" )
+   {
+      pkt_log_reader_t* reader = pkt_log_reader_open( file.m_path.c_str() );
+      uint64_t dataEnd = reader->m_dataEnd;
+      REQUIRE( pkt_log_reader_seek( reader, 998 ) );
+      uint64_t recordOffset = reader->m_offset;
+      pkt_log_reader_close( reader );
+
+      // The second index entry points past the data: the index is rebuilt from the records
+      const uint8_t BAD_OFFSET[ 8 ] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x7F };
+      std::vector< uint8_t > saved( sizeof( BAD_OFFSET ) );
+      FILE* log = fopen( file.m_path.c_str(), "r+b" );
+      REQUIRE( 0 == fseek( log, dataEnd + 32, SEEK_SET ) );
+      REQUIRE( saved.size() == fread( saved.data(), 1, saved.size(), log ) );
+      REQUIRE( 0 == fseek( log, dataEnd + 32, SEEK_SET ) );
+      REQUIRE( sizeof( BAD_OFFSET ) == fwrite( BAD_OFFSET, 1, sizeof( BAD_OFFSET ), log ) );
+      fflush( log );
+      reader = pkt_log_reader_open( file.m_path.c_str() );
+      REQUIRE( NUM_PACKETS == pkt_log_reader_count( reader ) );
+      REQUIRE( dataEnd == reader->m_dataEnd );
+      REQUIRE( pkt_log_reader_seek( reader, 777 ) );
+      REQUIRE( pkt_log_reader_next( reader, &record ) );
+      requireRecord( record, 777 );
+      pkt_log_reader_close( reader );
+
+      // Restore the index, then give the second to last record a length running into it
+      const uint8_t BAD_LENGTH[ 4 ] = { 0xF0, 0xFF, 0xFF, 0xFF };
+      REQUIRE( 0 == fseek( log, dataEnd + 32, SEEK_SET ) );
+      REQUIRE( saved.size() == fwrite( saved.data(), 1, saved.size(), log ) );
+      REQUIRE( 0 == fseek( log, recordOffset, SEEK_SET ) );
+      REQUIRE( sizeof( BAD_LENGTH ) == fwrite( BAD_LENGTH, 1, sizeof( BAD_LENGTH ), log ) );
+      fclose( log );
+      reader = pkt_log_reader_open( file.m_path.c_str() );
+      REQUIRE( NUM_PACKETS == pkt_log_reader_count( reader ) );
+      REQUIRE( pkt_log_reader_seek( reader, 998 ) );
+      REQUIRE_FALSE( pkt_log_reader_next( reader, &record ) );
+      REQUIRE_FALSE( pkt_log_reader_seek( reader, 999 ) );
+      REQUIRE_FALSE( pkt_log_reader_seek_time( reader, 999 * 10 ) );
+      REQUIRE( pkt_log_reader_seek( reader, 997 ) );
+      REQUIRE( pkt_log_reader_next( reader, &record ) );
+      requireRecord( record, 997 );
+      REQUIRE_FALSE( pkt_log_reader_next( reader, &record ) );
+      pkt_log_reader_close( reader );
+   }
+}
+
+TEST_CASE( "Validate packet log capture from a decoder", "[log]" )
+{
+   SECTION( "Verify decoded packets are logged with their ETX time" )
+   {
+      TempLogFile file;
+      const uint8_t BYTESTREAM_START[] = { STX, 0x01, DLE, 0x22, ETX, STX, 0x04 };
+      const uint8_t BYTESTREAM_END[] = { 0x05, ETX };
+
+      pkt_log_writer_t* writer =
+         pkt_log_writer_open( file.m_path.c_str(), PKT_LOG_DEFAULT_BLOCK_SIZE );
+      pkt_decoder_t* decoder = pkt_decoder_create_ts( pkt_log_write_packet_ts, writer );
+      pkt_decoder_write_bytes_ts( decoder, sizeof( BYTESTREAM_START ), BYTESTREAM_START, 7 );
+      pkt_decoder_write_bytes_ts( decoder, sizeof( BYTESTREAM_END ), BYTESTREAM_END, 9 );
+      pkt_decoder_destroy( decoder );
+      REQUIRE( pkt_log_writer_close( writer ) );
+
+      pkt_log_reader_t* reader = pkt_log_reader_open( file.m_path.c_str() );
+      pkt_log_record_t record;
+      REQUIRE( 2 == pkt_log_reader_count( reader ) );
+      REQUIRE( pkt_log_reader_next( reader, &record ) );
+      REQUIRE( 7 == record.timestamp );
+      REQUIRE( std::vector< uint8_t >( { 0x01, STX } )
+               == std::vector< uint8_t >( record.data, record.data + record.data_length ) );
+      REQUIRE( pkt_log_reader_next( reader, &record ) );
+      REQUIRE( 9 == record.timestamp );
+      REQUIRE( 2 == record.data_length );
+      pkt_log_reader_close( reader );
+   }
+}
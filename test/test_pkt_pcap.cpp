@@ -0,0 +1,432 @@
+#include "catch.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <libsrc/pkt_pcap.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+   typedef std::vector< uint8_t > Bytes;
+
+   // Scratch file for a capture, removed when the test section ends
+   struct TempCaptureFile
+   {
+      TempCaptureFile()
+      {
+         char path[] = "/tmp/pktpcap_test_XXXXXX";
+         int fd = mkstemp( path );
+         close( fd );
+         m_path = path;
+      }
+      ~TempCaptureFile() { unlink( m_path.c_str() ); }
+
+      void write( const Bytes& contents ) const
+      {
+         FILE* file = fopen( m_path.c_str(), "wb" );
+         REQUIRE( nullptr != file );
+         REQUIRE( contents.size() == fwrite( contents.data(), 1, contents.size(), file ) );
+         fclose( file );
+      }
+
+      std::string m_path;
+   };
+
+   struct Frame
+   {
+      pkt_flow_key_t m_flow;
+      uint64_t m_timestamp;
+      Bytes m_data;
+   };
+
+   void collectFrame( void* ctx,
+                      const pkt_flow_key_t* flow,
+                      uint64_t timestamp,
+                      size_t data_length,
+                      const uint8_t* data )
+   {
+      static_cast< std::vector< Frame >* >( ctx )->push_back(
+         { *flow, timestamp, Bytes( data, data + data_length ) } );
+   }
+
+   void putLe( Bytes& out, uint64_t value, size_t length )
+   {
+      for ( size_t idx = 0; idx < length; ++idx )
+      {
+         out.push_back( static_cast< uint8_t >( value >> ( 8 * idx ) ) );
+      }
+   }
+
+   void putBe( Bytes& out, uint64_t value, size_t length )
+   {
+      for ( size_t idx = length; idx > 0; --idx )
+      {
+         out.push_back( static_cast< uint8_t >( value >> ( 8 * ( idx - 1 ) ) ) );
+      }
+   }
+
+   // Frame number value: 1 to 40 data bytes, every other one a control byte that needs stuffing
+   Bytes frameData( uint8_t value )
+   {
+      Bytes data;
+      for ( size_t idx = 0; idx <= value % 40u; ++idx )
+      {
+         data.push_back( ( 0 == idx % 2 ) ? value : ( ( 0 == idx % 3 ) ? DLE : STX ) );
+      }
+      return data;
+   }
+
+   Bytes encode( const Bytes& data )
+   {
+      Bytes encoded( 1, STX );
+      for ( uint8_t byte : data )
+      {
+         if ( ( STX == byte ) || ( ETX == byte ) || ( DLE == byte ) )
+         {
+            encoded.push_back( DLE );
+            byte |= ENC;
+         }
+         encoded.push_back( byte );
+      }
+      encoded.push_back( ETX );
+      return encoded;
+   }
+
+   // Ethernet, with a VLAN tag, carrying IPv4 and TCP from 10.0.0.1:5000 to 10.0.0.2:6000
+   Bytes tcpPacket( uint32_t seq, uint8_t flags, const Bytes& payload )
+   {
+      Bytes packet = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+      putBe( packet, 0x8100, 2 );
+      putBe( packet, 42, 2 );
+      putBe( packet, 0x0800, 2 );
+      putBe( packet, 0x4500, 2 );
+      putBe( packet, 20 + 20 + payload.size(), 2 );
+      putBe( packet, 0x4000, 4 );
+      packet.insert( packet.end(), { 64, 6, 0, 0, 10, 0, 0, 1, 10, 0, 0, 2 } );
+      putBe( packet, 5000, 2 );
+      putBe( packet, 6000, 2 );
+      putBe( packet, seq, 4 );
+      putBe( packet, 0, 4 );
+      packet.insert( packet.end(), { 0x50, flags, 0xFF, 0xFF, 0, 0, 0, 0 } );
+      packet.insert( packet.end(), payload.begin(), payload.end() );
+      return packet;
+   }
+
+   // Raw IPv6 carrying UDP from [2001:db8::src]:port to [2001:db8::1]:7000, after a
+   // destination options header
+   Bytes udpPacket( uint8_t src, uint16_t port, const Bytes& payload )
+   {
+      Bytes packet = { 0x60, 0, 0, 0 };
+      putBe( packet, 8 + 8 + payload.size(), 2 );
+      packet.insert( packet.end(), { 60, 64 } );
+      for ( uint8_t last : { src, uint8_t( 1 ) } )
+      {
+         packet.insert( packet.end(), { 0x20, 0x01, 0x0D, 0xB8 } );
+         packet.insert( packet.end(), 11, 0 );
+         packet.push_back( last );
+      }
+      packet.insert( packet.end(), { 17, 0, 1, 4, 0, 0, 0, 0 } );
+      putBe( packet, port, 2 );
+      putBe( packet, 7000, 2 );
+      putBe( packet, 8 + payload.size(), 2 );
+      putBe( packet, 0, 2 );
+      packet.insert( packet.end(), payload.begin(), payload.end() );
+      return packet;
+   }
+
+   struct Record
+   {
+      uint64_t m_timestamp;
+      Bytes m_packet;
+   };
+
+   // Classic pcap with microsecond timestamps, little or big endian
+   Bytes pcapFile( uint32_t linkType, const std::vector< Record >& records, bool bigEndian )
+   {
+      auto put = [bigEndian]( Bytes& out, uint64_t value, size_t length ) {
+         bigEndian ? putBe( out, value, length ) : putLe( out, value, length );
+      };
+      Bytes file;
+      put( file, 0xA1B2C3D4, 4 );
+      put( file, 2, 2 );
+      put( file, 4, 2 );
+      put( file, 0, 8 );
+      put( file, 65535, 4 );
+      put( file, linkType, 4 );
+      for ( const Record& record : records )
+      {
+         put( file, record.m_timestamp / 1000000000, 4 );
+         put( file, record.m_timestamp % 1000000000 / 1000, 4 );
+         put( file, record.m_packet.size(), 4 );
+         put( file, record.m_packet.size(), 4 );
+         file.insert( file.end(), record.m_packet.begin(), record.m_packet.end() );
+      }
+      return file;
+   }
+
+   void putBlock( Bytes& file, uint32_t type, const Bytes& body )
+   {
+      size_t padded = ( body.size() + 3 ) & ~size_t( 3 );
+      putLe( file, type, 4 );
+      putLe( file, 12 + padded, 4 );
+      file.insert( file.end(), body.begin(), body.end() );
+      file.insert( file.end(), padded - body.size(), 0 );
+      putLe( file, 12 + padded, 4 );
+   }
+
+   // pcapng with one interface stamping in units of its if_tsresol (nanoseconds by default), and
+   // a block it should skip
+   Bytes pcapngFile( uint32_t linkType,
+                     const std::vector< Record >& records,
+                     uint8_t tsresol = 9 )
+   {
+      Bytes file;
+      Bytes section;
+      putLe( section, 0x1A2B3C4D, 4 );
+      putLe( section, 1, 2 );
+      putLe( section, 0, 2 );
+      putLe( section, UINT64_MAX, 8 );
+      putBlock( file, 0x0A0D0D0A, section );
+      Bytes interface;
+      putLe( interface, linkType, 2 );
+      putLe( interface, 0, 6 );
+      interface.insert( interface.end(), { 9, 0, 1, 0, tsresol, 0, 0, 0, 0, 0, 0, 0 } );
+      putBlock( file, 1, interface );
+      putBlock( file, 5, Bytes( 10, 0xEE ) );
+      for ( const Record& record : records )
+      {
+         Bytes packet;
+         putLe( packet, 0, 4 );
+         putLe( packet, record.m_timestamp >> 32, 4 );
+         putLe( packet, record.m_timestamp & 0xFFFFFFFF, 4 );
+         putLe( packet, record.m_packet.size(), 4 );
+         putLe( packet, record.m_packet.size(), 4 );
+         packet.insert( packet.end(), record.m_packet.begin(), record.m_packet.end() );
+         putBlock( file, 6, packet );
+      }
+      return file;
+   }
+
+   std::vector< Frame > readCapture( const Bytes& contents, pkt_pcap_stats_t& stats )
+   {
+      TempCaptureFile file;
+      file.write( contents );
+      std::vector< Frame > frames;
+      pkt_pcap_reader_t* reader = pkt_pcap_open( file.m_path.c_str(), collectFrame, &frames );
+      REQUIRE( nullptr != reader );
+      REQUIRE( pkt_pcap_read_all( reader ) );
+      pkt_pcap_get_stats( reader, &stats );
+      pkt_pcap_close( reader );
+      return frames;
+   }
+
+   // Frames 0 to count - 1 encoded back to back, as one TCP stream
+   Bytes tcpStream( uint8_t count )
+   {
+      Bytes stream;
+      for ( uint8_t value = 0; value < count; ++value )
+      {
+         Bytes encoded = encode( frameData( value ) );
+         stream.insert( stream.end(), encoded.begin(), encoded.end() );
+      }
+      return stream;
+   }
+
+   // The stream cut into segments of segmentLength bytes, numbered from the byte after the SYN
+   std::vector< Record > tcpSegments( const Bytes& stream, uint32_t isn, size_t segmentLength )
+   {
+      std::vector< Record > records;
+      records.push_back( { 1000, tcpPacket( isn, 0x02, Bytes() ) } );
+      for ( size_t offset = 0; offset < stream.size(); offset += segmentLength )
+      {
+         size_t length = std::min( segmentLength, stream.size() - offset );
+         Bytes payload( stream.begin() + offset, stream.begin() + offset + length );
+         records.push_back(
+            { 2000 + 1000 * offset, tcpPacket( isn + 1 + offset, 0x10, payload ) } );
+      }
+      return records;
+   }
+} // namespace
+
+TEST_CASE( "Validate pcap capture decoding", "[pcap]" )
+{
+   pkt_pcap_stats_t stats;
+   const uint8_t FRAME_COUNT( 60 );
+   Bytes stream = tcpStream( FRAME_COUNT );
+   // Sequence numbers wrap partway through the stream
+   const uint32_t ISN( 0xFFFFFF00 );
+
+   SECTION( "Verify TCP frames split, reordered and retransmitted are each decoded once" )
+   {
+      std::vector< Record > records = tcpSegments( stream, ISN, 37 );
+      // Swap neighbouring segments, and send some twice or overlapping what came before
+      for ( size_t idx = 2; idx + 1 < records.size(); idx += 3 )
+      {
+         std::swap( records[ idx ], records[ idx + 1 ] );
+      }
+      records.insert( records.begin() + 10, records[ 4 ] );
+      records.insert( records.begin() + 7, records[ 9 ] );
+      Bytes overlapping( stream.begin() + 30, stream.begin() + 100 );
+      records.insert( records.begin() + 20, { 0, tcpPacket( ISN + 31, 0x10, overlapping ) } );
+      records.push_back( { 0, tcpPacket( ISN + 1 + stream.size(), 0x11, Bytes() ) } );
+
+      std::vector< Frame > frames = readCapture( pcapFile( 1, records, false ), stats );
+      REQUIRE( FRAME_COUNT == frames.size() );
+      for ( uint8_t value = 0; value < FRAME_COUNT; ++value )
+      {
+         REQUIRE( frameData( value ) == frames[ value ].m_data );
+         REQUIRE( 6 == frames[ value ].m_flow.protocol );
+         REQUIRE( 5000 == frames[ value ].m_flow.src_port );
+         REQUIRE( 6000 == frames[ value ].m_flow.dst_port );
+         REQUIRE( 0 == memcmp( frames[ value ].m_flow.dst_addr, "\x0A\x00\x00\x02\x00", 5 ) );
+      }
+      REQUIRE( 1 == stats.flows );
+      REQUIRE( stream.size() == stats.payload_bytes );
+      REQUIRE( stats.out_of_order > 0 );
+      // The two copies, and the overlapping segment, which by then is all old data
+      REQUIRE( 3 == stats.retransmits );
+      REQUIRE( 0 == stats.gaps );
+      REQUIRE( 0 == stats.skipped );
+   }
+
+   SECTION( "Verify a FIN overtaken by data sent before it closes the flow after that data" )
+   {
+      std::vector< Record > records = tcpSegments( stream, ISN, 50 );
+      // The FIN arrives while nothing is held, just before the last segment
+      records.insert( records.end() - 1,
+                      { 0, tcpPacket( ISN + 1 + stream.size(), 0x11, Bytes() ) } );
+      // Then data from a connection whose SYN wasn't captured, which can only be decoded once
+      // the first flow has closed
+      records.push_back( { 0, tcpPacket( 12345, 0x10, encode( frameData( 7 ) ) ) } );
+
+      std::vector< Frame > frames = readCapture( pcapFile( 1, records, false ), stats );
+      REQUIRE( FRAME_COUNT + 1 == frames.size() );
+      for ( uint8_t value = 0; value < FRAME_COUNT; ++value )
+      {
+         REQUIRE( frameData( value ) == frames[ value ].m_data );
+      }
+      REQUIRE( frameData( 7 ) == frames.back().m_data );
+      REQUIRE( 2 == stats.flows );
+      REQUIRE( 0 == stats.gaps );
+   }
+
+   SECTION( "Verify a segment that was never captured drops only the frame it cut" )
+   {
+      std::vector< Record > records = tcpSegments( stream, ISN, 50 );
+      // The segment holding stream bytes 250 to 299
+      records.erase( records.begin() + 6 );
+      std::vector< Bytes > expected;
+      size_t start = 0;
+      for ( uint8_t value = 0; value < FRAME_COUNT; ++value )
+      {
+         size_t end = start + encode( frameData( value ) ).size();
+         if ( ( end <= 250 ) || ( start >= 300 ) )
+         {
+            expected.push_back( frameData( value ) );
+         }
+         start = end;
+      }
+      std::vector< Frame > frames = readCapture( pcapFile( 1, records, false ), stats );
+      REQUIRE( 1 == stats.gaps );
+      REQUIRE( expected.size() < FRAME_COUNT );
+      REQUIRE( expected.size() == frames.size() );
+      for ( size_t idx = 0; idx < frames.size(); ++idx )
+      {
+         REQUIRE( expected[ idx ] == frames[ idx ].m_data );
+      }
+   }
+
+   SECTION( "Verify big-endian captures and timestamps" )
+   {
+      std::vector< Record > records = tcpSegments( stream, ISN, 1000 );
+      records.back().m_timestamp = 1700000000123456000;
+      std::vector< Frame > frames = readCapture( pcapFile( 1, records, true ), stats );
+      REQUIRE( FRAME_COUNT == frames.size() );
+      REQUIRE( 1700000000123456000 == frames.back().m_timestamp );
+   }
+
+   SECTION( "Verify a file that isn't a capture is rejected, and a truncated one stops" )
+   {
+      TempCaptureFile file;
+      file.write( Bytes( 100, 0xA1 ) );
+      REQUIRE( nullptr == pkt_pcap_open( file.m_path.c_str(), collectFrame, nullptr ) );
+      REQUIRE( nullptr == pkt_pcap_open( "/nonexistent/capture.pcap", collectFrame, nullptr ) );
+
+      Bytes contents = pcapFile( 1, tcpSegments( stream, ISN, 100 ), false );
+      contents.erase( contents.end() - 10, contents.end() );
+      file.write( contents );
+      std::vector< Frame > frames;
+      pkt_pcap_reader_t* reader = pkt_pcap_open( file.m_path.c_str(), collectFrame, &frames );
+      REQUIRE( nullptr != reader );
+      REQUIRE( !pkt_pcap_read_all( reader ) );
+      pkt_pcap_close( reader );
+      REQUIRE( frames.size() > FRAME_COUNT / 2 );
+      REQUIRE( frames.size() < FRAME_COUNT );
+   }
+}
+
+TEST_CASE( "Validate pcapng capture decoding", "[pcap]" )
+{
+   pkt_pcap_stats_t stats;
+
+   SECTION( "Verify UDP flows over IPv6 are decoded apart, with nanosecond timestamps" )
+   {
+      // Two senders, each with frames split across datagrams, interleaved
+      std::vector< Record > records;
+      Bytes streams[ 2 ] = { tcpStream( 20 ), tcpStream( 30 ) };
+      for ( size_t offset = 0; offset < streams[ 1 ].size(); offset += 29 )
+      {
+         for ( uint8_t sender = 0; sender < 2; ++sender )
+         {
+            if ( offset < streams[ sender ].size() )
+            {
+               size_t length = std::min< size_t >( 29, streams[ sender ].size() - offset );
+               Bytes payload( streams[ sender ].begin() + offset,
+                              streams[ sender ].begin() + offset + length );
+               records.push_back(
+                  { 5000000000 + offset, udpPacket( 0x10 + sender, 4000 + sender, payload ) } );
+            }
+         }
+      }
+      // A packet that isn't UDP or TCP
+      records.push_back( { 0, Bytes( { 0x45, 0, 0, 20, 0, 0, 0, 0, 64, 1, 0, 0, 1, 2, 3, 4, 5,
+                                       6, 7, 8 } ) } );
+
+      std::vector< Frame > frames = readCapture( pcapngFile( 101, records ), stats );
+      REQUIRE( 50 == frames.size() );
+      REQUIRE( 2 == stats.flows );
+      REQUIRE( 1 == stats.skipped );
+      REQUIRE( records.size() == stats.records );
+      uint8_t next[ 2 ] = { 0, 0 };
+      for ( const Frame& frame : frames )
+      {
+         REQUIRE( 6 == frame.m_flow.ip_version );
+         REQUIRE( 17 == frame.m_flow.protocol );
+         REQUIRE( 7000 == frame.m_flow.dst_port );
+         size_t sender = frame.m_flow.src_port - 4000;
+         REQUIRE( sender < 2 );
+         REQUIRE( 0x10 + sender == frame.m_flow.src_addr[ 15 ] );
+         REQUIRE( frameData( next[ sender ]++ ) == frame.m_data );
+         REQUIRE( frame.m_timestamp >= 5000000000 );
+      }
+      REQUIRE( 20 == next[ 0 ] );
+      REQUIRE( 30 == next[ 1 ] );
+   }
+
+   SECTION( "Verify binary timestamp units finer than a nanosecond" )
+   {
+      // 2^-40 second ticks: 5.5 seconds, and 5 seconds and 2^-30
+      const uint8_t BINARY_40 = 0x80 | 40;
+      Bytes payload = encode( frameData( 0 ) );
+      std::vector< Record > records = {
+         { ( uint64_t( 11 ) << 39 ), udpPacket( 0x10, 4000, payload ) },
+         { ( uint64_t( 5 ) << 40 ) + ( uint64_t( 1 ) << 10 ), udpPacket( 0x11, 4001, payload ) } };
+
+      std::vector< Frame > frames = readCapture( pcapngFile( 101, records, BINARY_40 ), stats );
+      REQUIRE( 2 == frames.size() );
+      REQUIRE( 5500000000 == frames[ 0 ].m_timestamp );
+      REQUIRE( 5000000000 == frames[ 1 ].m_timestamp );
+   }
+}
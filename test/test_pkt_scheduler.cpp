@@ -0,0 +1,119 @@
+#include "catch.hpp"
+
+#include <atomic>
+#include <libsrc/pkt_scheduler.h>
+#include <random>
+#include <vector>
+
+// What one channel's decoder has delivered, and whether its callback is running right now
+struct ChannelLog
+{
+   std::vector< uint32_t > sequences;
+   std::atomic< bool > inCallback{ false };
+   bool overlapped = false;
+};
+
+// Every packet carries its sequence number within the channel, little-endian
+static void channelCallbackFunc( void* ctx, size_t bufferLength, const uint8_t* dataBuffer )
+{
+   auto* log = static_cast< ChannelLog* >( ctx );
+   if ( log->inCallback.exchange( true ) )
+   {
+      log->overlapped = true;
+   }
+   uint32_t sequence = 0;
+   for ( size_t idx = 0; idx < bufferLength && idx < 4; ++idx )
+   {
+      sequence |= static_cast< uint32_t >( dataBuffer[ idx ] ) << ( 8 * idx );
+   }
+   log->sequences.push_back( sequence );
+   log->inCallback = false;
+}
+
+// Feeds NUM_PACKETS numbered packets to each of NUM_CHANNELS channels, split into random-size
+// writes and interleaved across channels, then checks every channel got all of them in order
+static void runChannels( size_t numWorkers, bool stealing )
+{
+   const size_t NUM_CHANNELS( 64 );
+   const uint32_t NUM_PACKETS( 200 );
+
+   pkt_scheduler_t* scheduler = pkt_scheduler_create( numWorkers );
+   pkt_scheduler_set_work_stealing( scheduler, stealing );
+   std::vector< ChannelLog > logs( NUM_CHANNELS );
+   std::vector< pkt_decoder_t* > decoders;
+   std::vector< pkt_channel_t* > channels;
+   std::vector< std::vector< uint8_t > > streams( NUM_CHANNELS );
+   for ( size_t idx = 0; idx < NUM_CHANNELS; ++idx )
+   {
+      decoders.push_back( pkt_decoder_create( channelCallbackFunc, &logs[ idx ] ) );
+      channels.push_back(
+         pkt_scheduler_add_channel( scheduler, static_cast< uint32_t >( idx ), decoders.back() ) );
+      for ( uint32_t sequence = 0; sequence < NUM_PACKETS; ++sequence )
+      {
+         // Sequence numbers stay below 0x0100, so only the low byte can need stuffing
+         const uint8_t LOW = static_cast< uint8_t >( sequence );
+         if ( STX == LOW || ETX == LOW || DLE == LOW )
+         {
+            streams[ idx ].insert( streams[ idx ].end(),
+                                   { STX, DLE, uint8_t( LOW | ENC ), 0, ETX } );
+         }
+         else
+         {
+            streams[ idx ].insert( streams[ idx ].end(), { STX, LOW, 0, ETX } );
+         }
+      }
+   }
+
+   std::mt19937 rng( 1234 );
+   std::vector< size_t > offsets( NUM_CHANNELS, 0 );
+   size_t remaining = NUM_CHANNELS;
+   while ( remaining > 0 )
+   {
+      size_t idx = rng() % NUM_CHANNELS;
+      size_t length = std::min< size_t >( 1 + rng() % 37, streams[ idx ].size() - offsets[ idx ] );
+      if ( 0 == length )
+      {
+         continue;
+      }
+      pkt_scheduler_submit( scheduler, channels[ idx ], length, &streams[ idx ][ offsets[ idx ] ] );
+      offsets[ idx ] += length;
+      if ( offsets[ idx ] == streams[ idx ].size() )
+      {
+         --remaining;
+      }
+   }
+   pkt_scheduler_drain( scheduler );
+
+   for ( size_t idx = 0; idx < NUM_CHANNELS; ++idx )
+   {
+      REQUIRE_FALSE( logs[ idx ].overlapped );
+      REQUIRE( NUM_PACKETS == logs[ idx ].sequences.size() );
+      for ( uint32_t sequence = 0; sequence < NUM_PACKETS; ++sequence )
+      {
+         REQUIRE( sequence == logs[ idx ].sequences[ sequence ] );
+      }
+   }
+   pkt_scheduler_destroy( scheduler );
+   for ( pkt_decoder_t* decoder : decoders )
+   {
+      pkt_decoder_destroy( decoder );
+   }
+}
+
+TEST_CASE( "Validate multi-threaded channel scheduling", "[scheduler]" )
+{
+   SECTION( "Verify per-channel ordering with work stealing" )
+   {
+      runChannels( 4, true );
+   }
+
+   SECTION( "Verify per-channel ordering with channels pinned to their home worker" )
+   {
+      runChannels( 4, false );
+   }
+
+   SECTION( "Verify a single worker handles every channel" )
+   {
+      runChannels( 1, true );
+   }
+}
@@ -0,0 +1,251 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <libsrc/pkt_shm_ring.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+   // Reads count packets from a ring, checking their sequence numbers and contents. Returns an
+   // exit status for a child process
+   int readPackets( int fd, uint64_t count )
+   {
+      pkt_shm_reader_t* reader = pkt_shm_reader_open( fd );
+      if ( nullptr == reader )
+      {
+         return 1;
+      }
+      uint8_t buffer[ MAX_DECODED_DATA_LENGTH ];
+      size_t length;
+      uint64_t sequence;
+      uint64_t expected = 1;
+      size_t idle = 0;
+      while ( ( expected <= count ) && ( idle < 100000000 ) )
+      {
+         pkt_shm_result_t result = pkt_shm_reader_next( reader, buffer, &length, &sequence );
+         if ( PKT_SHM_EMPTY == result )
+         {
+            ++idle;
+            sched_yield();
+            continue;
+         }
+         // Packet n is n % 200 + 1 bytes of 0x40 + n % 64
+         if ( ( PKT_SHM_PACKET != result ) || ( expected != sequence )
+              || ( sequence % 200 + 1 != length )
+              || ( 0x40 + sequence % 64 != buffer[ length - 1 ] ) )
+         {
+            return 2;
+         }
+         ++expected;
+      }
+      pkt_shm_reader_close( reader );
+      return ( expected > count ) ? 0 : 3;
+   }
+
+   // Packet n for a ring that laps: n % 200 + 1 bytes, each depending on n and its position, so a
+   // copy torn by the producer shows
+   void lappedPacket( uint64_t n, std::vector< uint8_t >& packet )
+   {
+      packet.resize( n % 200 + 1 );
+      for ( size_t idx = 0; idx < packet.size(); ++idx )
+      {
+         packet[ idx ] = static_cast< uint8_t >( n * 7 + idx );
+      }
+   }
+
+   // Reads a ring the producer laps until packet count arrives, checking every packet that does
+   // is intact and that the ones skipped are all counted lost. Signals ready once the reader is
+   // open. Returns an exit status for a child process
+   int readLapped( int fd, uint64_t count, int ready )
+   {
+      pkt_shm_reader_t* reader = pkt_shm_reader_open( fd );
+      if ( ( nullptr == reader ) || ( 1 != write( ready, "r", 1 ) ) )
+      {
+         return 1;
+      }
+      uint8_t buffer[ MAX_DECODED_DATA_LENGTH ];
+      std::vector< uint8_t > expected;
+      size_t length;
+      uint64_t sequence = 0;
+      uint64_t previous = 0;
+      uint64_t received = 0;
+      uint64_t skipped = 0;
+      size_t idle = 0;
+      while ( ( previous < count ) && ( idle < 100000000 ) )
+      {
+         pkt_shm_result_t result = pkt_shm_reader_next( reader, buffer, &length, &sequence );
+         if ( PKT_SHM_PACKET != result )
+         {
+            idle += ( PKT_SHM_EMPTY == result ) ? 1 : 0;
+            sched_yield();
+            continue;
+         }
+         lappedPacket( sequence, expected );
+         if ( ( sequence <= previous ) || ( expected.size() != length )
+              || !std::equal( expected.begin(), expected.end(), buffer ) )
+         {
+            return 2;
+         }
+         skipped += sequence - previous - 1;
+         previous = sequence;
+         ++received;
+      }
+      uint64_t lost = pkt_shm_reader_lost( reader );
+      pkt_shm_reader_close( reader );
+      if ( previous < count )
+      {
+         return 3;
+      }
+      return ( ( skipped == lost ) && ( received + lost == count ) ) ? 0 : 4;
+   }
+
+   // Frames packet n for a decoder. Its bytes are never control characters, so need no escapes
+   void framePacket( uint64_t n, std::vector< uint8_t >& stream )
+   {
+      stream.push_back( STX );
+      stream.insert( stream.end(), n % 200 + 1, static_cast< uint8_t >( 0x40 + n % 64 ) );
+      stream.push_back( ETX );
+   }
+} // namespace
+
+TEST_CASE( "Validate the shared-memory packet ring", "[shm]" )
+{
+   SECTION( "Verify reader processes see every packet a decoder publishes" )
+   {
+      const uint64_t NUM_PACKETS( 2000 );
+      const size_t NUM_READERS( 3 );
+      pkt_shm_ring_t* ring = pkt_shm_ring_create( NUM_PACKETS );
+      REQUIRE( nullptr != ring );
+      std::vector< pid_t > children;
+      for ( size_t child = 0; child < NUM_READERS; ++child )
+      {
+         pid_t pid = fork();
+         if ( 0 == pid )
+         {
+            _exit( readPackets( pkt_shm_ring_fd( ring ), NUM_PACKETS ) );
+         }
+         children.push_back( pid );
+      }
+
+      pkt_decoder_t* decoder = pkt_decoder_create( pkt_shm_ring_publish_packet, ring );
+      std::vector< uint8_t > stream;
+      for ( uint64_t n = 1; n <= NUM_PACKETS; ++n )
+      {
+         stream.clear();
+         framePacket( n, stream );
+         pkt_decoder_write_bytes( decoder, stream.size(), stream.data() );
+      }
+      pkt_decoder_destroy( decoder );
+
+      for ( pid_t pid : children )
+      {
+         int status = -1;
+         REQUIRE( pid == waitpid( pid, &status, 0 ) );
+         REQUIRE( WIFEXITED( status ) );
+         REQUIRE( 0 == WEXITSTATUS( status ) );
+      }
+      pkt_shm_ring_destroy( ring );
+   }
+
+   SECTION( "Verify readers a small ring laps get intact packets and count the rest lost" )
+   {
+      const uint64_t NUM_PACKETS( 200000 );
+      const size_t NUM_READERS( 2 );
+      pkt_shm_ring_t* ring = pkt_shm_ring_create( 8 );
+      REQUIRE( nullptr != ring );
+      int ready[ 2 ];
+      REQUIRE( 0 == pipe( ready ) );
+      std::vector< pid_t > children;
+      for ( size_t child = 0; child < NUM_READERS; ++child )
+      {
+         pid_t pid = fork();
+         if ( 0 == pid )
+         {
+            _exit( readLapped( pkt_shm_ring_fd( ring ), NUM_PACKETS, ready[ 1 ] ) );
+         }
+         children.push_back( pid );
+      }
+      // Every reader starts at packet 1, so none are missed before it opens the ring
+      for ( size_t child = 0; child < NUM_READERS; ++child )
+      {
+         char signal;
+         REQUIRE( 1 == read( ready[ 0 ], &signal, 1 ) );
+      }
+      close( ready[ 0 ] );
+      close( ready[ 1 ] );
+
+      std::vector< uint8_t > packet;
+      for ( uint64_t n = 1; n <= NUM_PACKETS; ++n )
+      {
+         lappedPacket( n, packet );
+         REQUIRE( n == pkt_shm_ring_publish( ring, packet.size(), packet.data() ) );
+         if ( 0 == n % 100 )
+         {
+            // Let the readers catch up now and then, so they are lapped over and over rather
+            // than once at the end
+            usleep( 20 );
+         }
+      }
+
+      for ( pid_t pid : children )
+      {
+         int status = -1;
+         REQUIRE( pid == waitpid( pid, &status, 0 ) );
+         REQUIRE( WIFEXITED( status ) );
+         REQUIRE( 0 == WEXITSTATUS( status ) );
+      }
+      pkt_shm_ring_destroy( ring );
+   }
+
+   SECTION( "Verify a reader that falls behind is told it was overrun" )
+   {
+      const uint8_t PACKET[] = { 0x41, 0x42 };
+      pkt_shm_ring_t* ring = pkt_shm_ring_create( 10 );
+      pkt_shm_reader_t* reader = pkt_shm_reader_open( pkt_shm_ring_fd( ring ) );
+      REQUIRE( nullptr != reader );
+      uint8_t buffer[ MAX_DECODED_DATA_LENGTH ];
+      size_t length;
+      uint64_t sequence;
+      REQUIRE( PKT_SHM_EMPTY == pkt_shm_reader_next( reader, buffer, &length, &sequence ) );
+
+      // The ring holds 16 packets, so the first 24 of 40 are lost
+      for ( size_t packet = 0; packet < 40; ++packet )
+      {
+         pkt_shm_ring_publish( ring, sizeof( PACKET ), PACKET );
+      }
+      REQUIRE( PKT_SHM_OVERRUN == pkt_shm_reader_next( reader, buffer, &length, &sequence ) );
+      REQUIRE( 24 == pkt_shm_reader_lost( reader ) );
+      for ( uint64_t expected = 25; expected <= 40; ++expected )
+      {
+         REQUIRE( PKT_SHM_PACKET == pkt_shm_reader_next( reader, buffer, &length, &sequence ) );
+         REQUIRE( expected == sequence );
+         REQUIRE( sizeof( PACKET ) == length );
+      }
+      REQUIRE( PKT_SHM_EMPTY == pkt_shm_reader_next( reader, buffer, &length, &sequence ) );
+
+      // A packet too long for a slot isn't published
+      std::vector< uint8_t > tooLong( MAX_DECODED_DATA_LENGTH + 1, 0x41 );
+      REQUIRE( 0 == pkt_shm_ring_publish( ring, tooLong.size(), tooLong.data() ) );
+      REQUIRE( PKT_SHM_EMPTY == pkt_shm_reader_next( reader, buffer, &length, &sequence ) );
+
+      // A reader that joins late starts at the oldest packet still held
+      pkt_shm_reader_t* late = pkt_shm_reader_open( pkt_shm_ring_fd( ring ) );
+      REQUIRE( PKT_SHM_PACKET == pkt_shm_reader_next( late, buffer, &length, &sequence ) );
+      REQUIRE( 25 == sequence );
+      pkt_shm_reader_close( late );
+      pkt_shm_reader_close( reader );
+      pkt_shm_ring_destroy( ring );
+   }
+
+   SECTION( "Verify an fd that isn't a ring is rejected" )
+   {
+      int fds[ 2 ];
+      REQUIRE( 0 == pipe( fds ) );
+      REQUIRE( nullptr == pkt_shm_reader_open( fds[ 0 ] ) );
+      close( fds[ 0 ] );
+      close( fds[ 1 ] );
+   }
+}
@@ -0,0 +1,137 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <libsrc/pkt_decoder.h>
+#include <libsrc/pkt_simd.h>
+#include <sys/mman.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+   const pkt_simd_level_t LEVELS[] = { PKT_SIMD_SCALAR, PKT_SIMD_SSE2, PKT_SIMD_AVX2,
+                                       PKT_SIMD_AVX512 };
+   // Values one bit away from a control byte, which a sloppy comparison would match
+   const uint8_t NEAR_MISSES[] = { 0x00, 0x01, 0x06, 0x07, 0x11, 0x12, 0x18,
+                                   0x22, 0x23, 0x30, 0x82, 0x83, 0x90, 0xFF };
+   const uint8_t CONTROLS[] = { STX, ETX, DLE };
+
+   std::vector< uint8_t > plainBytes( size_t length )
+   {
+      std::vector< uint8_t > data( length );
+      for ( size_t idx = 0; idx < length; ++idx )
+      {
+         data[ idx ] = NEAR_MISSES[ idx % sizeof( NEAR_MISSES ) ];
+      }
+      return data;
+   }
+} // namespace
+
+TEST_CASE( "Validate SIMD kernel selection", "[simd]" )
+{
+   SECTION( "Verify the selected level is supported, and scalar always is" )
+   {
+      REQUIRE( pkt_simd_supported( pkt_simd_level() ) );
+      REQUIRE( pkt_simd_supported( PKT_SIMD_SCALAR ) );
+      REQUIRE( !pkt_simd_supported( static_cast< pkt_simd_level_t >( 99 ) ) );
+      REQUIRE( std::string( "scalar" ) == pkt_simd_level_name( PKT_SIMD_SCALAR ) );
+      REQUIRE( std::string( "avx512" ) == pkt_simd_level_name( PKT_SIMD_AVX512 ) );
+   }
+
+   SECTION( "Verify every supported kernel finds the first control byte at every position" )
+   {
+      for ( pkt_simd_level_t level : LEVELS )
+      {
+         if ( !pkt_simd_supported( level ) )
+         {
+            continue;
+         }
+         INFO( pkt_simd_level_name( level ) );
+         for ( size_t length = 0; length <= 160; ++length )
+         {
+            // Every start alignment, with the run ending anywhere in or after the data
+            for ( size_t start = 0; start < 8; ++start )
+            {
+               std::vector< uint8_t > data = plainBytes( start + length );
+               REQUIRE( length == pkt_simd_find_control( level, length, data.data() + start ) );
+               for ( size_t position = 0; position < length; ++position )
+               {
+                  uint8_t control = CONTROLS[ ( position + length ) % sizeof( CONTROLS ) ];
+                  data[ start + position ] = control;
+                  if ( position + 1 < length )
+                  {
+                     // A later control byte mustn't be found first
+                     data[ start + length - 1 ] = CONTROLS[ position % sizeof( CONTROLS ) ];
+                  }
+                  REQUIRE( position
+                           == pkt_simd_find_control( level, length, data.data() + start ) );
+                  data = plainBytes( start + length );
+               }
+            }
+         }
+      }
+   }
+
+   SECTION( "Verify every supported kernel marks each control byte in its own bitmap" )
+   {
+      const size_t WORDS = 4;
+      for ( pkt_simd_level_t level : LEVELS )
+      {
+         if ( !pkt_simd_supported( level ) )
+         {
+            continue;
+         }
+         INFO( pkt_simd_level_name( level ) );
+         for ( size_t length = 0; length <= 64 * WORDS; ++length )
+         {
+            std::vector< uint8_t > data = plainBytes( length );
+            for ( size_t idx = 0; idx < length; idx += 1 + idx % 5 )
+            {
+               data[ idx ] = CONTROLS[ ( idx + length ) % sizeof( CONTROLS ) ];
+            }
+            // Words past the data's must be left alone, so start them all set
+            uint64_t bitmaps[ sizeof( CONTROLS ) ][ WORDS + 1 ];
+            std::fill( &bitmaps[ 0 ][ 0 ], &bitmaps[ 0 ][ 0 ] + sizeof( bitmaps ) / 8, ~0ULL );
+            pkt_simd_control_bitmaps(
+               level, length, data.data(), bitmaps[ 0 ], bitmaps[ 1 ], bitmaps[ 2 ] );
+            for ( size_t control = 0; control < sizeof( CONTROLS ); ++control )
+            {
+               for ( size_t idx = 0; idx < 64 * ( ( length + 63 ) / 64 ); ++idx )
+               {
+                  bool set = ( bitmaps[ control ][ idx / 64 ] >> ( idx % 64 ) ) & 1;
+                  REQUIRE( set == ( ( idx < length ) && ( CONTROLS[ control ] == data[ idx ] ) ) );
+               }
+               REQUIRE( ~0ULL == bitmaps[ control ][ ( length + 63 ) / 64 ] );
+            }
+         }
+      }
+   }
+
+   SECTION( "Verify no kernel reads past the end of its data" )
+   {
+      // The data ends at a page boundary, with an inaccessible page after it
+      size_t pageSize = static_cast< size_t >( sysconf( _SC_PAGESIZE ) );
+      void* pages =
+         mmap( nullptr, 2 * pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+      REQUIRE( MAP_FAILED != pages );
+      uint8_t* end = static_cast< uint8_t* >( pages ) + pageSize;
+      REQUIRE( 0 == mprotect( end, pageSize, PROT_NONE ) );
+      std::vector< uint8_t > data = plainBytes( pageSize );
+      std::copy( data.begin(), data.end(), static_cast< uint8_t* >( pages ) );
+      for ( pkt_simd_level_t level : LEVELS )
+      {
+         if ( pkt_simd_supported( level ) )
+         {
+            for ( size_t length = 0; length <= 200; ++length )
+            {
+               REQUIRE( length == pkt_simd_find_control( level, length, end - length ) );
+               uint64_t bitmaps[ 3 ][ 4 ];
+               pkt_simd_control_bitmaps(
+                  level, length, end - length, bitmaps[ 0 ], bitmaps[ 1 ], bitmaps[ 2 ] );
+            }
+         }
+      }
+      munmap( pages, 2 * pageSize );
+   }
+}
@@ -0,0 +1,136 @@
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <libsrc/pkt_stream.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+   // Source that hands out a byte string a few bytes at a time, without ever suspending
+   struct ChunkedSource
+   {
+      struct ReadAwaiter
+      {
+         size_t m_result;
+
+         bool await_ready()
+         {
+            return true;
+         }
+         void await_suspend( std::coroutine_handle<> )
+         {
+         }
+         size_t await_resume()
+         {
+            return m_result;
+         }
+      };
+
+      ReadAwaiter read( uint8_t* buffer, size_t length )
+      {
+         size_t count = std::min( std::min( length, m_chunk ), m_bytes.size() - m_offset );
+         std::copy( m_bytes.begin() + m_offset, m_bytes.begin() + m_offset + count, buffer );
+         m_offset += count;
+         return { count };
+      }
+
+      std::vector< uint8_t > m_bytes;
+      size_t m_chunk;
+      size_t m_offset;
+   };
+
+   std::string toString( const PacketView* packet )
+   {
+      return std::string( packet->m_data, packet->m_data + packet->m_length );
+   }
+
+   template < typename Source >
+   PacketTask collectPackets( Source& source, std::vector< std::string >& packets )
+   {
+      PacketStream stream = pkt_decode_stream( source, 16 );
+      while ( const PacketView* packet = co_await stream.next() )
+      {
+         packets.push_back( toString( packet ) );
+      }
+   }
+} // namespace
+
+TEST_CASE( "Validate coroutine packet streams", "[stream]" )
+{
+   const uint8_t BYTESTREAM[] = { 0x01, STX, 'a', 'b', ETX, STX, 'c', DLE, 0x22, 'd', ETX,
+                                  STX,  'e', ETX, 0x05, STX, 'f', 'g', 'h', ETX };
+   std::vector< std::string > packets;
+
+   SECTION( "Verify packets are yielded in order from an in-memory source" )
+   {
+      ChunkedSource source = { { BYTESTREAM, BYTESTREAM + sizeof( BYTESTREAM ) }, 3, 0 };
+      PacketTask task = collectPackets( source, packets );
+      REQUIRE( task.done() );
+      // DLE 0x22 de-stuffs to an STX
+      REQUIRE( std::vector< std::string >( { "ab", "c\x02" "d", "e", "fgh" } ) == packets );
+   }
+
+   SECTION( "Verify a consumer waits on an fd without blocking its thread" )
+   {
+      int fds[ 2 ];
+      REQUIRE( 0 == pipe( fds ) );
+      fcntl( fds[ 0 ], F_SETFL, fcntl( fds[ 0 ], F_GETFL ) | O_NONBLOCK );
+      PacketEventLoop loop;
+      PacketFdSource source( fds[ 0 ], loop );
+      PacketTask task = collectPackets( source, packets );
+
+      // Nothing written yet, so the consumer is parked on the loop
+      REQUIRE( !task.done() );
+      REQUIRE( 1 == loop.m_waiters.size() );
+      for ( size_t idx = 0; idx < sizeof( BYTESTREAM ); idx += 5 )
+      {
+         REQUIRE( 5 == write( fds[ 1 ], BYTESTREAM + idx, 5 ) );
+         REQUIRE( loop.runOnce( 1000 ) );
+         REQUIRE( !task.done() );
+      }
+      REQUIRE( 4 == packets.size() );
+      close( fds[ 1 ] );
+      loop.run();
+      REQUIRE( task.done() );
+      REQUIRE( 0 == source.m_error );
+      REQUIRE( "fgh" == packets.back() );
+      close( fds[ 0 ] );
+   }
+
+   SECTION( "Verify a consumer whose fd another drained first waits again" )
+   {
+      // Each record is one whole frame, so whichever consumer reads it gets the packet
+      int fds[ 2 ];
+      REQUIRE( 0 == socketpair( AF_UNIX, SOCK_SEQPACKET, 0, fds ) );
+      fcntl( fds[ 0 ], F_SETFL, fcntl( fds[ 0 ], F_GETFL ) | O_NONBLOCK );
+      PacketEventLoop loop;
+      PacketFdSource first( fds[ 0 ], loop );
+      PacketFdSource second( fds[ 0 ], loop );
+      std::vector< std::string > others;
+      PacketTask firstTask = collectPackets( first, packets );
+      PacketTask secondTask = collectPackets( second, others );
+      REQUIRE( 2 == loop.m_waiters.size() );
+
+      // Both are woken for each record, but only one can read it
+      const uint8_t FRAME[] = { STX, 'a', 'b', ETX };
+      for ( size_t frame = 0; frame < 3; ++frame )
+      {
+         REQUIRE( sizeof( FRAME ) == write( fds[ 1 ], FRAME, sizeof( FRAME ) ) );
+         REQUIRE( loop.runOnce( 1000 ) );
+         REQUIRE( 2 == loop.m_waiters.size() );
+         REQUIRE( frame + 1 == packets.size() + others.size() );
+      }
+      close( fds[ 1 ] );
+      loop.run();
+      REQUIRE( firstTask.done() );
+      REQUIRE( secondTask.done() );
+      REQUIRE( 0 == first.m_error );
+      REQUIRE( 0 == second.m_error );
+      close( fds[ 0 ] );
+   }
+}